@@ -14,7 +14,7 @@ import pickle
 
 import gym
 from .house import House
-from .objrender import RenderMode
+from .objrender import RenderMode, PanoramaMode
 
 __all__ = ['Environment', 'MultiHouseEnv']
 
@@ -86,7 +86,11 @@ class Environment():
         """
         Args:
             mode (str or enum): either a RenderMode value or its string version.
-                                'rgb', 'depth', 'semantic', 'instance', or 'invdepth'
+                                'rgb', 'depth', 'semantic', 'instance', 'invdepth',
+                                'normal', 'position' or 'rgb_flat'.
+                                'normal' and 'position' render float32 images.
+                                'rgb_flat' renders the colors of the materials
+                                without textures, which are then never loaded.
         """
         mappings = {
             'rgb': RenderMode.RGB,
@@ -94,6 +98,9 @@ class Environment():
             'semantic': RenderMode.SEMANTIC,
             'instance': RenderMode.INSTANCE,
             'invdepth': RenderMode.INVDEPTH,
+            'normal': RenderMode.NORMAL,
+            'position': RenderMode.POSITION,
+            'rgb_flat': RenderMode.RGB_FLAT,
         }
         if isinstance(mode, six.string_types):
             mode = mode.lower()
@@ -138,6 +145,70 @@ class Environment():
             self.set_render_mode(backup)
             return ret
 
+    def render_panorama(self, panorama='equirectangular', resolution=None, fov=180, mode=None, copy=False):
+        """
+        Args:
+            panorama (str or enum): 'equirectangular', 'fisheye', or a PanoramaMode value.
+            resolution: (w, h) integer. By default (4h, 2h) for equirectangular,
+                        and the rendering resolution for fisheye.
+            fov (float): field of view of fisheye in degrees.
+            mode (str or enum or None): If None, use the current mode.
+
+        Returns:
+            An image of the given resolution
+        """
+        if isinstance(panorama, six.string_types):
+            panorama = {'equirectangular': PanoramaMode.EQUIRECTANGULAR,
+                        'fisheye': PanoramaMode.FISHEYE}[panorama.lower()]
+        if resolution is None:
+            w, h = self.resolution
+            if panorama == PanoramaMode.EQUIRECTANGULAR:
+                resolution = (4 * h, 2 * h)
+            else:
+                resolution = (w, h)
+        if mode is None:
+            return np.array(self.api.renderPanorama(panorama, resolution[0], resolution[1], fov), copy=copy)
+        else:
+            backup = self.api_mode
+            self.set_render_mode(mode)
+            ret = np.array(self.api.renderPanorama(panorama, resolution[0], resolution[1], fov), copy=copy)
+            self.set_render_mode(backup)
+            return ret
+
+    def render_with_flow(self, prev_camera, mode=None, copy=False):
+        """
+        Args:
+            prev_camera: the camera of the previous step, e.g. copy.copy(env.cam)
+                         taken before moving.
+            mode (str or enum or None): If None, use the current mode.
+
+        Returns:
+            (image, flow). The flow is a float32 array of shape (h, w, 2):
+            for each pixel, the displacement (dx, dy) in pixels to the same point
+            in the image rendered from prev_camera.
+        """
+        if mode is not None:
+            backup = self.api_mode
+            self.set_render_mode(mode)
+        img, flow = self.api.renderWithFlow(prev_camera)
+        if mode is not None:
+            self.set_render_mode(backup)
+        return np.array(img, copy=copy), np.array(flow, copy=copy)
+
+    def render_point_cloud(self, voxel_size=0, labels=False):
+        """
+        Args:
+            voxel_size (float): if positive, keep one point (the centroid) per voxel of this size.
+            labels (bool): whether to compute the semantic class of each point.
+
+        Returns:
+            A float32 array of shape (N, 4). Each row is (x, y, z, label) in world
+            coordinates, where label is the row index of the class in the
+            semantic label file, or -1 if labels=False.
+        """
+        cloud = np.array(self.api.renderPointCloud(voxel_size, labels), copy=False)
+        return cloud.reshape(-1, 4)
+
 
     @property
     def resolution(self):
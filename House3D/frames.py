@@ -0,0 +1,47 @@
+# Copyright 2017-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the license found in the
+# LICENSE file in the root directory of this source tree.
+"""
+Read the raw frames written by `objrender.AsyncWriter.writeRaw`.
+
+Usage:
+    for key, frame in read_frames('raw_dir'):
+        ...   # frame is a h x w x c uint8 array
+"""
+
+import glob
+import os
+import struct
+
+import numpy as np
+
+MAGIC = b'H3DFRM1\0'
+
+
+def read_shard(fname):
+    """Yield (key, frame) of each record in a shard file."""
+    with open(fname, 'rb') as f:
+        if f.read(len(MAGIC)) != MAGIC:
+            raise ValueError('{} is not a frame shard'.format(fname))
+        while True:
+            header = f.read(4)
+            if not header:
+                return
+            key_len, = struct.unpack('<I', header)
+            key = f.read(key_len).decode('utf-8')
+            h, w, c = struct.unpack('<3i', f.read(12))
+            data = f.read(h * w * c)
+            yield key, np.frombuffer(data, dtype=np.uint8).reshape(h, w, c)
+
+
+def read_frames(raw_dir):
+    """Yield (key, frame) of all shards in raw_dir. Frames written by
+    different threads are not in the order they were queued."""
+    def order(fname):
+        worker, index = os.path.basename(fname)[len('frames-'):-len('.bin')].split('-')
+        return int(worker), int(index)
+    for fname in sorted(glob.glob(os.path.join(raw_dir, 'frames-*.bin')), key=order):
+        for record in read_shard(fname):
+            yield record
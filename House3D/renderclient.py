@@ -0,0 +1,167 @@
+# Copyright 2017-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the license found in the
+# LICENSE file in the root directory of this source tree.
+"""
+A client of `renderer/render-server.bin`, which renders for many processes
+with a few shared GL contexts. See renderer/suncg/renderServer.hh for the
+protocol.
+
+Usage:
+    # ./render-server.bin /tmp/house3d.sock --width 120 --height 90 --contexts 2
+    api = RenderClient(120, 90, socket_path='/tmp/house3d.sock')
+    env = Environment(api, house, config)   # instead of objrender.RenderAPI
+
+It implements the methods of `objrender.RenderAPI` used by `Environment`:
+loadScene, getCamera, setMode, render, renderCubeMap, resolution,
+getNameFromInstanceColor and printContextInfo.
+Float modes (NORMAL and POSITION) are not supported.
+"""
+
+import collections
+import mmap
+import os
+import socket
+import struct
+
+import numpy as np
+
+from .objrender import Camera, RenderMode, Vec3
+
+__all__ = ['RenderClient', 'RenderServerError']
+
+DEFAULT_SOCKET = '/tmp/house3d.sock'
+
+# ops of RenderServer
+_HELLO, _LOAD_SCENE, _RENDER, _RENDER_CUBEMAP, _INSTANCE_NAME, _CONTEXT_INFO = range(1, 7)
+
+Geometry = collections.namedtuple('Geometry', ['w', 'h'])
+
+
+class RenderServerError(RuntimeError):
+    pass
+
+
+def _pack_string(s):
+    s = s.encode('utf-8')
+    return struct.pack('<I', len(s)) + s
+
+
+class RenderClient(object):
+    def __init__(self, w, h, device=0, socket_path=None):
+        """
+        Args:
+            w, h: the resolution, which has to be the one of the server.
+            device: unused, the server renders on its own device.
+            socket_path: the socket of the server. Defaults to the environment
+                variable HOUSE3D_RENDER_SERVER, or /tmp/house3d.sock.
+        """
+        if socket_path is None:
+            socket_path = os.environ.get('HOUSE3D_RENDER_SERVER', DEFAULT_SOCKET)
+        self._socket_path = socket_path
+        self._geo = Geometry(w, h)
+        self._sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self._sock.connect(socket_path)
+
+        body, fd = self._call(_HELLO, struct.pack('<2i', w, h), with_fd=True)
+        self._nr_slot, self._slot_bytes = struct.unpack('<iQ', body)
+        try:
+            self._shm = mmap.mmap(fd, self._nr_slot * self._slot_bytes)
+        finally:
+            os.close(fd)
+        self._mode = RenderMode.RGB
+        self._camera = None
+
+    def close(self):
+        """Disconnect. Frames returned by render() become invalid."""
+        if self._sock is not None:
+            self._sock.close()
+            self._sock = None
+
+    def _recv(self, n):
+        buf = b''
+        while len(buf) < n:
+            chunk = self._sock.recv(n - len(buf))
+            if not chunk:
+                raise RenderServerError('The render server closed the connection')
+            buf += chunk
+        return buf
+
+    def _call(self, op, args=b'', with_fd=False):
+        self._sock.sendall(struct.pack('<2I', op, len(args)) + args)
+        fd = None
+        if with_fd:
+            # the fd arrives with the first byte of the response
+            header, ancdata, _, _ = self._sock.recvmsg(8, socket.CMSG_LEN(4))
+            for level, kind, data in ancdata:
+                if level == socket.SOL_SOCKET and kind == socket.SCM_RIGHTS:
+                    fd = struct.unpack('i', data[:4])[0]
+            if not header:
+                raise RenderServerError('The render server closed the connection')
+            header += self._recv(8 - len(header))
+        else:
+            header = self._recv(8)
+        status, size = struct.unpack('<iI', header)
+        body = self._recv(size)
+        if status != 0:
+            if fd is not None:
+                os.close(fd)
+            raise RenderServerError(body.decode('utf-8', 'replace'))
+        if with_fd and fd is None:
+            raise RenderServerError('No shared memory from the render server')
+        return (body, fd) if with_fd else body
+
+    def _pose(self):
+        c = self._camera
+        if c is None:
+            raise RenderServerError('Call loadScene first')
+        return struct.pack('<11f', c.pos.x, c.pos.y, c.pos.z, c.front.x, c.front.y, c.front.z,
+                           c.yaw, c.pitch, c.near, c.far, c.vertical_fov)
+
+    def _frame(self, body):
+        slot, rows, cols, channels = struct.unpack('<4i', body)
+        # a view of the shared memory, valid until nr_slot more frames are rendered
+        return np.frombuffer(self._shm, dtype=np.uint8, count=rows * cols * channels,
+                             offset=slot * self._slot_bytes).reshape(rows, cols, channels)
+
+    def printContextInfo(self):
+        ctx, nr_ctx, nr_client = struct.unpack('<3i', self._call(_CONTEXT_INFO))
+        print('Render server at {}: context {}/{}, shared by {} clients'.format(
+            self._socket_path, ctx, nr_ctx, nr_client))
+
+    def loadScene(self, obj_file, model_category_file, semantic_label_file):
+        # the server may run in another directory
+        files = [os.path.abspath(f) for f in [obj_file, model_category_file, semantic_label_file]]
+        body = self._call(_LOAD_SCENE, b''.join(_pack_string(f) for f in files))
+        v = struct.unpack('<11f', body)
+        self._camera = Camera(Vec3(*v[0:3]), v[6], v[7])
+        self._camera.near, self._camera.far, self._camera.vertical_fov = v[8:11]
+
+    loadSceneSUNCG = loadScene
+
+    def getCamera(self):
+        """The camera is local, and sent with every render."""
+        return self._camera
+
+    def setMode(self, mode):
+        self._mode = mode
+
+    def isFloatMode(self):
+        return self._mode in [RenderMode.NORMAL, RenderMode.POSITION]
+
+    def resolution(self):
+        return self._geo
+
+    def render(self):
+        """Returns a h x w x c uint8 array in shared memory. It is overwritten
+        after nr_slot (4 by default) more frames, so copy it to keep it."""
+        return self._frame(self._call(_RENDER, struct.pack('<i', int(self._mode)) + self._pose()))
+
+    def renderCubeMap(self):
+        return self._frame(self._call(_RENDER_CUBEMAP,
+                                      struct.pack('<i', int(self._mode)) + self._pose()))
+
+    def getNameFromInstanceColor(self, r, g, b):
+        body = self._call(_INSTANCE_NAME, struct.pack('<3i', r, g, b))
+        return body[4:].decode('utf-8')
@@ -0,0 +1,394 @@
+# Copyright 2017-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the license found in the
+# LICENSE file in the root directory of this source tree.
+"""
+Procedural generator of SUNCG-compatible houses.
+
+Writes house.obj, house.mtl, house.json and PNG textures into a directory,
+following the SUNCG naming conventions (Floor#, Ceiling#, WallInside#,
+Model#<modelId>), so that both the renderer and `House` treat the output
+like real data. It is meant for scaling benchmarks, from a single room to
+very large houses, without access to the dataset.
+
+Usage:
+    python House3D/synthetic.py out_dir/house_id --rooms 8 --furniture-density 0.3 \\
+        --textures 16 --triangles 200000
+
+The directory layout matches config['prefix']/<houseID>/, so that
+`create_house(houseID, config)` can load it.
+"""
+
+import argparse
+import csv
+import json
+import math
+import os
+import random
+import struct
+import zlib
+
+__all__ = ['generate_house']
+
+METADATA_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'metadata')
+
+WALL_HEIGHT = 2.8
+WALL_THICKNESS = 0.1
+DOOR_WIDTH = 0.9
+DOOR_HEIGHT = 2.1
+
+# the first rooms make sure every target room type exists
+ROOM_TYPES = ['Kitchen', 'Living_Room', 'Bedroom', 'Bathroom', 'Dining_Room',
+              'Bedroom', 'Office', 'Hallway', 'Storage', 'Guest_Room']
+
+# coarse class -> (min size, max size) in meters, as (x, y, z)
+FURNITURE_CLASSES = {
+    'chair': ((0.4, 0.8, 0.4), (0.6, 1.0, 0.6)),
+    'table': ((0.8, 0.7, 0.6), (1.8, 0.8, 1.0)),
+    'sofa': ((1.6, 0.8, 0.8), (2.4, 0.9, 1.0)),
+    'bed': ((1.4, 0.5, 1.9), (1.8, 0.6, 2.1)),
+    'kitchen_cabinet': ((0.6, 0.9, 0.6), (1.2, 0.9, 0.6)),
+    'wardrobe_cabinet': ((0.8, 1.9, 0.5), (1.6, 2.1, 0.6)),
+    'shelving': ((0.6, 1.2, 0.3), (1.2, 2.0, 0.4)),
+    'desk': ((1.0, 0.7, 0.5), (1.6, 0.8, 0.8)),
+    'plant': ((0.3, 0.6, 0.3), (0.5, 1.5, 0.5)),
+    'tv_stand': ((1.0, 0.5, 0.4), (1.8, 0.6, 0.5)),
+}
+
+
+def _read_model_ids(category_file):
+    """Returns coarse class -> list of model ids, for FURNITURE_CLASSES."""
+    ret = {}
+    with open(category_file) as f:
+        for row in csv.DictReader(f):
+            klass = row['coarse_grained_class']
+            if klass in FURNITURE_CLASSES:
+                ret.setdefault(klass, []).append(row['model_id'])
+    return ret
+
+
+def _write_png(fname, w, h, pixels):
+    """Write an 8-bit RGB PNG. pixels: bytes of length w * h * 3."""
+    def chunk(tag, data):
+        return (struct.pack('>I', len(data)) + tag + data +
+                struct.pack('>I', zlib.crc32(tag + data) & 0xffffffff))
+    stride = w * 3
+    raw = b''.join(b'\x00' + pixels[y * stride:(y + 1) * stride] for y in range(h))
+    with open(fname, 'wb') as f:
+        f.write(b'\x89PNG\r\n\x1a\n')
+        f.write(chunk(b'IHDR', struct.pack('>IIBBBBB', w, h, 8, 2, 0, 0, 0)))
+        f.write(chunk(b'IDAT', zlib.compress(raw, 6)))
+        f.write(chunk(b'IEND', b''))
+
+
+def _gen_texture(fname, size, rng):
+    """A checkerboard or stripes of two random colors."""
+    c0 = bytes(rng.randrange(256) for _ in range(3))
+    c1 = bytes(rng.randrange(256) for _ in range(3))
+    cell = rng.choice([4, 8, 16, 32])
+    stripes = rng.random() < 0.5
+    rows = []
+    for y in range(size):
+        row = bytearray()
+        for x in range(size):
+            odd = (x // cell) % 2 if stripes else (x // cell + y // cell) % 2
+            row += c1 if odd else c0
+        rows.append(bytes(row))
+    _write_png(fname, size, size, b''.join(rows))
+
+
+class _ObjWriter(object):
+    def __init__(self):
+        self.lines = []
+        self.nr_v = self.nr_vt = self.nr_vn = 0
+        self.nr_triangles = 0
+
+    def group(self, name, material):
+        self.lines.append('g ' + name)
+        self.lines.append('usemtl ' + material)
+
+    def grid(self, origin, du, dv, normal, n):
+        """A parallelogram, split into n x n quads, counter-clockwise when
+        seen from the side `normal` points to."""
+        base_v, base_vt = self.nr_v + 1, self.nr_vt + 1
+        for i in range(n + 1):
+            for j in range(n + 1):
+                a, b = float(i) / n, float(j) / n
+                p = [origin[k] + a * du[k] + b * dv[k] for k in range(3)]
+                self.lines.append('v %.4f %.4f %.4f' % tuple(p))
+                # one texture repetition per meter
+                self.lines.append('vt %.4f %.4f' % (
+                    a * math.sqrt(sum(x * x for x in du)),
+                    b * math.sqrt(sum(x * x for x in dv))))
+        self.lines.append('vn %.4f %.4f %.4f' % tuple(normal))
+        self.nr_v += (n + 1) ** 2
+        self.nr_vt += (n + 1) ** 2
+        self.nr_vn += 1
+        vn = self.nr_vn
+        for i in range(n):
+            for j in range(n):
+                k00 = i * (n + 1) + j
+                k10, k01, k11 = k00 + n + 1, k00 + 1, k00 + n + 2
+                for tri in ((k00, k10, k11), (k00, k11, k01)):
+                    self.lines.append('f ' + ' '.join(
+                        '%d/%d/%d' % (base_v + k, base_vt + k, vn) for k in tri))
+        self.nr_triangles += 2 * n * n
+
+    def box(self, lo, hi, n=1, faces='xXyYzZ'):
+        """An axis-aligned box with outward faces, each split into n x n quads.
+        faces: the faces to emit, lower case for the min side."""
+        x0, y0, z0 = lo
+        x1, y1, z1 = hi
+        sx, sy, sz = x1 - x0, y1 - y0, z1 - z0
+        spec = {
+            'x': ((x0, y0, z0), (0, 0, sz), (0, sy, 0), (-1, 0, 0)),
+            'X': ((x1, y0, z1), (0, 0, -sz), (0, sy, 0), (1, 0, 0)),
+            'y': ((x0, y0, z0), (sx, 0, 0), (0, 0, sz), (0, -1, 0)),
+            'Y': ((x0, y1, z1), (sx, 0, 0), (0, 0, -sz), (0, 1, 0)),
+            'z': ((x1, y0, z0), (-sx, 0, 0), (0, sy, 0), (0, 0, -1)),
+            'Z': ((x0, y0, z1), (sx, 0, 0), (0, sy, 0), (0, 0, 1)),
+        }
+        for f in faces:
+            self.grid(*(spec[f] + (n,)))
+
+    def write(self, fname, mtl_name):
+        with open(fname, 'w') as f:
+            f.write('mtllib %s\n' % mtl_name)
+            f.write('\n'.join(self.lines))
+            f.write('\n')
+
+
+def _bbox(lo, hi):
+    return {'min': list(lo), 'max': list(hi)}
+
+
+def _layout_rooms(nr_rooms, rng):
+    """Place rooms on a grid. Returns a list of (x0, z0, x1, z1), and the
+    grid position of each room."""
+    nr_cols = int(math.ceil(math.sqrt(nr_rooms)))
+    nr_rows = int(math.ceil(float(nr_rooms) / nr_cols))
+    col_w = [rng.uniform(3.5, 6.0) for _ in range(nr_cols)]
+    row_h = [rng.uniform(3.5, 6.0) for _ in range(nr_rows)]
+    rooms, cells = [], []
+    for r in range(nr_rows):
+        for c in range(nr_cols):
+            if len(rooms) == nr_rooms:
+                break
+            x0, z0 = sum(col_w[:c]), sum(row_h[:r])
+            rooms.append((x0, z0, x0 + col_w[c], z0 + row_h[r]))
+            cells.append((r, c))
+    return rooms, cells
+
+
+def _wall_segments(a0, a1, door):
+    """Split the span [a0, a1] around an optional door centered at `door`.
+    Returns a list of (begin, end, is_lintel)."""
+    if door is None:
+        return [(a0, a1, False)]
+    d0, d1 = door - DOOR_WIDTH / 2, door + DOOR_WIDTH / 2
+    return [(a0, d0, False), (d0, d1, True), (d1, a1, False)]
+
+
+def generate_house(out_dir, rooms=5, furniture_density=0.25, textures=8,
+                   triangle_budget=0, texture_size=128, seed=0,
+                   category_file=None):
+    """
+    Generate a house into out_dir.
+
+    Args:
+        rooms (int): number of rooms. Adjacent rooms are connected by doors.
+        furniture_density (float): pieces of furniture per square meter of floor.
+        textures (int): number of distinct textures (and textured materials).
+        triangle_budget (int): approximate total number of triangles. Furniture
+            is tessellated to spend what the structure does not use.
+            0 means one quad per box face.
+        texture_size (int): side length of each texture, in pixels.
+        seed (int): random seed. The output is deterministic given the arguments.
+        category_file (str): ModelCategoryMapping.csv to draw model ids from.
+
+    Returns:
+        dict: statistics of the generated house.
+    """
+    assert rooms >= 1 and textures >= 1
+    rng = random.Random(seed)
+    if category_file is None:
+        category_file = os.path.join(METADATA_DIR, 'ModelCategoryMapping.csv')
+    model_ids = _read_model_ids(category_file)
+    classes = sorted(model_ids.keys())
+    assert len(classes) > 0, 'No furniture classes found in ' + category_file
+
+    tex_dir = os.path.join(out_dir, 'texture')
+    if not os.path.isdir(tex_dir):
+        os.makedirs(tex_dir)
+    materials = []   # (name, kd, texture or None)
+    for i in range(textures):
+        name = 'tex_%d' % i
+        _gen_texture(os.path.join(tex_dir, name + '.png'), texture_size, rng)
+        materials.append((name, (1, 1, 1), 'texture/%s.png' % name))
+    for name in ['floor', 'wall', 'ceiling']:
+        g = rng.uniform(0.6, 0.95)
+        materials.append((name, (g, g * 0.95, g * 0.9), None))
+    textured = [m[0] for m in materials[:textures]]
+
+    room_boxes, cells = _layout_rooms(rooms, rng)
+    cell_to_room = {c: i for i, c in enumerate(cells)}
+
+    # furniture placement, before writing geometry, to know the budget per piece
+    furniture = []   # (room index, class, model id, lo, hi, material)
+    for ridx, (x0, z0, x1, z1) in enumerate(room_boxes):
+        area = (x1 - x0) * (z1 - z0)
+        nr_obj = int(round(area * furniture_density))
+        placed = []
+        margin = WALL_THICKNESS + 0.05
+        for _ in range(nr_obj):
+            klass = rng.choice(classes)
+            smin, smax = FURNITURE_CLASSES[klass]
+            size = [rng.uniform(smin[k], smax[k]) for k in range(3)]
+            if rng.random() < 0.5:
+                size[0], size[2] = size[2], size[0]
+            # rejection sampling against walls, doors and placed furniture
+            for _ in range(50):
+                if x1 - x0 - 2 * margin <= size[0] or z1 - z0 - 2 * margin <= size[2]:
+                    break
+                px = rng.uniform(x0 + margin, x1 - margin - size[0])
+                pz = rng.uniform(z0 + margin, z1 - margin - size[2])
+                lo = (px, 0.0, pz)
+                hi = (px + size[0], size[1], pz + size[2])
+                # keep a clear corridor through the room center
+                cx, cz = (x0 + x1) / 2, (z0 + z1) / 2
+                if (lo[0] < cx + 0.5 and hi[0] > cx - 0.5) or \
+                        (lo[2] < cz + 0.5 and hi[2] > cz - 0.5):
+                    continue
+                if any(lo[0] < h[0] and hi[0] > l[0] and lo[2] < h[2] and hi[2] > l[2]
+                       for l, h in placed):
+                    continue
+                placed.append((lo, hi))
+                furniture.append((ridx, klass, rng.choice(model_ids[klass]),
+                                  lo, hi, rng.choice(textured)))
+                break
+
+    obj = _ObjWriter()
+    nodes = []
+    level_lo = [min(b[0] for b in room_boxes), 0.0, min(b[1] for b in room_boxes)]
+    level_hi = [max(b[2] for b in room_boxes), WALL_HEIGHT, max(b[3] for b in room_boxes)]
+
+    # structure: one floor, ceiling and a few wall groups per room
+    for ridx, (x0, z0, x1, z1) in enumerate(room_boxes):
+        name = '0_%d' % ridx
+        obj.group('Floor#' + name, 'floor')
+        obj.box((x0, 0, z0), (x1, 0, z1), faces='Y')
+        obj.group('Ceiling#' + name, 'ceiling')
+        obj.box((x0, WALL_HEIGHT, z0), (x1, WALL_HEIGHT, z1), faces='y')
+
+        r, c = cells[ridx]
+        # doors to the room on the right and the room below, on both sides
+        door_x = {}
+        door_z = {}
+        for dr, dc, side in [(0, 1, 'X'), (0, -1, 'x'), (1, 0, 'Z'), (-1, 0, 'z')]:
+            if (r + dr, c + dc) in cell_to_room:
+                other = room_boxes[cell_to_room[(r + dr, c + dc)]]
+                if side in 'Xx':
+                    # door position along z, within the overlap of both rooms
+                    lo, hi = max(z0, other[1]), min(z1, other[3])
+                    door_x[side] = (lo + hi) / 2
+                else:
+                    lo, hi = max(x0, other[0]), min(x1, other[2])
+                    door_z[side] = (lo + hi) / 2
+
+        t = WALL_THICKNESS
+        widx = 0
+        # walls are inside the room, facing inwards
+        for side in 'xX':
+            wx0 = x0 if side == 'x' else x1 - t
+            for a0, a1, lintel in _wall_segments(z0, z1, door_x.get(side)):
+                y0 = DOOR_HEIGHT if lintel else 0.0
+                obj.group('WallInside#%s_%d' % (name, widx), 'wall')
+                obj.box((wx0, y0, a0), (wx0 + t, WALL_HEIGHT, a1),
+                        faces='X' if side == 'x' else 'x')
+                widx += 1
+        for side in 'zZ':
+            wz0 = z0 if side == 'z' else z1 - t
+            for a0, a1, lintel in _wall_segments(x0 + t, x1 - t, door_z.get(side)):
+                y0 = DOOR_HEIGHT if lintel else 0.0
+                obj.group('WallInside#%s_%d' % (name, widx), 'wall')
+                obj.box((a0, y0, wz0), (a1, WALL_HEIGHT, wz0 + t),
+                        faces='Z' if side == 'z' else 'z')
+                widx += 1
+
+        nodes.append({
+            'id': name,
+            'type': 'Room',
+            'valid': 1,
+            'modelId': 'fr_0rm_%d' % ridx,
+            'roomTypes': [ROOM_TYPES[ridx % len(ROOM_TYPES)]],
+            'bbox': _bbox((x0, 0, z0), (x1, WALL_HEIGHT, z1)),
+            'nodeIndices': [],
+            'hideCeiling': 0, 'hideFloor': 0, 'hideWalls': 0,
+        })
+
+    # furniture: spend the rest of the triangle budget evenly
+    tess = 1
+    if triangle_budget > 0 and len(furniture) > 0:
+        per_obj = max(triangle_budget - obj.nr_triangles, 0) / float(len(furniture))
+        tess = max(int(math.sqrt(per_obj / 12.0)), 1)
+    for ridx, klass, model_id, lo, hi, material in furniture:
+        obj.group('Model#' + model_id, material)
+        obj.box(lo, hi, n=tess)
+        nodes[ridx]['nodeIndices'].append(len(nodes))
+        nodes.append({
+            'id': '0_%d' % len(nodes),
+            'type': 'Object',
+            'valid': 1,
+            'modelId': model_id,
+            'bbox': _bbox(lo, hi),
+            'transform': [1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1],
+        })
+
+    obj.write(os.path.join(out_dir, 'house.obj'), 'house.mtl')
+    with open(os.path.join(out_dir, 'house.mtl'), 'w') as f:
+        for name, kd, tex in materials:
+            f.write('newmtl %s\n' % name)
+            f.write('Kd %.3f %.3f %.3f\nKa 0 0 0\nd 1\n' % kd)
+            if tex is not None:
+                f.write('map_Kd %s\n' % tex)
+    house = {
+        'id': os.path.basename(os.path.normpath(out_dir)),
+        'up': [0, 1, 0],
+        'front': [0, 0, 1],
+        'scaleToMeters': 1,
+        'levels': [{
+            'id': '0',
+            'bbox': _bbox(level_lo, level_hi),
+            'nodes': nodes,
+        }],
+    }
+    with open(os.path.join(out_dir, 'house.json'), 'w') as f:
+        json.dump(house, f)
+    return {'rooms': rooms, 'objects': len(furniture),
+            'triangles': obj.nr_triangles, 'materials': len(materials),
+            'textures': textures}
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Generate a SUNCG-compatible house.')
+    parser.add_argument('out_dir', help='output directory, e.g. prefix/houseID')
+    parser.add_argument('--rooms', type=int, default=5)
+    parser.add_argument('--furniture-density', type=float, default=0.25,
+                        help='pieces of furniture per square meter')
+    parser.add_argument('--textures', type=int, default=8)
+    parser.add_argument('--texture-size', type=int, default=128)
+    parser.add_argument('--triangles', type=int, default=0,
+                        help='approximate triangle budget, 0 for minimal geometry')
+    parser.add_argument('--seed', type=int, default=0)
+    parser.add_argument('--category-file', help='path to ModelCategoryMapping.csv')
+    args = parser.parse_args()
+
+    if not os.path.isdir(args.out_dir):
+        os.makedirs(args.out_dir)
+    stats = generate_house(args.out_dir, rooms=args.rooms,
+                           furniture_density=args.furniture_density,
+                           textures=args.textures, triangle_budget=args.triangles,
+                           texture_size=args.texture_size, seed=args.seed,
+                           category_file=args.category_file)
+    print('Generated {}: {}'.format(args.out_dir, stats))
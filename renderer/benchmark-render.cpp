@@ -0,0 +1,258 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: benchmark-render.cpp
+
+// End-to-end rendering benchmark of SUNCGRenderAPI.
+//
+// Sweeps render modes, resolutions, and single view vs. cube map over one
+// scene. Reports throughput and latency percentiles for each configuration
+// and phase, as a table on stdout and optionally as JSON.
+// The phases are those of getFrameStats(); a cube map has one sample per face.
+//
+// Usage:
+//   ./benchmark-render.bin house.obj ModelCategoryMapping.csv colormap_coarse.csv
+//     [--modes rgb,semantic,depth] [--resolutions 120x90,640x480]
+//     [--views single,cubemap] [--frames 200] [--warmup 10] [--device 0]
+//     [--json report.json]
+//
+// Use a device without a GPU behind it (e.g. Mesa's llvmpipe via EGL) to
+// benchmark the software path.
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "suncg/render.hh"
+#include "lib/stats.hh"
+#include "lib/strutils.hh"
+#include "lib/timer.hh"
+
+using namespace render;
+using namespace std;
+
+namespace {
+
+const map<string, SUNCGScene::RenderMode> MODES = {
+  {"rgb", SUNCGScene::RenderMode::RGB},
+  {"semantic", SUNCGScene::RenderMode::SEMANTIC},
+  {"depth", SUNCGScene::RenderMode::DEPTH},
+  {"instance", SUNCGScene::RenderMode::INSTANCE},
+  {"invdepth", SUNCGScene::RenderMode::INVDEPTH},
+  {"normal", SUNCGScene::RenderMode::NORMAL},
+  {"position", SUNCGScene::RenderMode::POSITION},
+  {"rgb_flat", SUNCGScene::RenderMode::RGB_FLAT},
+};
+
+const double PERCENTILES[] = {50, 95, 99};
+
+struct Options {
+  string obj_file, category_file, color_file;
+  vector<string> modes{"rgb", "semantic", "depth"};
+  vector<Geometry> resolutions{{120, 90}, {640, 480}};
+  vector<string> views{"single", "cubemap"};
+  int frames = 200;   // frames measured per configuration
+  int warmup = 10;
+  int device = 0;
+  string json_file;
+};
+
+struct Result {
+  string mode, view;
+  Geometry geo;
+  int frames;
+  double fps;
+  RollingStats latency;       // ms of each render call
+  // phase name -> percentile -> ms, of each render() call
+  map<string, map<string, double>> phases;
+};
+
+vector<string> split(const string& s, char delim) {
+  vector<string> ret;
+  stringstream ss(s);
+  string item;
+  while (getline(ss, item, delim))
+    if (!item.empty())
+      ret.push_back(item);
+  return ret;
+}
+
+[[noreturn]] void usage(const char* prog) {
+  cerr << "Usage: " << prog << " house.obj ModelCategoryMapping.csv colormap.csv"
+       << " [--modes rgb,semantic,depth] [--resolutions 120x90,640x480]"
+       << " [--views single,cubemap] [--frames 200] [--warmup 10]"
+       << " [--device 0] [--json report.json]" << endl;
+  exit(1);
+}
+
+Options parse_args(int argc, char* argv[]) {
+  if (argc < 4)
+    usage(argv[0]);
+  Options opt;
+  opt.obj_file = argv[1];
+  opt.category_file = argv[2];
+  opt.color_file = argv[3];
+  for (int i = 4; i < argc; i += 2) {
+    string key = argv[i];
+    if (i + 1 >= argc)
+      usage(argv[0]);
+    string val = argv[i + 1];
+    if (key == "--modes") {
+      opt.modes = split(val, ',');
+      for (auto& m : opt.modes)
+        if (!MODES.count(m))
+          error_exit(ssprintf("Unknown mode %s\n", m.c_str()));
+    } else if (key == "--resolutions") {
+      opt.resolutions.clear();
+      for (auto& r : split(val, ',')) {
+        int w, h;
+        if (sscanf(r.c_str(), "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0)
+          error_exit(ssprintf("Invalid resolution %s\n", r.c_str()));
+        opt.resolutions.push_back(Geometry{w, h});
+      }
+    } else if (key == "--views") {
+      opt.views = split(val, ',');
+      for (auto& v : opt.views)
+        if (v != "single" && v != "cubemap")
+          error_exit(ssprintf("Unknown view %s\n", v.c_str()));
+    } else if (key == "--frames") {
+      opt.frames = stoi(val);
+    } else if (key == "--warmup") {
+      opt.warmup = stoi(val);
+    } else if (key == "--device") {
+      opt.device = stoi(val);
+    } else if (key == "--json") {
+      opt.json_file = val;
+    } else {
+      usage(argv[0]);
+    }
+  }
+  return opt;
+}
+
+// Put the camera at eye level in the middle of the scene.
+void reset_camera(SUNCGRenderAPI& api) {
+  Camera* cam = api.getCamera();
+  cam->pos = api.getSceneMin() + api.getSceneRange() * 0.5f;
+  cam->pos.y = api.getSceneMin().y + 1.2f;
+  cam->yaw = -90.f;
+  cam->pitch = 0.f;
+  cam->updateDirection();
+}
+
+void render_one(SUNCGRenderAPI& api, const string& view, bool is_float) {
+  if (view == "single") {
+    if (is_float)
+      api.renderFloat();
+    else
+      api.render();
+  } else {
+    if (is_float)
+      api.renderCubeMapFloat();
+    else
+      api.renderCubeMap();
+  }
+  // look around: different views have different costs
+  api.getCamera()->turn(7.f, 0.f);
+}
+
+Result run(SUNCGRenderAPI& api, const Options& opt,
+    const string& mode, Geometry geo, const string& view) {
+  api.setMode(MODES.at(mode));
+  bool is_float = SUNCGScene::is_float_mode(MODES.at(mode));
+  reset_camera(api);
+  for (int i = 0; i < opt.warmup; ++i)
+    render_one(api, view, is_float);
+
+  Result r{mode, view, geo, max(opt.frames, 1), 0, RollingStats{1 << 20}, {}};
+  api.enableFrameStats();
+  Timer total;
+  for (int i = 0; i < r.frames; ++i) {
+    Timer tm;
+    render_one(api, view, is_float);
+    r.latency.add(tm.duration() * 1e3);
+  }
+  r.fps = r.frames / total.duration();
+
+  for (auto& phase : api.getFrameStats()) {
+    if (phase.second["count"] == 0)
+      continue;
+    for (double p : PERCENTILES) {
+      string key = ssprintf("p%d", (int)p);
+      r.phases[phase.first][key] = phase.second[key];
+    }
+  }
+  api.enableFrameStats(false);
+  return r;
+}
+
+void print_result(const Result& r) {
+  cout << ssprintf("%-9s %5dx%-5d %-8s %8.1f fps  latency p50/p95/p99 = %.2f/%.2f/%.2f ms\n",
+      r.mode.c_str(), r.geo.w, r.geo.h, r.view.c_str(), r.fps,
+      r.latency.percentile(50), r.latency.percentile(95),
+      r.latency.percentile(99));
+  for (auto& phase : r.phases) {
+    auto& p = phase.second;
+    cout << ssprintf("    %-12s p50/p95/p99 = %.3f/%.3f/%.3f ms\n", phase.first.c_str(),
+        p.at("p50"), p.at("p95"), p.at("p99"));
+  }
+}
+
+void write_json(const string& fname, const vector<Result>& results,
+    const Options& opt, const string& renderer) {
+  ofstream fout(fname);
+  if (!fout.good())
+    error_exit(ssprintf("Cannot open %s\n", fname.c_str()));
+  fout << "{\n  \"scene\": \"" << opt.obj_file << "\",\n";
+  fout << "  \"renderer\": \"" << renderer << "\",\n";
+  fout << "  \"results\": [";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    fout << (i ? ",\n" : "\n") << "    {";
+    fout << ssprintf("\"mode\": \"%s\", \"width\": %d, \"height\": %d, \"view\": \"%s\", "
+        "\"frames\": %d, \"fps\": %.3f, ",
+        r.mode.c_str(), r.geo.w, r.geo.h, r.view.c_str(), r.frames, r.fps);
+    fout << ssprintf("\"latency_ms\": {\"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f}, ",
+        r.latency.percentile(50), r.latency.percentile(95),
+        r.latency.percentile(99));
+    fout << "\"phases_ms\": {";
+    bool first = true;
+    for (auto& phase : r.phases) {
+      auto& p = phase.second;
+      fout << (first ? "" : ", ") << ssprintf(
+          "\"%s\": {\"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f}", phase.first.c_str(),
+          p.at("p50"), p.at("p95"), p.at("p99"));
+      first = false;
+    }
+    fout << "}}";
+  }
+  fout << "\n  ]\n}\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  Options opt = parse_args(argc, argv);
+  vector<Result> results;
+  string renderer;
+  for (auto& geo : opt.resolutions) {
+    SUNCGRenderAPI api(geo.w, geo.h, opt.device);
+    if (renderer.empty()) {
+      renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+      api.printContextInfo();
+    }
+    api.loadScene(opt.obj_file, opt.category_file, opt.color_file);
+    for (auto& mode : opt.modes)
+      for (auto& view : opt.views) {
+        results.push_back(run(api, opt, mode, geo, view));
+        print_result(results.back());
+      }
+  }
+  if (!opt.json_file.empty())
+    write_json(opt.json_file, results, opt, renderer);
+}
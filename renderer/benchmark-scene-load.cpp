@@ -0,0 +1,265 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: benchmark-scene-load.cpp
+
+// Benchmark of loading and switching scenes, as in multi-house training.
+//
+// Cycles through the given houses in an access pattern, with a scene cache of
+// limited capacity. Reports the latency of cold loads (cache misses), warm
+// switches (cache hits) and the first frame after each switch, as well as the
+// resident memory high-water mark. Each configuration runs in a fresh process.
+//
+// Usage:
+//   ./benchmark-scene-load.bin ModelCategoryMapping.csv colormap_coarse.csv
+//     house1/house.obj house2/house.obj ... [--list houses.txt]
+//     [--cache 0,4,16] [--patterns random,roundrobin,zipf] [--switches 200]
+//     [--zipf-s 1.0] [--seed 0] [--size 120x90] [--device 0] [--json report.json]
+//
+// --cache 0 means an unlimited cache. Synthetic houses of any size can be
+// generated with House3D/synthetic.py.
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "suncg/render.hh"
+#include "lib/meminfo.hh"
+#include "lib/stats.hh"
+#include "lib/strutils.hh"
+#include "lib/timer.hh"
+
+using namespace render;
+using namespace std;
+
+namespace {
+
+struct Options {
+  string category_file, color_file;
+  vector<string> houses;
+  vector<int> caches{0, 4};
+  vector<string> patterns{"random", "roundrobin", "zipf"};
+  int switches = 200;
+  double zipf_s = 1.0;
+  int seed = 0;
+  Geometry size{120, 90};
+  int device = 0;
+  string json_file;
+};
+
+// Statistics of one configuration. Sent from the child process as is.
+struct Result {
+  int nr_cold, nr_warm;
+  double cold_p50, cold_p95, cold_mean;
+  double warm_p50, warm_p95, warm_mean;
+  double frame_p50, frame_p95;
+  double peak_rss_mb, final_rss_mb;
+};
+
+vector<string> split(const string& s, char delim) {
+  vector<string> ret;
+  stringstream ss(s);
+  string item;
+  while (getline(ss, item, delim))
+    if (!item.empty())
+      ret.push_back(item);
+  return ret;
+}
+
+[[noreturn]] void usage(const char* prog) {
+  cerr << "Usage: " << prog << " ModelCategoryMapping.csv colormap.csv house.obj ..."
+       << " [--list houses.txt] [--cache 0,4,16] [--patterns random,roundrobin,zipf]"
+       << " [--switches 200] [--zipf-s 1.0] [--seed 0] [--size 120x90]"
+       << " [--device 0] [--json report.json]" << endl;
+  exit(1);
+}
+
+Options parse_args(int argc, char* argv[]) {
+  if (argc < 3)
+    usage(argv[0]);
+  Options opt;
+  opt.category_file = argv[1];
+  opt.color_file = argv[2];
+  for (int i = 3; i < argc; ++i) {
+    string key = argv[i];
+    if (key.compare(0, 2, "--") != 0) {
+      opt.houses.push_back(key);
+      continue;
+    }
+    if (i + 1 >= argc)
+      usage(argv[0]);
+    string val = argv[++i];
+    if (key == "--list") {
+      ifstream fin(val);
+      if (!fin.good())
+        error_exit(ssprintf("Cannot open %s\n", val.c_str()));
+      string line;
+      while (getline(fin, line))
+        if (!line.empty())
+          opt.houses.push_back(line);
+    } else if (key == "--cache") {
+      opt.caches.clear();
+      for (auto& c : split(val, ','))
+        opt.caches.push_back(max(stoi(c), 0));
+    } else if (key == "--patterns") {
+      opt.patterns = split(val, ',');
+      for (auto& p : opt.patterns)
+        if (p != "random" && p != "roundrobin" && p != "zipf")
+          error_exit(ssprintf("Unknown pattern %s\n", p.c_str()));
+    } else if (key == "--switches") {
+      opt.switches = stoi(val);
+    } else if (key == "--zipf-s") {
+      opt.zipf_s = stod(val);
+    } else if (key == "--seed") {
+      opt.seed = stoi(val);
+    } else if (key == "--size") {
+      if (sscanf(val.c_str(), "%dx%d", &opt.size.w, &opt.size.h) != 2)
+        error_exit(ssprintf("Invalid size %s\n", val.c_str()));
+    } else if (key == "--device") {
+      opt.device = stoi(val);
+    } else if (key == "--json") {
+      opt.json_file = val;
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (opt.houses.empty())
+    usage(argv[0]);
+  return opt;
+}
+
+// The sequence of house indices to load.
+vector<int> access_sequence(const string& pattern, int nr_house, const Options& opt) {
+  mt19937 rng(opt.seed);
+  vector<int> ret(opt.switches);
+  if (pattern == "roundrobin") {
+    for (int i = 0; i < opt.switches; ++i)
+      ret[i] = i % nr_house;
+  } else if (pattern == "random") {
+    uniform_int_distribution<int> dist(0, nr_house - 1);
+    for (auto& r : ret)
+      r = dist(rng);
+  } else {
+    // Zipf over a random ranking of the houses
+    vector<int> rank(nr_house);
+    for (int i = 0; i < nr_house; ++i)
+      rank[i] = i;
+    shuffle(rank.begin(), rank.end(), rng);
+    vector<double> weights(nr_house);
+    for (int i = 0; i < nr_house; ++i)
+      weights[i] = 1.0 / pow(i + 1, opt.zipf_s);
+    discrete_distribution<int> dist(weights.begin(), weights.end());
+    for (auto& r : ret)
+      r = rank[dist(rng)];
+  }
+  return ret;
+}
+
+Result run(const Options& opt, const vector<int>& sequence, int cache) {
+  SUNCGRenderAPI api(opt.size.w, opt.size.h, opt.device);
+  api.setSceneCacheCapacity(cache);
+  RollingStats cold{1 << 20}, warm{1 << 20}, frame{1 << 20};
+  for (int idx : sequence) {
+    const string& house = opt.houses[idx];
+    bool cached = api.isSceneCached(house);
+    Timer tm;
+    api.loadScene(house, opt.category_file, opt.color_file);
+    glFinish();   // include the upload to GPU
+    (cached ? warm : cold).add(tm.duration() * 1e3);
+
+    tm.restart();
+    api.render();
+    frame.add(tm.duration() * 1e3);
+  }
+  return Result{
+    (int)cold.size(), (int)warm.size(),
+    cold.percentile(50), cold.percentile(95), cold.mean(),
+    warm.percentile(50), warm.percentile(95), warm.mean(),
+    frame.percentile(50), frame.percentile(95),
+    peak_rss_bytes() / 1048576.0, current_rss_bytes() / 1048576.0};
+}
+
+// Run in a child process, so that every configuration starts from an empty
+// GL context and has its own memory high-water mark.
+Result run_in_child(const Options& opt, const vector<int>& sequence, int cache) {
+  int fds[2];
+  if (pipe(fds) != 0)
+    error_exit("pipe() failed\n");
+  // don't let the child inherit unflushed output
+  cout.flush();
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    Result r = run(opt, sequence, cache);
+    if (write(fds[1], &r, sizeof(r)) != sizeof(r))
+      _exit(1);
+    _exit(0);
+  }
+  close(fds[1]);
+  Result r;
+  ssize_t nr = read(fds[0], &r, sizeof(r));
+  close(fds[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  if (nr != sizeof(r))
+    error_exit("The benchmark process failed\n");
+  return r;
+}
+
+void print_result(const string& pattern, int cache, const Result& r) {
+  cout << ssprintf("%-10s cache=%-4s cold %4d x p50/p95 %8.1f/%8.1f ms | "
+      "warm %4d x p50/p95 %6.2f/%6.2f ms | first frame p50/p95 %6.2f/%6.2f ms | "
+      "peak RSS %7.1f MB\n",
+      pattern.c_str(), cache ? to_string(cache).c_str() : "inf",
+      r.nr_cold, r.cold_p50, r.cold_p95, r.nr_warm, r.warm_p50, r.warm_p95,
+      r.frame_p50, r.frame_p95, r.peak_rss_mb);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  Options opt = parse_args(argc, argv);
+  cout << opt.houses.size() << " houses, " << opt.switches << " switches per configuration" << endl;
+
+  ofstream json;
+  if (!opt.json_file.empty()) {
+    json.open(opt.json_file);
+    if (!json.good())
+      error_exit(ssprintf("Cannot open %s\n", opt.json_file.c_str()));
+    json << "{\n  \"houses\": " << opt.houses.size()
+         << ",\n  \"switches\": " << opt.switches << ",\n  \"results\": [";
+  }
+  bool first = true;
+  for (auto& pattern : opt.patterns) {
+    vector<int> sequence = access_sequence(pattern, opt.houses.size(), opt);
+    for (int cache : opt.caches) {
+      Result r = run_in_child(opt, sequence, cache);
+      print_result(pattern, cache, r);
+      if (json.is_open()) {
+        json << (first ? "\n" : ",\n") << ssprintf(
+            "    {\"pattern\": \"%s\", \"cache\": %d, "
+            "\"cold\": {\"count\": %d, \"p50_ms\": %.3f, \"p95_ms\": %.3f, \"mean_ms\": %.3f}, "
+            "\"warm\": {\"count\": %d, \"p50_ms\": %.3f, \"p95_ms\": %.3f, \"mean_ms\": %.3f}, "
+            "\"first_frame\": {\"p50_ms\": %.3f, \"p95_ms\": %.3f}, "
+            "\"peak_rss_mb\": %.1f, \"final_rss_mb\": %.1f}",
+            pattern.c_str(), cache,
+            r.nr_cold, r.cold_p50, r.cold_p95, r.cold_mean,
+            r.nr_warm, r.warm_p50, r.warm_p95, r.warm_mean,
+            r.frame_p50, r.frame_p95, r.peak_rss_mb, r.final_rss_mb);
+        first = false;
+      }
+    }
+  }
+  if (json.is_open())
+    json << "\n  ]\n}\n";
+}
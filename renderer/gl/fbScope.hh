@@ -8,25 +8,35 @@
 
 #pragma once
 #include "api.hh"
+#include "memoryStats.hh"
 
 #include "lib/geometry.hh"
 #include "lib/debugutils.hh"
 #include "lib/mat.h"
 #include "lib/strutils.hh"
 #include "lib/imgproc.hh"
+#include "lib/profiler.hh"
 
 namespace render {
 
 class Framebuffer {
   public:
-    explicit Framebuffer(Geometry win_size): win_size_{win_size} {
+    // color_format: internal format of the color buffer.
+    // Use GL_RGBA8 to capture images, or a float format (e.g. GL_RGBA32F)
+    // to use captureFloat().
+    // aux_format: if not GL_NONE, add a second color buffer of this format
+    // at GL_COLOR_ATTACHMENT1, for shaders with a second output.
+    explicit Framebuffer(Geometry win_size, GLenum color_format = GL_RGBA8,
+        GLenum aux_format = GL_NONE):
+      win_size_{win_size} {
       if (glGenFramebuffers == nullptr)
         error_exit("Pointer to glGenFramebuffers wasn't setup properly!");
 
+      nr_rbo_ = aux_format == GL_NONE ? 2 : 3;
       glGenFramebuffers(1, &fbo);
-      glGenRenderbuffers(2, rbo);
+      glGenRenderbuffers(nr_rbo_, rbo);
       glBindRenderbuffer(GL_RENDERBUFFER, rbo[0]);
-      glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, win_size_.w, win_size_.h);
+      glRenderbufferStorage(GL_RENDERBUFFER, color_format, win_size_.w, win_size_.h);
 
       glBindRenderbuffer(GL_RENDERBUFFER, rbo[1]);
       glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, win_size_.w, win_size_.h);
@@ -35,8 +45,21 @@ class Framebuffer {
       glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbo[0]);
       glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo[1]);
 
+      if (aux_format != GL_NONE) {
+        glBindRenderbuffer(GL_RENDERBUFFER, rbo[2]);
+        glRenderbufferStorage(GL_RENDERBUFFER, aux_format, win_size_.w, win_size_.h);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_RENDERBUFFER, rbo[2]);
+        const GLenum buffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+        glDrawBuffers(2, buffers);
+      }
+
       glBindRenderbuffer(GL_RENDERBUFFER, 0);
 
+      GLenum formats[] = {color_format, GL_DEPTH24_STENCIL8, aux_format};
+      for (int i = 0; i < nr_rbo_; ++i)
+        GPUMemory::allocate(GPUMemory::FRAMEBUFFER, GPUMemory::Object::RENDERBUFFER, rbo[i],
+            GPUMemory::texture_size(win_size_.w, win_size_.h, formats[i], false));
+
       GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
       if (status != GL_FRAMEBUFFER_COMPLETE)
         error_exit(
@@ -48,34 +71,67 @@ class Framebuffer {
     void unbind() const { glBindFramebuffer(GL_FRAMEBUFFER, 0); }
 
     Matuc capture() const {
+      Matuc ret3{win_size_.h, win_size_.w, 3};
+      capture(ret3);
+      return ret3;
+    }
+
+    // Capture into an existing h x w x 3 buffer.
+    void capture(Matuc& ret3) const {
+      m_assert(ret3.height() == win_size_.h && ret3.width() == win_size_.w);
+      m_assert(ret3.channels() == 3);
+      rgba_to_rgb_vflip(readRGBA(), ret3);
+    }
+
+    // The raw h x w x 4 color buffer. Note that opengl returns a
+    // vertical-flipped image.
+    Matuc readRGBA() const {
+      PROFILE_ZONE("Framebuffer::readRGBA");
       Matuc ret{win_size_.h, win_size_.w, 4};
       glReadBuffer(GL_COLOR_ATTACHMENT0);
       glReadPixels(0, 0, win_size_.w, win_size_.h,
           GL_RGBA, GL_UNSIGNED_BYTE, ret.ptr());
-      // opengl returns a vertical-flipped image.
+      return ret;
+    }
 
+    // Capture the first `channels` channels of a float color buffer,
+    // as a h x w x channels image.
+    // attachment: 0 for the color buffer, 1 for the auxiliary buffer.
+    Mat32f captureFloat(int channels, int attachment = 0) const {
+      static const GLenum formats[] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+      m_assert(channels >= 1 && channels <= 4);
+      m_assert(attachment == 0 || (attachment == 1 && nr_rbo_ == 3));
+      PROFILE_ZONE("Framebuffer::captureFloat");
+      Mat32f ret{win_size_.h, win_size_.w, channels};
+      glReadBuffer(GL_COLOR_ATTACHMENT0 + attachment);
+      glReadPixels(0, 0, win_size_.w, win_size_.h,
+          formats[channels - 1], GL_FLOAT, ret.ptr());
+      // opengl returns a vertical-flipped image.
+      vflip(ret);
+      return ret;
+    }
 
-      Matuc ret3{win_size_.h, win_size_.w, 3};
-      for (int i = 0; i < ret3.height(); ++i) {
-        unsigned char* oldptr = ret.ptr(i);
-        unsigned char* newptr = ret3.ptr(win_size_.h - 1 - i);
-        for (int j = 0; j < ret3.width(); ++j) {
-          *(newptr++) = *(oldptr++);
-          *(newptr++) = *(oldptr++);
-          *(newptr++) = *(oldptr++);
-          oldptr ++;
-        }
-      }
-      return ret3;
+    // Capture the depth buffer as a h x w x 1 image of window-space depth
+    // in [0, 1]. Pixels without any object have depth 1.
+    Mat32f captureDepth() const {
+      PROFILE_ZONE("Framebuffer::captureDepth");
+      Mat32f ret{win_size_.h, win_size_.w, 1};
+      glReadPixels(0, 0, win_size_.w, win_size_.h,
+          GL_DEPTH_COMPONENT, GL_FLOAT, ret.ptr());
+      vflip(ret);
+      return ret;
     }
 
     ~Framebuffer() {
+      for (int i = 0; i < nr_rbo_; ++i)
+        GPUMemory::release(GPUMemory::Object::RENDERBUFFER, rbo[i]);
       glDeleteFramebuffers(1, &fbo);
-      glDeleteRenderbuffers(2, rbo);
+      glDeleteRenderbuffers(nr_rbo_, rbo);
     }
 
   protected:
-    GLuint fbo, rbo[2];
+    GLuint fbo, rbo[3];
+    int nr_rbo_;
     Geometry win_size_;
 };
 
@@ -88,6 +144,11 @@ class FramebufferScope {
       fb_{fb} { fb.bind(); }
 
     Matuc capture() const { return fb_.capture(); }
+    void capture(Matuc& dst) const { fb_.capture(dst); }
+    Matuc readRGBA() const { return fb_.readRGBA(); }
+    Mat32f captureFloat(int channels, int attachment = 0) const
+    { return fb_.captureFloat(channels, attachment); }
+    Mat32f captureDepth() const { return fb_.captureDepth(); }
 
     ~FramebufferScope() { fb_.unbind(); }
 
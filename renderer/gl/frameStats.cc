@@ -0,0 +1,130 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: frameStats.cc
+
+#include "frameStats.hh"
+
+#include "lib/debugutils.hh"
+
+namespace render {
+
+GPUTimer::GPUTimer(int nr_query, int max_query, int warmup):
+  queries_(nr_query), max_query_(max_query), warmup_(warmup) {
+  m_assert(nr_query > 0 && max_query >= nr_query && warmup >= 0);
+  glGenQueries(nr_query, queries_.data());
+  free_.assign(queries_.begin(), queries_.end());
+}
+
+GPUTimer::~GPUTimer() {
+  glDeleteQueries(queries_.size(), queries_.data());
+}
+
+void GPUTimer::begin() {
+  if (free_.empty()) {
+    if (static_cast<int>(queries_.size()) < max_query_) {
+      GLuint q;
+      glGenQueries(1, &q);
+      queries_.push_back(q);
+      free_.push_back(q);
+    } else {
+      // too many frames in flight: wait for the oldest one
+      pop_pending(done_);
+      stalls_++;
+    }
+  }
+  glBeginQuery(GL_TIME_ELAPSED, free_.front());
+}
+
+void GPUTimer::end() {
+  glEndQuery(GL_TIME_ELAPSED);
+  pending_.push_back(free_.front());
+  free_.pop_front();
+}
+
+void GPUTimer::pop_pending(std::vector<double>& out) {
+  GLuint q = pending_.front();
+  GLuint64 ns;
+  glGetQueryObjectui64v(q, GL_QUERY_RESULT, &ns);
+  if (warmup_ > 0) {
+    warmup_--;
+    discarded_++;
+  } else {
+    out.push_back(ns / 1e6);
+  }
+  pending_.pop_front();
+  free_.push_back(q);
+}
+
+std::vector<double> GPUTimer::collect(bool wait) {
+  std::vector<double> ret;
+  ret.swap(done_);
+  while (!pending_.empty()) {
+    if (!wait) {
+      GLint available = 0;
+      glGetQueryObjectiv(pending_.front(), GL_QUERY_RESULT_AVAILABLE, &available);
+      // queries finish in order
+      if (!available)
+        break;
+    }
+    pop_pending(ret);
+  }
+  return ret;
+}
+
+
+FrameStats::FrameStats(int window): stats_(NR_PHASE, RollingStats{window}) {}
+
+const char* FrameStats::phase_name(Phase phase) {
+  static const char* names[] = {"draw", "gpu", "readback", "postprocess", "total"};
+  m_assert(phase >= 0 && phase < NR_PHASE);
+  return names[phase];
+}
+
+void FrameStats::beginFrame() {
+  collect_gpu(false);
+  frame_timer_.restart();
+  phase_timer_.restart();
+}
+
+void FrameStats::mark(Phase phase) {
+  stats_[phase].add(phase_timer_.duration() * 1e3);
+  phase_timer_.restart();
+}
+
+void FrameStats::endFrame() {
+  stats_[TOTAL].add(frame_timer_.duration() * 1e3);
+}
+
+void FrameStats::collect_gpu(bool wait) {
+  for (double ms : gpu_timer_.collect(wait))
+    stats_[GPU].add(ms);
+}
+
+std::map<std::string, std::map<std::string, double>> FrameStats::summary() {
+  collect_gpu(true);
+  std::map<std::string, std::map<std::string, double>> ret;
+  for (int i = 0; i < NR_PHASE; ++i) {
+    const RollingStats& s = stats_[i];
+    ret[phase_name(static_cast<Phase>(i))] = {
+      {"p50", s.percentile(50)},
+      {"p90", s.percentile(90)},
+      {"p95", s.percentile(95)},
+      {"p99", s.percentile(99)},
+      {"mean", s.mean()},
+      {"count", static_cast<double>(s.size())}};
+  }
+  ret[phase_name(GPU)]["discarded"] = gpu_timer_.discarded();
+  ret[phase_name(GPU)]["stalls"] = gpu_timer_.stalls();
+  return ret;
+}
+
+void FrameStats::clear() {
+  gpu_timer_.collect(true);
+  for (auto& s : stats_)
+    s.clear();
+}
+
+} // namespace render
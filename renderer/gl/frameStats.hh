@@ -0,0 +1,105 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: frameStats.hh
+
+#pragma once
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "api.hh"
+#include "lib/stats.hh"
+#include "lib/timer.hh"
+
+namespace render {
+
+// Measure the GPU time of the commands between begin() and end() with
+// GL_TIME_ELAPSED queries.
+// To avoid stalling the pipeline, the results are collected a few frames
+// later, when they become available.
+class GPUTimer {
+  public:
+    // nr_query: number of measurements in flight before more queries are
+    //   allocated, up to max_query.
+    // warmup: number of first measurements to discard. Some drivers
+    //   (e.g. llvmpipe) return a bogus value for the first one.
+    explicit GPUTimer(int nr_query = 4, int max_query = 64, int warmup = 1);
+    ~GPUTimer();
+
+    GPUTimer(const GPUTimer&) = delete;
+    GPUTimer& operator = (const GPUTimer&) = delete;
+
+    // Only one GPUTimer can be running at a time.
+    // If max_query measurements are in flight, begin() waits for the oldest
+    // one. Its result is kept for the next collect().
+    void begin();
+    void end();
+
+    // Return the finished measurements in milliseconds, oldest first.
+    std::vector<double> collect(bool wait = false);
+
+    // Number of measurements discarded as warm-up.
+    int discarded() const { return discarded_; }
+    // Number of times begin() had to wait for the GPU.
+    int stalls() const { return stalls_; }
+
+  private:
+    std::vector<GLuint> queries_;
+    std::deque<GLuint> free_, pending_;
+    std::vector<double> done_;  // results waited for by begin()
+    int max_query_, warmup_;
+    int discarded_ = 0, stalls_ = 0;
+
+    // Add the result of the oldest pending query to `out`. Waits for it.
+    void pop_pending(std::vector<double>& out);
+};
+
+
+// Per-phase timing of rendering a frame, with rolling statistics.
+//
+// Usage for each frame:
+//  beginFrame(); beginGPU(); <draw>; endGPU(); mark(DRAW);
+//  <glReadPixels>; mark(READBACK); <conversion>; mark(POSTPROCESS); endFrame();
+class FrameStats {
+  public:
+    enum Phase {
+      DRAW = 0,         // CPU time to submit the draw calls
+      GPU = 1,          // GPU time to execute the draw calls
+      READBACK = 2,     // glReadPixels, including waiting for the GPU
+      POSTPROCESS = 3,  // CPU conversion of the pixels
+      TOTAL = 4,        // the whole frame, on CPU
+      NR_PHASE = 5
+    };
+
+    explicit FrameStats(int window = 512);
+
+    void beginFrame();
+    void beginGPU() { gpu_timer_.begin(); }
+    void endGPU() { gpu_timer_.end(); }
+    // Add the CPU time since the last mark (or beginFrame) to `phase`.
+    void mark(Phase phase);
+    void endFrame();
+
+    // phase name -> {"p50", "p90", "p95", "p99", "mean", "count"}, in milliseconds.
+    // "gpu" also has "discarded" and "stalls", see GPUTimer.
+    // Waits for the GPU measurements in flight.
+    std::map<std::string, std::map<std::string, double>> summary();
+
+    void clear();
+
+    static const char* phase_name(Phase phase);
+
+  private:
+    GPUTimer gpu_timer_;
+    std::vector<RollingStats> stats_;
+    Timer frame_timer_, phase_timer_;
+
+    void collect_gpu(bool wait);
+};
+
+} // namespace render
@@ -9,6 +9,7 @@
 #include "api.hh"
 #undef INCLUDE_GL_CONTEXT_HEADERS
 #include "glContext.hh"
+#include "stateCache.hh"
 #include <iostream>
 #include <atomic>
 
@@ -45,8 +46,7 @@ const EGLint EGLconfigAttribs[] = {
 // };
 
 
-bool check_nvidia_readable(int device) {
-  string dev = ssprintf("/dev/nvidia%d", device);
+bool check_readable(const string& dev) {
   int ret = open(dev.c_str(), O_RDONLY);
   if (ret == -1)
     return false;
@@ -54,6 +54,10 @@ bool check_nvidia_readable(int device) {
   return true;
 }
 
+bool check_nvidia_readable(int device) {
+  return check_readable(ssprintf("/dev/nvidia%d", device));
+}
+
 const int GLXcontextAttribs[] = {
     GLX_CONTEXT_MAJOR_VERSION_ARB, 3,
     GLX_CONTEXT_MINOR_VERSION_ARB, 3,
@@ -86,6 +90,11 @@ namespace render {
 
 void GLContext::init() {
   glViewport(0, 0, win_size_.w, win_size_.h);
+  // the state cached for a previous context is meaningless
+  GLStateCache::invalidate();
+  // the context is used by the thread that creates it
+  if (placement_.reason.empty())
+    placement_ = place_thread(device_sysfs_dir_);
 }
 
 void GLContext::printInfo() {
@@ -95,6 +104,7 @@ void GLContext::printInfo() {
   cerr << "GLSL Version: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << endl;
   cerr << "Vendor: " << glGetString(GL_VENDOR) << endl;
   cerr << "Renderer: " << glGetString(GL_RENDERER) << endl;
+  cerr << "Placement: " << placement_.str() << endl;
   cerr << "----------------------------------------------" << endl;
 }
 
@@ -154,13 +164,37 @@ EGLContext::EGLContext(Geometry win_size, int device): GLContext{win_size} {
 
     eglQueryDevicesEXT(MAX_DEVICES, eglDevs, &numDevices);
 
-    std::vector<int> visible_devices;
-    if (numDevices > 1) {  // we must be using nvidia GPUs
-      // cgroup may block our access to /dev/nvidiaX, but eglQueryDevices can still see them.
+    // Mesa exposes its software renderer (llvmpipe) and each DRM device
+    // (e.g. /dev/dri/card0) as EGL devices. They can be told apart by their
+    // extensions. Other devices are assumed to be nvidia GPUs.
+    PFNEGLQUERYDEVICESTRINGEXTPROC eglQueryDeviceStringEXT =
+      (PFNEGLQUERYDEVICESTRINGEXTPROC) eglGetProcAddress("eglQueryDeviceStringEXT");
+    auto query_string = [&](int i, EGLint name) -> string {
+      if (!eglQueryDeviceStringEXT)
+        return "";
+      const char* str = eglQueryDeviceStringEXT(eglDevs[i], name);
+      return str ? str : "";
+    };
+
+    // Hardware devices come first, so that device 0 is a GPU if there is one.
+    std::vector<int> visible_devices, software_devices;
+    if (numDevices > 1) {
       for (int i = 0; i < numDevices; ++i) {
-        if (check_nvidia_readable(i))
+        string exts = query_string(i, EGL_EXTENSIONS);
+        if (exts.find("EGL_MESA_device_software") != string::npos) {
+          software_devices.push_back(i);
+          continue;
+        }
+        // cgroup may block our access to /dev/nvidiaX, but eglQueryDevices can still see them.
+        // Containers often expose /dev/nvidiaX but not the DRM device.
+        string drm_file = query_string(i, EGL_DRM_DEVICE_FILE_EXT);
+        bool readable = check_nvidia_readable(i) ||
+          (!drm_file.empty() && check_readable(drm_file));
+        if (readable)
           visible_devices.push_back(i);
       }
+      visible_devices.insert(visible_devices.end(),
+          software_devices.begin(), software_devices.end());
     } else if (numDevices == 1) {
       // TODO we may still be using nvidia GPUs, but there is no way to tell.
       // But it's very rare that you'll start a docker and hide the only one GPU from it.
@@ -173,13 +207,23 @@ EGLContext::EGLContext(Geometry win_size, int device): GLContext{win_size} {
       error_exit(ssprintf("[EGL] Request device %d but only found %lu devices", device, visible_devices.size()));
     }
 
-    if (static_cast<int>(visible_devices.size()) == numDevices) {
+    bool identity = static_cast<int>(visible_devices.size()) == numDevices;
+    for (int i = 0; i < numDevices && identity; ++i)
+      identity = visible_devices[i] == i;
+    if (identity) {
       cerr << "[EGL] Detected " << numDevices << " devices. Using device " << device << endl;
     } else {
       cerr << "[EGL] " << visible_devices.size() << " out of " << numDevices <<
           " devices are accessible. Using device " << device << " whose physical id is " << visible_devices[device] << "." << endl;
       device = visible_devices[device];
     }
+    string drm_file = query_string(device, EGL_DRM_DEVICE_FILE_EXT);
+    if (!drm_file.empty())
+      device_sysfs_dir_ = sysfs_dir_of_device_file(drm_file);
+    else if (check_nvidia_readable(device))
+      device_sysfs_dir_ = sysfs_dir_of_device_file(ssprintf("/dev/nvidia%d", device));
+    // before the driver allocates anything, and starts its threads
+    placement_ = place_thread(device_sysfs_dir_);
     eglDpy_ = eglGetPlatformDisplayEXT(EGL_PLATFORM_DEVICE_EXT, eglDevs[device], 0);
   }
 
@@ -11,6 +11,7 @@
 #include "api.hh"
 #undef INCLUDE_GL_CONTEXT_HEADERS
 
+#include "lib/affinity.hh"
 #include "lib/geometry.hh"
 
 namespace render {
@@ -22,9 +23,14 @@ class GLContext {
 
     virtual void printInfo();
 
+    // Where the thread that created the context runs. See place_thread().
+    const Placement& placement() const { return placement_; }
+
   protected:
     void init();
     Geometry win_size_;
+    std::string device_sysfs_dir_;  // of the GPU, if known
+    Placement placement_;
 };
 
 
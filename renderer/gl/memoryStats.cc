@@ -0,0 +1,148 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: memoryStats.cc
+
+#include "memoryStats.hh"
+
+#include <algorithm>
+#include <utility>
+
+#include "lib/debugutils.hh"
+#include "lib/strutils.hh"
+
+using namespace std;
+
+namespace render {
+
+namespace {
+
+const char* DEFAULT_OWNER = "renderer";
+const char* TOTAL = "total";
+
+struct Allocation {
+  string owner;
+  GPUMemory::Category cat;
+  size_t bytes;
+};
+
+struct Usage {
+  size_t bytes[GPUMemory::NR_CATEGORY] = {};
+  size_t total = 0, peak = 0;
+  int objects = 0;
+
+  void add(GPUMemory::Category cat, size_t b) {
+    bytes[cat] += b;
+    total += b;
+    objects++;
+    peak = max(peak, total);
+  }
+
+  void sub(GPUMemory::Category cat, size_t b) {
+    bytes[cat] -= b;
+    total -= b;
+    objects--;
+  }
+};
+
+struct State {
+  map<pair<GPUMemory::Object, GLuint>, Allocation> objects;
+  map<string, Usage> usage;   // by owner, and TOTAL
+  string owner = DEFAULT_OWNER;
+};
+
+State& state() {
+  static thread_local State s;
+  return s;
+}
+
+} // namespace
+
+const char* GPUMemory::category_name(Category cat) {
+  static const char* names[] = {"vertex_buffer", "texture", "framebuffer"};
+  m_assert(cat >= 0 && cat < NR_CATEGORY);
+  return names[cat];
+}
+
+void GPUMemory::allocate(Category cat, Object type, GLuint id, size_t bytes) {
+  // storage can be re-specified
+  release(type, id);
+  State& s = state();
+  s.objects[{type, id}] = Allocation{s.owner, cat, bytes};
+  s.usage[s.owner].add(cat, bytes);
+  s.usage[TOTAL].add(cat, bytes);
+}
+
+void GPUMemory::release(Object type, GLuint id) {
+  State& s = state();
+  auto itr = s.objects.find({type, id});
+  if (itr == s.objects.end())
+    return;
+  auto& a = itr->second;
+  s.usage[a.owner].sub(a.cat, a.bytes);
+  s.usage[TOTAL].sub(a.cat, a.bytes);
+  s.objects.erase(itr);
+}
+
+size_t GPUMemory::bytes_per_pixel(GLenum internal_format) {
+  switch (internal_format) {
+    case GL_RGB:
+    case GL_RGB8:
+      return 3;
+    case GL_RGBA:
+    case GL_RGBA8:
+    case GL_DEPTH24_STENCIL8:
+    case GL_RG16F:
+    case GL_R32F:
+      return 4;
+    case GL_RGBA16F:
+      return 8;
+    case GL_RGBA32F:
+      return 16;
+    default:
+      error_exit(ssprintf("Unknown internal format 0x%x\n", internal_format));
+  }
+}
+
+size_t GPUMemory::texture_size(int w, int h, GLenum internal_format, bool mipmap) {
+  size_t bpp = bytes_per_pixel(internal_format);
+  size_t ret = (size_t)w * h * bpp;
+  if (!mipmap)
+    return ret;
+  // each level halves the size, rounding down, until 1x1
+  while (w > 1 || h > 1) {
+    w = max(w / 2, 1);
+    h = max(h / 2, 1);
+    ret += (size_t)w * h * bpp;
+  }
+  return ret;
+}
+
+GPUMemory::OwnerScope::OwnerScope(const string& owner):
+  prev_{state().owner} {
+  state().owner = owner;
+}
+
+GPUMemory::OwnerScope::~OwnerScope() {
+  state().owner = prev_;
+}
+
+map<string, map<string, double>> GPUMemory::summary() {
+  map<string, map<string, double>> ret;
+  // always report the total, even before any allocation
+  state().usage[TOTAL];
+  for (auto& kv : state().usage) {
+    const Usage& u = kv.second;
+    auto& r = ret[kv.first];
+    for (int i = 0; i < NR_CATEGORY; ++i)
+      r[category_name(static_cast<Category>(i))] = u.bytes[i];
+    r["total"] = u.total;
+    r["peak"] = u.peak;
+    r["objects"] = u.objects;
+  }
+  return ret;
+}
+
+} // namespace render
@@ -0,0 +1,69 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: memoryStats.hh
+
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <string>
+
+#include "api.hh"
+
+namespace render {
+
+// Accounting of the GPU memory allocated by the renderer, grouped by owner
+// (the obj file of a scene, or "renderer" for framebuffers) and category.
+//
+// Sizes are computed from the dimensions and internal formats requested from
+// the driver, which may add padding (e.g. store GL_RGB as 4 bytes per pixel).
+// GL objects live in the context of a thread, so the accounting is per thread.
+class GPUMemory {
+  public:
+    enum Category {
+      VERTEX_BUFFER = 0,
+      TEXTURE = 1,      // textures of the scenes, with their mipmaps
+      FRAMEBUFFER = 2,  // render targets: renderbuffers, cube maps, readback buffers
+      NR_CATEGORY = 3
+    };
+
+    // Kinds of GL objects, which have separate names.
+    enum class Object { BUFFER, TEXTURE, RENDERBUFFER };
+
+    static const char* category_name(Category cat);
+
+    // Record that the object `id` now holds `bytes` bytes, owned by the
+    // current owner.
+    static void allocate(Category cat, Object type, GLuint id, size_t bytes);
+    // Record the deletion of an object. Unknown objects are ignored.
+    static void release(Object type, GLuint id);
+
+    // Bytes per pixel of an internal format used by the renderer.
+    static size_t bytes_per_pixel(GLenum internal_format);
+    // Bytes of a 2D texture, with a full mipmap chain if `mipmap`.
+    static size_t texture_size(int w, int h, GLenum internal_format, bool mipmap);
+
+    // Allocations within the lifetime of an OwnerScope belong to `owner`.
+    class OwnerScope {
+      public:
+        explicit OwnerScope(const std::string& owner);
+        ~OwnerScope();
+
+        OwnerScope(const OwnerScope&) = delete;
+        OwnerScope& operator = (const OwnerScope&) = delete;
+
+      private:
+        std::string prev_;
+    };
+
+    // {owner: {"vertex_buffer", "texture", "framebuffer", "total", "peak", "objects"}},
+    // in bytes, where "peak" is the high-water mark of "total". The key
+    // "total" is the sum over all owners, with its own peak.
+    // Owners whose objects were all released are kept, with their peak.
+    static std::map<std::string, std::map<std::string, double>> summary();
+};
+
+} // namespace render
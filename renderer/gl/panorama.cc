@@ -0,0 +1,271 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: panorama.cc
+
+#include "panorama.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "utils.hh"
+#include "memoryStats.hh"
+#include "lib/debugutils.hh"
+#include "lib/strutils.hh"
+
+namespace {
+
+// Viewing direction and up vector of each cube map face, in the order of
+// GL_TEXTURE_CUBE_MAP_POSITIVE_X + i.
+// With these up vectors, a face rendered into a framebuffer matches the
+// texel layout that the cube map sampler expects.
+const glm::vec3 CUBE_FACE_DIRS[6] = {
+  {1.f, 0.f, 0.f}, {-1.f, 0.f, 0.f},
+  {0.f, 1.f, 0.f}, {0.f, -1.f, 0.f},
+  {0.f, 0.f, 1.f}, {0.f, 0.f, -1.f}
+};
+const glm::vec3 CUBE_FACE_UPS[6] = {
+  {0.f, -1.f, 0.f}, {0.f, -1.f, 0.f},
+  {0.f, 0.f, 1.f}, {0.f, 0.f, -1.f},
+  {0.f, -1.f, 0.f}, {0.f, -1.f, 0.f}
+};
+
+const float PI = 3.14159265358979f;
+
+} // namespace
+
+namespace render {
+
+CubeMapFramebuffer::CubeMapFramebuffer(int size): size_{size} {
+  glGenTextures(1, &tex_);
+  GLStateCache::bindTexture(GL_TEXTURE_CUBE_MAP, tex_);
+  for (int i = 0; i < 6; ++i)
+    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA8,
+        size_, size_, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, 0);
+  GLStateCache::bindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+  glGenRenderbuffers(1, &rbo_);
+  glBindRenderbuffer(GL_RENDERBUFFER, rbo_);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, size_, size_);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  GPUMemory::allocate(GPUMemory::FRAMEBUFFER, GPUMemory::Object::TEXTURE, tex_,
+      6 * GPUMemory::texture_size(size_, size_, GL_RGBA8, false));
+  GPUMemory::allocate(GPUMemory::FRAMEBUFFER, GPUMemory::Object::RENDERBUFFER, rbo_,
+      GPUMemory::texture_size(size_, size_, GL_DEPTH24_STENCIL8, false));
+
+  glGenFramebuffers(1, &fbo_);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+      GL_TEXTURE_CUBE_MAP_POSITIVE_X, tex_, 0);
+  GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  if (status != GL_FRAMEBUFFER_COMPLETE)
+    error_exit(
+      ssprintf("ERROR::FRAMEBUFFER: Cube map framebuffer is not complete! ErrorCode=%d\n", status));
+}
+
+CubeMapFramebuffer::~CubeMapFramebuffer() {
+  glDeleteFramebuffers(1, &fbo_);
+  GPUMemory::release(GPUMemory::Object::RENDERBUFFER, rbo_);
+  GPUMemory::release(GPUMemory::Object::TEXTURE, tex_);
+  glDeleteRenderbuffers(1, &rbo_);
+  GLStateCache::deleteTexture(tex_);
+}
+
+void CubeMapFramebuffer::bindFace(int face) const {
+  m_assert(face >= 0 && face < 6);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+      GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, tex_, 0);
+}
+
+
+// A triangle covering the whole viewport, without any vertex buffer.
+const char* PanoramaRenderer::vShader = R"xxx(
+#version 330 core
+out vec2 uv;
+
+void main()
+{
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    uv = p;
+    gl_Position = vec4(p * 2.0f - 1.0f, 0.0f, 1.0f);
+}
+)xxx";
+
+const char* PanoramaRenderer::fShader = R"xxx(
+#version 330 core
+
+in vec2 uv;
+out vec4 fragcolor;
+
+const float PI = 3.14159265358979f;
+
+uniform uint mode;
+// 0: equirectangular
+// 1: fisheye
+uniform uint values;
+// 0: color
+// 1: depth, gray levels
+// 2: inverse depth, 16 bits in r and g
+uniform vec3 front;
+uniform vec3 right;
+uniform vec3 up;
+uniform float fov;  // fisheye field of view in radians
+uniform vec2 scale;  // fisheye: maps uv to the unit circle
+uniform vec3 background;
+uniform samplerCube cubemap;
+
+void main() {
+    vec3 dir;
+    if (mode == 0u) {
+      float lon = (uv.x - 0.5f) * 2.0f * PI;
+      float lat = (uv.y - 0.5f) * PI;
+      dir = cos(lat) * sin(lon) * right + sin(lat) * up + cos(lat) * cos(lon) * front;
+    } else {
+      vec2 p = (uv * 2.0f - 1.0f) * scale;
+      float r = length(p);
+      if (r > 1.0f) {
+        fragcolor = vec4(background, 1.0f);
+        return;
+      }
+      float theta = r * fov * 0.5f;
+      vec2 d = r > 0.0f ? p / r : vec2(0.0f);
+      dir = sin(theta) * (d.x * right + d.y * up) + cos(theta) * front;
+    }
+    vec3 c = texture(cubemap, dir).xyz;
+    if (values != 0u) {
+      // faces store the depth along their axis, which is the major axis of dir
+      vec3 a = abs(dir);
+      float cosine = max(a.x, max(a.y, a.z)) / length(dir);
+      if (values == 1u && c.r == c.g && c.g == c.b) {
+        // depths beyond the range stay saturated
+        c = vec3(min(c.r / cosine, 1.0f));
+      } else if (values == 2u && c.b == 0.0f) {
+        float f = round(c.r * 255.0f) * 256.0f + round(c.g * 255.0f);
+        f = floor(f * cosine + 0.5f);
+        float ms = floor(f / 256.0f);
+        c = vec3(ms / 255.0f, (f - ms * 256.0f) / 255.0f, 0.0f);
+      }
+    }
+    fragcolor = vec4(c, 1.0f);
+}
+)xxx";
+
+
+PanoramaRenderer::PanoramaRenderer(): shader_{vShader, fShader} {
+  mode_loc_ = shader_.getUniformLocation("mode");
+  values_loc_ = shader_.getUniformLocation("values");
+  front_loc_ = shader_.getUniformLocation("front");
+  right_loc_ = shader_.getUniformLocation("right");
+  up_loc_ = shader_.getUniformLocation("up");
+  fov_loc_ = shader_.getUniformLocation("fov");
+  scale_loc_ = shader_.getUniformLocation("scale");
+  background_loc_ = shader_.getUniformLocation("background");
+  cubemap_loc_ = shader_.getUniformLocation("cubemap");
+  // core profile needs a vertex array bound to draw, even without attributes
+  glGenVertexArrays(1, &vao_);
+}
+
+PanoramaRenderer::~PanoramaRenderer() {
+  GLStateCache::deleteVertexArray(vao_);
+}
+
+Matuc PanoramaRenderer::render(const Camera& cam, Geometry out,
+    PanoramaMode mode, float fov, bool nearest, PanoramaValues values,
+    glm::vec3 background,
+    std::function<void(const glm::mat4&, Geometry)> draw_face) {
+  m_assert(out.w > 0 && out.h > 0);
+  float fov_rad = glm::radians(glm::clamp(fov, 1.f, 360.f));
+
+  // Choose the face size so that the cube map has roughly the same angular
+  // resolution as the output.
+  int face_size;
+  if (mode == PanoramaMode::EQUIRECTANGULAR) {
+    face_size = std::max(out.w / 4, out.h / 2);
+  } else {
+    face_size = std::min(out.w, out.h) * (PI / 2) / fov_rad;
+  }
+  GLint max_size;
+  glGetIntegerv(GL_MAX_CUBE_MAP_TEXTURE_SIZE, &max_size);
+  face_size = std::min(std::max(face_size, 1), static_cast<int>(max_size));
+
+  if (!cube_fb_ || cube_fb_->size() != face_size)
+    cube_fb_.reset(new CubeMapFramebuffer{face_size});
+  if (!out_fb_ || out_size_.w != out.w || out_size_.h != out.h) {
+    out_fb_.reset(new Framebuffer{out});
+    out_size_ = out;
+  }
+
+  // 1. render the six faces
+  glViewport(0, 0, face_size, face_size);
+  glm::mat4 projection = glm::perspective(glm::radians(90.f), 1.f, cam.near, cam.far);
+  for (int i = 0; i < 6; ++i) {
+    cube_fb_->bindFace(i);
+    glm::mat4 view = glm::lookAt(cam.pos, cam.pos + CUBE_FACE_DIRS[i], CUBE_FACE_UPS[i]);
+    draw_face(projection * view, Geometry{face_size, face_size});
+  }
+
+  // 2. resample the cube map into the panorama
+  glm::vec3 front, right, up;
+  if (mode == PanoramaMode::EQUIRECTANGULAR) {
+    // keep the horizon level: ignore the pitch
+    front = glm::vec3{cam.front.x, 0.f, cam.front.z};
+    if (glm::length(front) < 1e-4f)   // looking straight up or down
+      front = glm::vec3{cos(glm::radians(cam.yaw)), 0.f, sin(glm::radians(cam.yaw))};
+    front = glm::normalize(front);
+    up = WORLD_UP;
+    right = glm::normalize(glm::cross(front, up));
+  } else {
+    front = cam.front;
+    right = cam.right;
+    up = glm::cross(right, front);
+  }
+  float short_side = std::min(out.w, out.h);
+  glm::vec2 scale{out.w / short_side, out.h / short_side};
+
+  FramebufferScope fbs{*out_fb_};
+  glViewport(0, 0, out.w, out.h);
+  bool depth_test = GLStateCache::isEnabled(GL_DEPTH_TEST),
+       blend = GLStateCache::isEnabled(GL_BLEND);
+  GLStateCache::disable(GL_DEPTH_TEST);
+  GLStateCache::disable(GL_BLEND);
+
+  shader_.use();
+  glUniform1ui(mode_loc_, static_cast<GLuint>(mode));
+  glUniform1ui(values_loc_, static_cast<GLuint>(values));
+  glUniform3fv(front_loc_, 1, &front.x);
+  glUniform3fv(right_loc_, 1, &right.x);
+  glUniform3fv(up_loc_, 1, &up.x);
+  glUniform1f(fov_loc_, fov_rad);
+  glUniform2fv(scale_loc_, 1, &scale.x);
+  glUniform3fv(background_loc_, 1, &background.x);
+  GLStateCache::activeTexture(GL_TEXTURE0);
+  glUniform1i(cubemap_loc_, 0);  // use TU0
+
+  GLStateCache::bindTexture(GL_TEXTURE_CUBE_MAP, cube_fb_->texture());
+  GLint filter = nearest ? GL_NEAREST : GL_LINEAR;
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, filter);
+  GLStateCache::enable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+  {
+    VertexArrayGuard VAG{vao_};
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glCheckError("PanoramaRenderer::render::glDrawArrays");
+  }
+  // don't leave the cube map bound while rendering into it
+  GLStateCache::bindTexture(GL_TEXTURE_CUBE_MAP, 0);
+  GLStateCache::setEnabled(GL_DEPTH_TEST, depth_test);
+  GLStateCache::setEnabled(GL_BLEND, blend);
+  return fbs.capture();
+}
+
+} // namespace render
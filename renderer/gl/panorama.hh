@@ -0,0 +1,104 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: panorama.hh
+
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include "api.hh"
+#include <glm/glm.hpp>
+
+#include "camera.hh"
+#include "fbScope.hh"
+#include "shader.hh"
+#include "lib/geometry.hh"
+#include "lib/mat.h"
+
+namespace render {
+
+enum class PanoramaMode {
+  // 360 x 180 degrees, longitude along the x axis, centered at the camera front.
+  EQUIRECTANGULAR = 0,
+  // Equidistant fisheye, with the given field of view across the shorter side.
+  FISHEYE = 1
+};
+
+// How the colors of the cube map faces are interpreted when resampling.
+enum class PanoramaValues {
+  COLOR = 0,
+  // gray levels of planar depth, and non-gray colors for infinity.
+  // Converted to the distance from the camera.
+  DEPTH = 1,
+  // 16-bit inverse planar depth in the first two channels, and 0 in the
+  // third. Converted to the inverse distance from the camera.
+  INVDEPTH = 2
+};
+
+// A cube map texture with a depth buffer, whose faces can be rendered to.
+class CubeMapFramebuffer {
+  public:
+    explicit CubeMapFramebuffer(int size);
+    ~CubeMapFramebuffer();
+
+    CubeMapFramebuffer(const CubeMapFramebuffer&) = delete;
+    CubeMapFramebuffer& operator = (const CubeMapFramebuffer&) = delete;
+
+    // Bind the framebuffer with face `face` (0-5, in the order of
+    // GL_TEXTURE_CUBE_MAP_POSITIVE_X + face) as the color attachment.
+    void bindFace(int face) const;
+
+    GLuint texture() const { return tex_; }
+    int size() const { return size_; }
+
+  protected:
+    int size_;
+    GLuint fbo_, tex_, rbo_;
+};
+
+
+// Render the scene into a cube map around the camera, then resample it
+// on the GPU into a panorama. Only the panorama is read back.
+class PanoramaRenderer {
+  public:
+    PanoramaRenderer();
+    ~PanoramaRenderer();
+
+    PanoramaRenderer(const PanoramaRenderer&) = delete;
+    PanoramaRenderer& operator = (const PanoramaRenderer&) = delete;
+
+    // draw_face: draw the scene with the given projection * view matrix,
+    //   into the currently bound framebuffer, whose viewport is given.
+    // out: size of the output panorama.
+    // fov: field of view in degrees, only used by FISHEYE.
+    // nearest: use nearest sampling instead of bilinear. Needed when the
+    //   colors are labels or encoded values which cannot be interpolated.
+    // values: how to convert the colors of the faces. Depths of a face are
+    //   along its axis, and have to be converted to be continuous at seams.
+    // background: color of the pixels not covered by the panorama.
+    //
+    // Returns the panorama as a h x w x 3 image.
+    // The viewport is changed and has to be restored by the caller.
+    Matuc render(const Camera& cam, Geometry out,
+        PanoramaMode mode, float fov, bool nearest, PanoramaValues values,
+        glm::vec3 background,
+        std::function<void(const glm::mat4&, Geometry)> draw_face);
+
+    static const char *vShader, *fShader;
+
+  protected:
+    Shader shader_;
+    GLint mode_loc_, values_loc_, front_loc_, right_loc_, up_loc_,
+          fov_loc_, scale_loc_, background_loc_, cubemap_loc_;
+    GLuint vao_;
+
+    std::unique_ptr<CubeMapFramebuffer> cube_fb_;
+    std::unique_ptr<Framebuffer> out_fb_;
+    Geometry out_size_{0, 0};
+};
+
+} // namespace render
@@ -0,0 +1,129 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: pointcloud.cc
+
+#include "pointcloud.hh"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "lib/debugutils.hh"
+#include "lib/parallel.hh"
+
+namespace {
+
+// Rows per thread. A row is cheap, so don't start threads for tiny images.
+const int MIN_ROWS_PER_THREAD = 16;
+
+// 21 bits per axis, which covers +-10km with 1cm voxels.
+inline uint64_t voxel_key(const float* p, float inv_size) {
+  const int64_t offset = 1 << 20, mask = (1 << 21) - 1;
+  uint64_t x = (static_cast<int64_t>(std::floor(p[0] * inv_size)) + offset) & mask,
+           y = (static_cast<int64_t>(std::floor(p[1] * inv_size)) + offset) & mask,
+           z = (static_cast<int64_t>(std::floor(p[2] * inv_size)) + offset) & mask;
+  return (x << 42) | (y << 21) | z;
+}
+
+} // namespace
+
+namespace render {
+
+Mat32f depth_to_point_cloud(const Mat32f& depth, const Mat<int>* labels,
+    const glm::mat4& inv_camera_matrix, float voxel_size) {
+  const int h = depth.rows(), w = depth.cols();
+  m_assert(depth.channels() == 1);
+  m_assert(!labels || (labels->rows() == h && labels->cols() == w));
+
+  // Each row is unprojected into its own region of `buf`, then compacted.
+  std::vector<float> buf((size_t)h * w * 4);
+  std::vector<int> row_count(h);
+  const glm::mat4& m = inv_camera_matrix;
+  const float dx = 2.f / w, dy = 2.f / h;
+
+  parallel_for(h, MIN_ROWS_PER_THREAD, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      // clip = (x, y, 2 * d - 1, 1), and x varies linearly along the row.
+      float x0 = 0.5f * dx - 1.f, y = 1.f - (i + 0.5f) * dy;
+      glm::vec4 base = m[0] * x0 + m[1] * y + m[3] - m[2],
+                step_x = m[0] * dx,
+                scale_d = m[2] * 2.f;
+      const float* d = depth.ptr(i);
+      float* out = buf.data() + (size_t)i * w * 4;
+
+      // dense pass without branches, so that it can be vectorized
+      for (int j = 0; j < w; ++j) {
+        glm::vec4 p = base + step_x * static_cast<float>(j) + scale_d * d[j];
+        float inv_w = 1.f / p.w;
+        out[j * 4] = p.x * inv_w;
+        out[j * 4 + 1] = p.y * inv_w;
+        out[j * 4 + 2] = p.z * inv_w;
+        out[j * 4 + 3] = -1.f;
+      }
+      if (labels) {
+        const int* l = labels->ptr(i);
+        for (int j = 0; j < w; ++j)
+          out[j * 4 + 3] = l[j];
+      }
+
+      // drop the background
+      int n = 0;
+      for (int j = 0; j < w; ++j) {
+        if (d[j] < 1.f) {
+          if (n != j)
+            memcpy(out + n * 4, out + j * 4, 4 * sizeof(float));
+          ++n;
+        }
+      }
+      row_count[i] = n;
+    }
+  });
+
+  size_t nr_point = 0;
+  for (int i = 0; i < h; ++i) {
+    int n = row_count[i];
+    if (n)
+      memmove(buf.data() + nr_point * 4, buf.data() + (size_t)i * w * 4,
+          n * 4 * sizeof(float));
+    nr_point += n;
+  }
+
+  if (voxel_size > 0 && nr_point > 0) {
+    float inv_size = 1.f / voxel_size;
+    std::unordered_map<uint64_t, int> voxel_id;
+    voxel_id.reserve(nr_point);
+    std::vector<int> count;
+    size_t nr_voxel = 0;
+    // accumulate sums in place at the front of buf
+    for (size_t k = 0; k < nr_point; ++k) {
+      float* p = buf.data() + k * 4;
+      auto itr = voxel_id.emplace(voxel_key(p, inv_size), nr_voxel);
+      float* v = buf.data() + itr.first->second * 4;
+      if (itr.second) {
+        memmove(v, p, 4 * sizeof(float));
+        count.push_back(1);
+        ++nr_voxel;
+      } else {
+        v[0] += p[0]; v[1] += p[1]; v[2] += p[2];
+        ++count[itr.first->second];
+      }
+    }
+    for (size_t k = 0; k < nr_voxel; ++k) {
+      float inv_count = 1.f / count[k];
+      float* v = buf.data() + k * 4;
+      v[0] *= inv_count; v[1] *= inv_count; v[2] *= inv_count;
+    }
+    nr_point = nr_voxel;
+  }
+
+  Mat32f ret(nr_point, 4, 1);
+  memcpy(ret.ptr(), buf.data(), nr_point * 4 * sizeof(float));
+  return ret;
+}
+
+} // namespace render
@@ -0,0 +1,30 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: pointcloud.hh
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "lib/mat.h"
+
+namespace render {
+
+// Unproject a depth image into world-space points.
+//
+// depth: h x w x 1 window-space depth, as returned by Framebuffer::captureDepth().
+//   Pixels with depth 1 (nothing rendered) are dropped.
+// labels: h x w x 1 label of each pixel, or nullptr.
+// inv_camera_matrix: inverse of the projection * view matrix used to render.
+// voxel_size: if positive, points are merged into their centroid for each
+//   voxel of this size. The label of a voxel is the label of its first point.
+//
+// Returns a N x 4 matrix of (x, y, z, label), ordered by their first pixel in
+// row-major order. The label is -1 if `labels` is nullptr.
+Mat32f depth_to_point_cloud(const Mat32f& depth, const Mat<int>* labels,
+    const glm::mat4& inv_camera_matrix, float voxel_size);
+
+} // namespace render
@@ -0,0 +1,185 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: programCache.cc
+
+#include "programCache.hh"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "lib/strutils.hh"
+
+using namespace std;
+
+namespace {
+
+const char MAGIC[8] = "H3DPRG1";
+
+atomic<int> nr_hit_{0}, nr_miss_{0};
+
+// FNV-1a, which is stable across platforms and runs, unlike std::hash
+uint64_t fnv1a(const string& s) {
+  uint64_t h = 14695981039346656037ULL;
+  for (unsigned char c : s) {
+    h ^= c;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+string cache_dir() {
+  if (const char* dir = getenv("HOUSE3D_SHADER_CACHE"))
+    return dir;
+  const char* xdg = getenv("XDG_CACHE_HOME");
+  if (xdg && *xdg)
+    return string(xdg) + "/house3d/shaders";
+  const char* home = getenv("HOME");
+  if (home && *home)
+    return string(home) + "/.cache/house3d/shaders";
+  return "";
+}
+
+bool make_dirs(const string& dir) {
+  for (size_t pos = dir.find('/', 1); ; pos = dir.find('/', pos + 1)) {
+    string prefix = dir.substr(0, pos);
+    if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST)
+      return false;
+    if (pos == string::npos)
+      return true;
+  }
+}
+
+string cache_file(const string& dir, const string& key) {
+  return ssprintf("%s/%016llx.bin", dir.c_str(), (unsigned long long)fnv1a(key));
+}
+
+bool binary_supported() {
+  GLint nr_format = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nr_format);
+  return nr_format > 0;
+}
+
+template <typename T>
+void write_value(ofstream& out, T v) {
+  out.write(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template <typename T>
+bool read_value(ifstream& in, T& v) {
+  return (bool)in.read(reinterpret_cast<char*>(&v), sizeof(T));
+}
+
+} // namespace
+
+namespace render {
+
+string ProgramCache::key(const char* vertex_shader, const char* fragment_shader) {
+  auto str = [](GLenum name) {
+    const GLubyte* s = glGetString(name);
+    return s ? string(reinterpret_cast<const char*>(s)) : string();
+  };
+  string ret = str(GL_VENDOR) + "\n" + str(GL_RENDERER) + "\n" + str(GL_VERSION) + "\n";
+  ret += vertex_shader;
+  ret.push_back('\0');
+  ret += fragment_shader;
+  return ret;
+}
+
+GLuint ProgramCache::load(const string& key) {
+  string dir = cache_dir();
+  if (dir.empty() || !binary_supported())
+    return 0;
+  ifstream fin(cache_file(dir, key), ios::binary);
+  char magic[sizeof(MAGIC)];
+  uint32_t key_len, format, len;
+  bool ok = fin.good() && fin.read(magic, sizeof(magic)) &&
+    memcmp(magic, MAGIC, sizeof(MAGIC)) == 0 && read_value(fin, key_len) &&
+    key_len == key.size();
+  string stored_key;
+  vector<char> binary;
+  if (ok) {
+    stored_key.resize(key_len);
+    ok = fin.read(&stored_key[0], key_len) && stored_key == key &&
+      read_value(fin, format) && read_value(fin, len);
+  }
+  if (ok) {
+    binary.resize(len);
+    ok = (bool)fin.read(binary.data(), len);
+  }
+  if (!ok) {
+    nr_miss_++;
+    return 0;
+  }
+
+  while (glGetError() != GL_NO_ERROR) {}
+  GLuint program = glCreateProgram();
+  glProgramBinary(program, format, binary.data(), len);
+  GLint success = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  // the driver rejects binaries from another build of itself
+  if (glGetError() != GL_NO_ERROR || !success) {
+    glDeleteProgram(program);
+    nr_miss_++;
+    return 0;
+  }
+  nr_hit_++;
+  return program;
+}
+
+void ProgramCache::store(const string& key, GLuint program) {
+  string dir = cache_dir();
+  if (dir.empty() || !binary_supported() || !make_dirs(dir))
+    return;
+  GLint len = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &len);
+  if (len <= 0)
+    return;
+  vector<char> binary(len);
+  GLenum format;
+  GLsizei written = 0;
+  glGetProgramBinary(program, len, &written, &format, binary.data());
+  if (written <= 0)
+    return;
+
+  // write then rename, so that concurrent workers never read a partial file
+  string fname = cache_file(dir, key);
+  // unique among the contexts of all processes
+  string tmp = fname + ".XXXXXX";
+  int fd = mkstemp(&tmp[0]);
+  if (fd < 0)
+    return;
+  fchmod(fd, 0644);   // mkstemp creates it as 0600
+  close(fd);
+  {
+    ofstream fout(tmp, ios::binary);
+    fout.write(MAGIC, sizeof(MAGIC));
+    write_value<uint32_t>(fout, key.size());
+    fout.write(key.data(), key.size());
+    write_value<uint32_t>(fout, format);
+    write_value<uint32_t>(fout, written);
+    fout.write(binary.data(), written);
+    if (!fout.good()) {
+      fout.close();
+      remove(tmp.c_str());
+      return;
+    }
+  }
+  if (rename(tmp.c_str(), fname.c_str()) != 0)
+    remove(tmp.c_str());
+}
+
+int ProgramCache::nr_hit() { return nr_hit_; }
+int ProgramCache::nr_miss() { return nr_miss_; }
+
+} // namespace render
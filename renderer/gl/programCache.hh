@@ -0,0 +1,42 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: programCache.hh
+
+#pragma once
+
+#include <string>
+
+#include "api.hh"
+
+namespace render {
+
+// A disk cache of linked shader programs, saved with glGetProgramBinary and
+// restored with glProgramBinary, to skip compiling shaders at startup.
+//
+// The cache directory is $HOUSE3D_SHADER_CACHE, or by default
+// $XDG_CACHE_HOME/house3d/shaders (~/.cache/house3d/shaders).
+// Setting HOUSE3D_SHADER_CACHE to an empty string disables the cache.
+// Entries are keyed by the shader sources and the vendor, renderer and version
+// of the driver. A binary that the driver rejects is ignored, and the program
+// is compiled again.
+class ProgramCache {
+  public:
+    // The key of a program in the current context.
+    static std::string key(const char* vertex_shader, const char* fragment_shader);
+
+    // A linked program, or 0 if not in the cache.
+    static GLuint load(const std::string& key);
+
+    // Save a linked program. The program has to be linked with
+    // GL_PROGRAM_BINARY_RETRIEVABLE_HINT. Failures are ignored.
+    static void store(const std::string& key, GLuint program);
+
+    // Number of programs loaded from the cache, and compiled, by this process.
+    static int nr_hit();
+    static int nr_miss();
+};
+
+} // namespace render
@@ -0,0 +1,83 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: readback.cc
+
+#include "readback.hh"
+
+#include <memory>
+
+#include "memoryStats.hh"
+#include "utils.hh"
+#include "lib/debugutils.hh"
+#include "lib/profiler.hh"
+
+namespace render {
+
+AsyncReadback::AsyncReadback(Geometry size, int nr_buffer):
+  size_{size}, pbo_(nr_buffer), tags_(nr_buffer) {
+  m_assert(nr_buffer > 0);
+  size_t bytes = (size_t)size.w * size.h * 4;
+  glGenBuffers(nr_buffer, pbo_.data());
+  for (GLuint pbo : pbo_) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+    GPUMemory::allocate(GPUMemory::FRAMEBUFFER, GPUMemory::Object::BUFFER, pbo, bytes);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glCheckError("AsyncReadback");
+}
+
+AsyncReadback::~AsyncReadback() {
+  if (mapped_)
+    pop();
+  for (GLuint pbo : pbo_)
+    GPUMemory::release(GPUMemory::Object::BUFFER, pbo);
+  glDeleteBuffers(pbo_.size(), pbo_.data());
+}
+
+void AsyncReadback::start(int tag) {
+  PROFILE_ZONE("AsyncReadback::start");
+  m_assert(!full());
+  int idx = (head_ + count_) % pbo_.size();
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo_[idx]);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  // with a pack buffer bound, the pointer is an offset into it
+  glReadPixels(0, 0, size_.w, size_.h, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  // other readbacks read into client memory
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  tags_[idx] = tag;
+  count_++;
+}
+
+Matuc AsyncReadback::map() {
+  PROFILE_ZONE("AsyncReadback::map");
+  m_assert(!empty() && !mapped_);
+  size_t bytes = (size_t)size_.w * size_.h * 4;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo_[head_]);
+  auto ptr = static_cast<unsigned char*>(
+      glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT));
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  if (!ptr)
+    error_exit("AsyncReadback: glMapBufferRange failed\n");
+  mapped_ = true;
+  // does not own the mapped memory, and does not allocate
+  return Matuc{size_.h, size_.w, 4, std::shared_ptr<unsigned char>(
+      std::shared_ptr<unsigned char>(), ptr)};
+}
+
+void AsyncReadback::pop() {
+  m_assert(!empty());
+  if (mapped_) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo_[head_]);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    mapped_ = false;
+  }
+  head_ = (head_ + 1) % pbo_.size();
+  count_--;
+}
+
+} // namespace render
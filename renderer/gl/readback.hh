@@ -0,0 +1,57 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: readback.hh
+
+#pragma once
+
+#include <vector>
+
+#include "api.hh"
+#include "lib/geometry.hh"
+#include "lib/mat.h"
+
+namespace render {
+
+// Read RGBA8 frames back through a ring of pixel pack buffers.
+//
+// start() only queues the copy of the color buffer on the GPU, so the next
+// frames can be drawn before the pixels of this one reach the CPU. map()
+// waits for the oldest copy. With a ring of N buffers, up to N frames are in
+// flight.
+class AsyncReadback {
+  public:
+    AsyncReadback(Geometry size, int nr_buffer);
+    ~AsyncReadback();
+
+    AsyncReadback(const AsyncReadback&) = delete;
+    AsyncReadback& operator = (const AsyncReadback&) = delete;
+
+    bool empty() const { return count_ == 0; }
+    bool full() const { return count_ == (int)pbo_.size(); }
+
+    // Queue a copy of the color buffer of the bound framebuffer, with a tag to
+    // identify the frame. Must not be full().
+    void start(int tag);
+
+    // The tag of the oldest copy.
+    int front_tag() const { return tags_[head_]; }
+
+    // Wait for the oldest copy, and map it as a h x w x 4 image. As with
+    // glReadPixels, the bottom row comes first. Valid until pop().
+    Matuc map();
+
+    // Release the oldest copy.
+    void pop();
+
+  private:
+    Geometry size_;
+    std::vector<GLuint> pbo_;
+    std::vector<int> tags_;
+    int head_ = 0, count_ = 0;
+    bool mapped_ = false;
+};
+
+} // namespace render
@@ -11,6 +11,8 @@
 #include <iostream>
 
 #include "api.hh"
+#include "programCache.hh"
+#include "stateCache.hh"
 #include <glm/glm.hpp>
 
 #include "lib/strutils.hh"
@@ -21,8 +23,13 @@ namespace render {
 
 class Shader {
   public:
-    // Constructor generates the shader on the fly
+    // Constructor generates the shader on the fly, or loads the program
+    // from ProgramCache
     Shader(const char* vertexShader, const char* fragmentShader) {
+      std::string cache_key = ProgramCache::key(vertexShader, fragmentShader);
+      this->Program = ProgramCache::load(cache_key);
+      if (this->Program)
+        return;
       // 2. Compile shaders
       GLint success;
       GLchar infoLog[512];
@@ -52,6 +59,7 @@ class Shader {
       this->Program = glCreateProgram();
       glAttachShader(this->Program, vertex);
       glAttachShader(this->Program, fragment);
+      glProgramParameteri(this->Program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
       glLinkProgram(this->Program);
       // Print linking errors if any
       glGetProgramiv(this->Program, GL_LINK_STATUS, &success);
@@ -63,9 +71,10 @@ class Shader {
       // Delete the shaders as they're linked into our program now and no longer necessery
       glDeleteShader(vertex);
       glDeleteShader(fragment);
+      ProgramCache::store(cache_key, this->Program);
     }
 
-    void use() const { glUseProgram(Program); }
+    void use() const { GLStateCache::useProgram(Program); }
 
     GLint getUniformLocation(const char* name) const
     { return glGetUniformLocation(Program, name); }
@@ -80,6 +89,16 @@ class Shader {
           glGetUniformLocation(Program, name), 1, (const GLfloat*)&vec);
     }
 
+    void setVec2(const char* name, const glm::vec2& vec) const {
+      glUniform2fv(
+          glGetUniformLocation(Program, name), 1, (const GLfloat*)&vec);
+    }
+
+    // also used for bool uniforms
+    void setInt(const char* name, int v) const {
+      glUniform1i(glGetUniformLocation(Program, name), v);
+    }
+
   protected:
     GLuint Program;
 };
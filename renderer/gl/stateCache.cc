@@ -0,0 +1,175 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: stateCache.cc
+
+#include "stateCache.hh"
+
+#include <algorithm>
+#include <iterator>
+
+using namespace std;
+
+namespace render {
+
+namespace {
+
+enum Call {
+  USE_PROGRAM = 0,
+  BIND_VERTEX_ARRAY,
+  ACTIVE_TEXTURE,
+  BIND_TEXTURE,
+  ENABLE,
+  BLEND_FUNC,
+  NR_CALL
+};
+
+const char* CALL_NAMES[NR_CALL] = {
+  "useProgram", "bindVertexArray", "activeTexture", "bindTexture", "enable", "blendFunc"};
+
+// a value GL never uses for the cached state
+const GLuint UNKNOWN = ~0u;
+// texture units and targets whose bindings are cached
+const int NR_UNIT = 16;
+const GLenum TARGETS[] = {GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BUFFER};
+const int NR_TARGET = sizeof(TARGETS) / sizeof(TARGETS[0]);
+
+struct State {
+  GLuint program, vao, active_unit;
+  GLuint textures[NR_UNIT][NR_TARGET];
+  map<GLenum, bool> enabled;
+  GLenum blend_src, blend_dst;
+
+  long long issued[NR_CALL] = {}, elided[NR_CALL] = {};
+
+  State() { reset(); }
+
+  void reset() {
+    program = vao = active_unit = UNKNOWN;
+    for (auto& unit : textures)
+      fill(begin(unit), end(unit), UNKNOWN);
+    enabled.clear();
+    blend_src = blend_dst = UNKNOWN;
+  }
+
+  // Count the call, and returns whether it has to be issued.
+  bool update(Call call, GLuint& cached, GLuint value) {
+    if (cached == value) {
+      elided[call]++;
+      return false;
+    }
+    issued[call]++;
+    cached = value;
+    return true;
+  }
+};
+
+State& state() {
+  static thread_local State s;
+  return s;
+}
+
+int target_index(GLenum target) {
+  for (int i = 0; i < NR_TARGET; ++i)
+    if (TARGETS[i] == target)
+      return i;
+  return -1;
+}
+
+} // namespace
+
+void GLStateCache::useProgram(GLuint program) {
+  if (state().update(USE_PROGRAM, state().program, program))
+    glUseProgram(program);
+}
+
+void GLStateCache::bindVertexArray(GLuint vao) {
+  if (state().update(BIND_VERTEX_ARRAY, state().vao, vao))
+    glBindVertexArray(vao);
+}
+
+void GLStateCache::activeTexture(GLenum unit) {
+  if (state().update(ACTIVE_TEXTURE, state().active_unit, unit))
+    glActiveTexture(unit);
+}
+
+void GLStateCache::bindTexture(GLenum target, GLuint texture) {
+  State& s = state();
+  int unit = s.active_unit - GL_TEXTURE0, t = target_index(target);
+  if (s.active_unit == UNKNOWN || unit >= NR_UNIT || t < 0) {
+    s.issued[BIND_TEXTURE]++;
+    glBindTexture(target, texture);
+    return;
+  }
+  if (s.update(BIND_TEXTURE, s.textures[unit][t], texture))
+    glBindTexture(target, texture);
+}
+
+void GLStateCache::setEnabled(GLenum cap, bool enabled) {
+  State& s = state();
+  auto itr = s.enabled.find(cap);
+  if (itr != s.enabled.end() && itr->second == enabled) {
+    s.elided[ENABLE]++;
+    return;
+  }
+  s.issued[ENABLE]++;
+  s.enabled[cap] = enabled;
+  if (enabled)
+    glEnable(cap);
+  else
+    glDisable(cap);
+}
+
+bool GLStateCache::isEnabled(GLenum cap) {
+  State& s = state();
+  auto itr = s.enabled.find(cap);
+  if (itr != s.enabled.end())
+    return itr->second;
+  bool enabled = glIsEnabled(cap);
+  s.enabled[cap] = enabled;
+  return enabled;
+}
+
+void GLStateCache::blendFunc(GLenum sfactor, GLenum dfactor) {
+  State& s = state();
+  if (s.blend_src == sfactor && s.blend_dst == dfactor) {
+    s.elided[BLEND_FUNC]++;
+    return;
+  }
+  s.issued[BLEND_FUNC]++;
+  s.blend_src = sfactor;
+  s.blend_dst = dfactor;
+  glBlendFunc(sfactor, dfactor);
+}
+
+void GLStateCache::deleteTexture(GLuint texture) {
+  for (auto& unit : state().textures)
+    for (auto& t : unit)
+      if (t == texture)
+        t = 0;
+  glDeleteTextures(1, &texture);
+}
+
+void GLStateCache::deleteVertexArray(GLuint vao) {
+  if (state().vao == vao)
+    state().vao = 0;
+  glDeleteVertexArrays(1, &vao);
+}
+
+void GLStateCache::invalidate() {
+  state().reset();
+}
+
+map<string, map<string, double>> GLStateCache::summary() {
+  map<string, map<string, double>> ret;
+  const State& s = state();
+  for (int i = 0; i < NR_CALL; ++i) {
+    ret[CALL_NAMES[i]]["issued"] = s.issued[i];
+    ret[CALL_NAMES[i]]["elided"] = s.elided[i];
+  }
+  return ret;
+}
+
+} // namespace render
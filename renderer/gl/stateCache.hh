@@ -0,0 +1,54 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: stateCache.hh
+
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "api.hh"
+
+namespace render {
+
+// A cache of the GL state set by the renderer: current program, vertex
+// array, active texture unit, textures bound to each unit, enabled
+// capabilities and blend function. Calls that would not change the state
+// are skipped.
+//
+// The cache is only valid if every change of this state goes through it, and
+// deleted objects are reported. GL state belongs to the context current in a
+// thread, so the cache is per thread, and invalidated when a context is made
+// current.
+class GLStateCache {
+  public:
+    static void useProgram(GLuint program);
+    static void bindVertexArray(GLuint vao);
+    // unit: GL_TEXTURE0 + i
+    static void activeTexture(GLenum unit);
+    // Bind to the active texture unit.
+    static void bindTexture(GLenum target, GLuint texture);
+    static void enable(GLenum cap) { setEnabled(cap, true); }
+    static void disable(GLenum cap) { setEnabled(cap, false); }
+    static void setEnabled(GLenum cap, bool enabled);
+    // Queries GL only the first time.
+    static bool isEnabled(GLenum cap);
+    static void blendFunc(GLenum sfactor, GLenum dfactor);
+
+    // Delete an object, which GL also unbinds.
+    static void deleteTexture(GLuint texture);
+    static void deleteVertexArray(GLuint vao);
+
+    // Forget the cached state, e.g. after making another context current.
+    static void invalidate();
+
+    // Number of calls issued to GL and elided, since the thread started:
+    // {call: {"issued", "elided"}}, where call is one of "useProgram",
+    // "bindVertexArray", "activeTexture", "bindTexture", "enable" and "blendFunc".
+    static std::map<std::string, std::map<std::string, double>> summary();
+};
+
+} // namespace render
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "api.hh"
+#include "stateCache.hh"
 #include <glm/vec3.hpp>
 #include <string>
 #include <iostream>
@@ -16,23 +17,24 @@
 #include "lib/strutils.hh"
 namespace render {
 
-inline void glCheckError(std::string msg) {
+// Takes a C string, which costs no allocation in the draw loop.
+inline void glCheckError(const char* msg) {
   GLenum e = glGetError();
   if (e != GL_NO_ERROR) {
     error_exit(ssprintf(
-        "OpenGL error in \"%s\": %d (%d)\n", msg.c_str(), e, e));
+        "OpenGL error in \"%s\": %d (%d)\n", msg, e, e));
   }
 }
 
+// Bind through GLStateCache. The binding is left in place at the end of the
+// scope, so that drawing with the same object again doesn't rebind it.
 struct VertexArrayGuard {
-  VertexArrayGuard(GLuint vao) { glBindVertexArray(vao); }
-  ~VertexArrayGuard() { glBindVertexArray(0); }
+  VertexArrayGuard(GLuint vao) { GLStateCache::bindVertexArray(vao); }
 };
 
 struct TextureGuard {
   TextureGuard(GLuint tid)
-  { glBindTexture(GL_TEXTURE_2D, tid); }
-  ~TextureGuard() { glBindTexture(GL_TEXTURE_2D, 0); }
+  { GLStateCache::bindTexture(GL_TEXTURE_2D, tid); }
 };
 
 
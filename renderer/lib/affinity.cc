@@ -0,0 +1,293 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: affinity.cc
+
+#include "affinity.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "debugutils.hh"
+#include "strutils.hh"
+
+using namespace std;
+
+namespace {
+
+// The first line of a file, or "" if it cannot be read.
+string read_line(const string& fname) {
+  ifstream fin{fname};
+  string line;
+  getline(fin, line);
+  return line;
+}
+
+#ifdef __linux__
+bool exists(const string& path) {
+  return access(path.c_str(), F_OK) == 0;
+}
+
+vector<int> cpus_of_node(int node) {
+  string list = read_line(ssprintf("/sys/devices/system/node/node%d/cpulist", node));
+  if (list.empty())
+    return {};
+  return parse_cpulist(list);
+}
+
+vector<int> allowed_cpus() {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  vector<int> ret;
+  if (sched_getaffinity(0, sizeof(set), &set) != 0)
+    return ret;
+  for (int i = 0; i < CPU_SETSIZE; ++i)
+    if (CPU_ISSET(i, &set))
+      ret.push_back(i);
+  return ret;
+}
+
+bool pin_thread(const vector<int>& cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int c : cpus)
+    CPU_SET(c, &set);
+  // 0 is the calling thread
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+// Prefer allocating the memory of the calling thread on `node`, without
+// depending on libnuma.
+bool prefer_memory_node(int node) {
+  const int MPOL_PREFERRED = 1;
+  const int MAX_NODE = 1024;
+  unsigned long mask[MAX_NODE / (8 * sizeof(unsigned long))] = {0};
+  if (node < 0 || node >= MAX_NODE)
+    return false;
+  mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+  return syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, MAX_NODE + 1) == 0;
+}
+#endif
+
+} // namespace
+
+string Placement::str() const {
+  if (cpus.empty())
+    return ssprintf("not pinned (%s)", reason.c_str());
+  string mem = numa_node >= 0 ? ssprintf("memory on NUMA node %d", numa_node) : "memory not bound";
+  return ssprintf("cpus %s, %s (%s)", format_cpulist(cpus).c_str(), mem.c_str(), reason.c_str());
+}
+
+vector<int> parse_cpulist(const string& s) {
+  // a bitmap, so that repeated ranges do not allocate more
+  vector<bool> in_list;
+  for (auto range : strsplit(s, ",")) {
+    // e.g. the newline at the end of sysfs files
+    size_t begin = range.find_first_not_of(" \t\n"), end = range.find_last_not_of(" \t\n");
+    if (begin == string::npos)
+      continue;
+    range = range.substr(begin, end + 1 - begin);
+    size_t pos;
+    int lo, hi;
+    try {
+      lo = stoi(range, &pos);
+      hi = lo;
+      if (pos < range.size()) {
+        if (range[pos] != '-')
+          throw invalid_argument(range);
+        size_t pos2;
+        hi = stoi(range.substr(pos + 1), &pos2);
+        if (pos + 1 + pos2 != range.size())
+          throw invalid_argument(range);
+      }
+    } catch (const logic_error&) {
+      throw runtime_error(ssprintf("Invalid cpu list '%s'", s.c_str()));
+    }
+    if (lo < 0 || hi < lo || hi >= MAX_CPU)
+      throw runtime_error(ssprintf("Invalid cpu list '%s'", s.c_str()));
+    if ((int)in_list.size() <= hi)
+      in_list.resize(hi + 1);
+    fill(in_list.begin() + lo, in_list.begin() + hi + 1, true);
+  }
+  vector<int> ret;
+  for (size_t i = 0; i < in_list.size(); ++i)
+    if (in_list[i])
+      ret.push_back(i);
+  return ret;
+}
+
+string format_cpulist(const vector<int>& cpus) {
+  string ret;
+  for (size_t i = 0; i < cpus.size(); ) {
+    size_t j = i;
+    while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+      j++;
+    if (!ret.empty())
+      ret += ",";
+    ret += j == i ? ssprintf("%d", cpus[i]) : ssprintf("%d-%d", cpus[i], cpus[j]);
+    i = j + 1;
+  }
+  return ret;
+}
+
+int num_numa_nodes() {
+  string list = read_line("/sys/devices/system/node/has_cpu");
+  if (list.empty())
+    return 1;
+  try {
+    return max<int>(parse_cpulist(list).size(), 1);
+  } catch (const runtime_error&) {
+    return 1;
+  }
+}
+
+int numa_node_of_device(const string& sysfs_dir) {
+  string node = read_line(sysfs_dir + "/numa_node");
+  if (node.empty())
+    return -1;
+  // the kernel reports -1 if the platform does not tell
+  return max(atoi(node.c_str()), -1);
+}
+
+string sysfs_dir_of_device_file(const string& dev_file) {
+#ifdef __linux__
+  const string dri = "/dev/dri/", nvidia = "/dev/nvidia";
+  if (dev_file.compare(0, dri.size(), dri) == 0) {
+    string dir = "/sys/class/drm/" + dev_file.substr(dri.size()) + "/device";
+    return exists(dir) ? dir : "";
+  }
+  if (dev_file.compare(0, nvidia.size(), nvidia) == 0) {
+    // the nvidia driver lists its GPUs by PCI bus id, with their minor number
+    string minor = dev_file.substr(nvidia.size());
+    const string gpus = "/proc/driver/nvidia/gpus/";
+    DIR* dir = opendir(gpus.c_str());
+    if (!dir)
+      return "";
+    string ret;
+    while (dirent* ent = readdir(dir)) {
+      string bus_id = ent->d_name;
+      if (bus_id[0] == '.')
+        continue;
+      ifstream fin{gpus + bus_id + "/information"};
+      string line;
+      while (getline(fin, line)) {
+        auto fields = strsplit(line, ":");
+        if (fields.size() == 2 && fields[0] == "Device Minor") {
+          istringstream ss{fields[1]};
+          string value;
+          ss >> value;
+          if (value == minor)
+            ret = "/sys/bus/pci/devices/" + bus_id;
+        }
+      }
+    }
+    closedir(dir);
+    return exists(ret) ? ret : "";
+  }
+#endif
+  return "";
+}
+
+namespace {
+
+thread_local bool placement_allowed = false;
+// the result of the first place_thread() in this thread
+thread_local Placement placed_thread;
+
+Placement place_thread_once(const string& sysfs_dir) {
+  Placement p;
+#ifdef __linux__
+  const char* env = getenv("HOUSE3D_CPU_AFFINITY");
+  string spec = env ? env : "";
+  int node = -1;
+  vector<int> cpus;
+  if (spec == "none") {
+    p.reason = "disabled by HOUSE3D_CPU_AFFINITY";
+    return p;
+  } else if (!spec.empty()) {
+    p.reason = "HOUSE3D_CPU_AFFINITY=" + spec;
+    try {
+      if (spec.compare(0, 5, "node:") == 0) {
+        node = stoi(spec.substr(5));
+        cpus = cpus_of_node(node);
+      } else {
+        cpus = parse_cpulist(spec);
+      }
+    } catch (const exception&) {
+      p.reason = "invalid " + p.reason;
+      print_debug("Ignore invalid HOUSE3D_CPU_AFFINITY=%s\n", spec.c_str());
+      return p;
+    }
+  } else {
+    if (!placement_allowed) {
+      p.reason = "not a thread of the renderer";
+      return p;
+    }
+    if (sysfs_dir.empty()) {
+      p.reason = "unknown device";
+      return p;
+    }
+    if (num_numa_nodes() <= 1) {
+      p.reason = "single NUMA node";
+      return p;
+    }
+    node = numa_node_of_device(sysfs_dir);
+    if (node < 0) {
+      p.reason = "unknown NUMA node of " + sysfs_dir;
+      return p;
+    }
+    p.reason = "local to " + sysfs_dir;
+    try {
+      cpus = cpus_of_node(node);
+    } catch (const exception&) {
+      p.reason += ", invalid cpu list of NUMA node " + to_string(node);
+      return p;
+    }
+  }
+
+  vector<int> allowed = allowed_cpus(), usable;
+  set_intersection(cpus.begin(), cpus.end(), allowed.begin(), allowed.end(),
+      back_inserter(usable));
+  if (usable.empty()) {
+    p.reason += ", no allowed cpu";
+    return p;
+  }
+  if (!pin_thread(usable)) {
+    p.reason += ", sched_setaffinity failed";
+    return p;
+  }
+  p.cpus = usable;
+  if (node >= 0 && prefer_memory_node(node))
+    p.numa_node = node;
+#else
+  (void)sysfs_dir;
+  p.reason = "not supported on this platform";
+#endif
+  return p;
+}
+
+} // namespace
+
+void allow_thread_placement() {
+  placement_allowed = true;
+}
+
+Placement place_thread(const string& sysfs_dir) {
+  if (!placed_thread.reason.empty())
+    return placed_thread;
+  placed_thread = place_thread_once(sysfs_dir);
+  return placed_thread;
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: affinity.hh
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Where a thread runs and allocates its memory.
+struct Placement {
+  int numa_node = -1;       // -1 if memory is not bound to a node
+  std::vector<int> cpus;    // empty if the thread is not pinned
+  std::string reason;       // how it was decided, or why it was not pinned
+
+  std::string str() const;
+};
+
+// Parse a Linux cpu list, e.g. "0-3,8,10-11". Whitespace around the items,
+// such as the trailing newline in sysfs, is ignored. Cpus are below MAX_CPU.
+// Throws std::runtime_error.
+const int MAX_CPU = 1 << 16;
+std::vector<int> parse_cpulist(const std::string& s);
+
+// Format a cpu list, e.g. {0, 1, 2, 3, 8} -> "0-3,8".
+std::string format_cpulist(const std::vector<int>& cpus);
+
+// The number of NUMA nodes with cpus, or 1 if unknown.
+int num_numa_nodes();
+
+// The NUMA node of a PCI device, given its directory in sysfs, e.g.
+// /sys/class/drm/card0/device. Returns -1 if unknown.
+int numa_node_of_device(const std::string& sysfs_dir);
+
+// The sysfs directory of the PCI device behind /dev/dri/cardN or
+// /dev/nvidiaN, or "" if not found.
+std::string sysfs_dir_of_device_file(const std::string& dev_file);
+
+// Let place_thread() pin the calling thread by default. Only for threads
+// owned by the renderer, e.g. of RenderAPIThread and the render server:
+// other threads, e.g. the Python thread of a RenderAPI, would pass their cpus
+// to all the threads they start later.
+void allow_thread_placement();
+
+// Pin the calling thread close to the device in `sysfs_dir` (may be empty),
+// and prefer allocating its memory on the same NUMA node. Nothing is changed
+// on single-node machines, if the node of the device is unknown, or if the
+// thread did not call allow_thread_placement(). A thread is placed once: the
+// later calls return the first placement.
+//
+// The environment variable HOUSE3D_CPU_AFFINITY overrides it, in any thread:
+//   "none": do not pin.
+//   "node:N": pin to the cpus and memory of NUMA node N.
+//   a cpu list, e.g. "0-7,16-23": pin to these cpus, memory is not bound.
+// Cpus not allowed for the process are ignored.
+Placement place_thread(const std::string& sysfs_dir);
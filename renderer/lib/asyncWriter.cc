@@ -0,0 +1,215 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: asyncWriter.cc
+
+#include "asyncWriter.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "imgproc.hh"
+#include "profiler.hh"
+#include "strutils.hh"
+#include "timer.hh"
+
+using namespace std;
+
+namespace {
+
+const char RAW_MAGIC[8] = "H3DFRM1";
+
+size_t file_size(const char* fname) {
+  struct stat st;
+  return stat(fname, &st) == 0 ? st.st_size : 0;
+}
+
+void append_le32(string& buf, uint32_t v) {
+  for (int i = 0; i < 4; ++i)
+    buf.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+} // namespace
+
+AsyncWriter::AsyncWriter(int nr_thread, int capacity, const string& raw_dir,
+    size_t shard_bytes):
+  raw_dir_{raw_dir}, shard_bytes_{shard_bytes}, capacity_(max(capacity, 1)),
+  shards_(max(nr_thread, 1)) {
+  if (!raw_dir_.empty() && mkdir(raw_dir_.c_str(), 0755) != 0 && errno != EEXIST)
+    throw runtime_error(ssprintf("Cannot create directory %s", raw_dir_.c_str()));
+  for (size_t i = 0; i < shards_.size(); ++i)
+    threads_.emplace_back([this, i]() { this->work_(i); });
+}
+
+AsyncWriter::~AsyncWriter() {
+  try {
+    flush();
+  } catch (const runtime_error& e) {
+    print_debug("AsyncWriter: %s\n", e.what());
+  }
+  {
+    lock_guard<mutex> lg(mutex_);
+    stopped_ = true;
+  }
+  not_empty_.notify_all();
+  for (auto& th : threads_)
+    th.join();
+  for (auto& shard : shards_)
+    if (shard.fp)
+      fclose(shard.fp);
+}
+
+void AsyncWriter::write(const string& fname, const Matuc& img, int level) {
+  push_(Job{false, fname, img, level});
+}
+
+void AsyncWriter::writeRaw(const string& key, const Matuc& img) {
+  if (raw_dir_.empty())
+    throw runtime_error("writeRaw() needs a raw_dir");
+  push_(Job{true, key, img, 0});
+}
+
+void AsyncWriter::push_(Job&& job) {
+  PROFILE_ZONE("AsyncWriter::write");
+  unique_lock<mutex> lk(mutex_);
+  if (jobs_.size() >= capacity_) {
+    Timer timer;
+    not_full_.wait(lk, [this]() { return jobs_.size() < capacity_; });
+    nr_blocked_++;
+    blocked_seconds_ += timer.duration();
+  }
+  jobs_.emplace_back(std::move(job));
+  max_queued_ = max(max_queued_, jobs_.size());
+  lk.unlock();
+  not_empty_.notify_one();
+}
+
+void AsyncWriter::flush() {
+  PROFILE_ZONE("AsyncWriter::flush");
+  unique_lock<mutex> lk(mutex_);
+  idle_.wait(lk, [this]() { return jobs_.empty() && nr_busy_ == 0; });
+  // no job runs while the lock is held, so the shards are not in use
+  for (auto& shard : shards_)
+    if (shard.fp && fflush(shard.fp) != 0 && error_.empty())
+      error_ = ssprintf("Failed to flush shard %d", shard.index);
+  if (!error_.empty()) {
+    string err;
+    swap(err, error_);
+    throw runtime_error(err);
+  }
+}
+
+map<string, double> AsyncWriter::stats() const {
+  lock_guard<mutex> lg(mutex_);
+  return {
+    {"queued", (double)jobs_.size()},
+    {"max_queued", (double)max_queued_},
+    {"written", (double)nr_written_},
+    {"failed", (double)nr_failed_},
+    {"bytes", (double)bytes_},
+    {"blocked", (double)nr_blocked_},
+    {"blocked_seconds", blocked_seconds_},
+    {"encode_seconds", encode_seconds_},
+  };
+}
+
+void AsyncWriter::work_(int worker) {
+  Profiler::set_thread_name(ssprintf("AsyncWriter-%d", worker));
+  unique_lock<mutex> lk(mutex_);
+  while (true) {
+    not_empty_.wait(lk, [this]() { return stopped_ || !jobs_.empty(); });
+    if (jobs_.empty())
+      return;   // stopped
+    size_t bytes = 0;
+    double seconds;
+    string err;
+    {
+      Job job = std::move(jobs_.front());
+      jobs_.pop_front();
+      nr_busy_++;
+      lk.unlock();
+      not_full_.notify_one();
+
+      Timer timer;
+      try {
+        PROFILE_ZONE("AsyncWriter::encode");
+        if (job.raw) {
+          bytes = writeRaw_(job, worker);
+        } else {
+          write_image(job.name.c_str(), job.img, job.level);
+          bytes = file_size(job.name.c_str());
+        }
+      } catch (const runtime_error& e) {
+        err = e.what();
+      }
+      seconds = timer.duration();
+    } // the buffer is released before taking the lock
+
+    lk.lock();
+    nr_busy_--;
+    encode_seconds_ += seconds;
+    if (err.empty()) {
+      nr_written_++;
+      bytes_ += bytes;
+    } else {
+      nr_failed_++;
+      if (error_.empty())
+        error_ = err;
+    }
+    if (jobs_.empty() && nr_busy_ == 0)
+      idle_.notify_all();
+  }
+}
+
+size_t AsyncWriter::writeRaw_(const Job& job, int worker) {
+  Shard& shard = shards_[worker];
+  if (shard.fp && shard.bytes >= shard_bytes_) {
+    fclose(shard.fp);
+    shard.fp = nullptr;
+    shard.index++;
+  }
+  if (!shard.fp) {
+    shard.fname = ssprintf("%s/frames-%d-%d.bin", raw_dir_.c_str(), worker, shard.index);
+    shard.fp = fopen(shard.fname.c_str(), "wb");
+    if (!shard.fp)
+      throw runtime_error(ssprintf("Cannot open %s for writing", shard.fname.c_str()));
+    shard.bytes = 0;
+    if (fwrite(RAW_MAGIC, sizeof(RAW_MAGIC), 1, shard.fp) == 1)
+      shard.bytes = sizeof(RAW_MAGIC);
+  }
+  const Matuc& img = job.img;
+  string header;
+  append_le32(header, job.name.size());
+  header.append(job.name);
+  append_le32(header, img.rows());
+  append_le32(header, img.cols());
+  append_le32(header, img.channels());
+  bool ok = shard.bytes > 0 &&
+    fwrite(header.data(), 1, header.size(), shard.fp) == header.size() &&
+    fwrite(img.ptr(), 1, img.elements(), shard.fp) == (size_t)img.elements() &&
+    // a frame is much larger than the stdio buffer: flushing the rest costs
+    // little, and catches the errors of this record here
+    fflush(shard.fp) == 0;
+  if (!ok) {
+    // Cut the partial record, so that the shard stays readable, and
+    // continue in a new shard. A shard without its magic is removed.
+    fclose(shard.fp);
+    shard.fp = nullptr;
+    bool cut = shard.bytes > 0 ?
+      truncate(shard.fname.c_str(), shard.bytes) == 0 :
+      unlink(shard.fname.c_str()) == 0;
+    shard.index++;
+    throw runtime_error(ssprintf("Failed to write frame %s to shard %d-%d%s",
+          job.name.c_str(), worker, shard.index - 1,
+          cut ? "" : ", and cannot remove the partial record"));
+  }
+  size_t bytes = header.size() + img.elements();
+  shard.bytes += bytes;
+  return bytes;
+}
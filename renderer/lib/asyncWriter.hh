@@ -0,0 +1,102 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: asyncWriter.hh
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mat.h"
+
+// Write frames to disk in a pool of threads, so that the render loop does not
+// wait for encoding.
+//
+// Frames are queued by reference: the writer shares the buffer of the Mat,
+// which must not be modified until the frame is written. Renders return a new
+// buffer every frame, so they can be queued directly. When `capacity` frames
+// are queued, write() blocks until a thread takes one.
+//
+// Raw frames are appended to shard files in `raw_dir`, one sequence of shards
+// per thread, named frames-<thread>-<index>.bin. A shard starts with the 8
+// bytes "H3DFRM1\0", followed by records of:
+//   uint32 key length, the key, int32 rows, cols, channels, then the pixels.
+// Integers are little-endian. A new shard is started after `shard_bytes`, and
+// after a failed write, whose partial record is truncated away.
+// Existing shards in `raw_dir` are overwritten, so use one directory per writer.
+// House3D/frames.py reads them back.
+class AsyncWriter {
+  public:
+    AsyncWriter(int nr_thread, int capacity, const std::string& raw_dir = "",
+        size_t shard_bytes = size_t(1) << 30);
+
+    // Waits for the queued frames. Errors are printed.
+    ~AsyncWriter();
+
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator = (const AsyncWriter&) = delete;
+
+    // Queue a png or jpeg file. See write_image() for `level`.
+    void write(const std::string& fname, const Matuc& img, int level = -1);
+
+    // Queue a raw frame into the shards.
+    void writeRaw(const std::string& key, const Matuc& img);
+
+    // Wait until all queued frames are written and the shards are flushed.
+    // Throws std::runtime_error with the first error since the last flush,
+    // if any frame failed.
+    void flush();
+
+    // queued, max_queued, written, failed, bytes: output size,
+    // blocked: number of writes that waited for a free slot,
+    // blocked_seconds: the total time they waited,
+    // encode_seconds: the total time of the threads on encoding and writing.
+    std::map<std::string, double> stats() const;
+
+  private:
+    struct Job {
+      bool raw;
+      std::string name;
+      Matuc img;
+      int level;
+    };
+
+    struct Shard {
+      FILE* fp = nullptr;
+      std::string fname;
+      int index = 0;
+      size_t bytes = 0;   // up to the end of the last complete record
+    };
+
+    void push_(Job&& job);
+    void work_(int worker);
+    // Returns the number of bytes written.
+    size_t writeRaw_(const Job& job, int worker);
+
+    std::string raw_dir_;
+    size_t shard_bytes_;
+    size_t capacity_;
+    std::vector<Shard> shards_;   // by worker
+    std::vector<std::thread> threads_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable not_empty_, not_full_, idle_;
+    std::deque<Job> jobs_;
+    int nr_busy_ = 0;
+    bool stopped_ = false;
+
+    // stats, guarded by mutex_
+    size_t max_queued_ = 0;
+    long long nr_written_ = 0, nr_failed_ = 0, nr_blocked_ = 0, bytes_ = 0;
+    double blocked_seconds_ = 0, encode_seconds_ = 0;
+    std::string error_;     // the first error since the last flush()
+};
@@ -0,0 +1,177 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: bufferPool.cc
+
+#include "bufferPool.hh"
+
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const size_t MIN_SIZE = 64;
+// larger buffers are not pooled
+const size_t MAX_POOLED_SIZE = size_t(1) << 30;
+// size_class(MAX_POOLED_SIZE) is 96
+const int NR_CLASS = 97;
+// number of released buffers of each class cached by a thread
+const int NR_LOCAL_SLOT = 4;
+
+// Class 0 is [0, 64]. Above, each power of two (2^k, 2^(k+1)] is split
+// into 4 classes of size 2^k + j * 2^(k-2), j = 1..4.
+int size_class(size_t bytes) {
+  if (bytes <= MIN_SIZE)
+    return 0;
+  int k = 63 - __builtin_clzll(bytes - 1);
+  size_t step = size_t(1) << (k - 2);
+  int j = (bytes - 1 - (size_t(1) << k)) / step + 1;
+  return (k - 6) * 4 + j;
+}
+
+size_t class_size(int c) {
+  if (c == 0)
+    return MIN_SIZE;
+  int k = (c - 1) / 4 + 6, j = (c - 1) % 4 + 1;
+  return (size_t(1) << k) + j * (size_t(1) << (k - 2));
+}
+
+atomic<long long> nr_allocate{0}, nr_system{0}, pooled_bytes{0};
+
+void* system_allocate(size_t bytes) {
+  nr_system++;
+  void* ptr = nullptr;
+  if (posix_memalign(&ptr, BufferPool::ALIGNMENT, bytes) != 0)
+    throw bad_alloc();
+  return ptr;
+}
+
+struct Global {
+  mutex mtx;
+  vector<void*> free[NR_CLASS];
+  size_t bytes = 0, limit = size_t(512) << 20;
+};
+
+// Never destroyed, because buffers may be released during static destruction.
+Global& global() {
+  static Global* g = new Global;
+  return *g;
+}
+
+// Returns false if the global free list is full.
+bool release_to_global(void* ptr, int c) {
+  Global& g = global();
+  size_t size = class_size(c);
+  lock_guard<mutex> lg(g.mtx);
+  if (g.bytes + size > g.limit)
+    return false;
+  g.free[c].push_back(ptr);
+  g.bytes += size;
+  pooled_bytes += size;
+  return true;
+}
+
+void* allocate_from_global(int c) {
+  Global& g = global();
+  lock_guard<mutex> lg(g.mtx);
+  if (g.free[c].empty())
+    return nullptr;
+  void* ret = g.free[c].back();
+  g.free[c].pop_back();
+  g.bytes -= class_size(c);
+  pooled_bytes -= class_size(c);
+  return ret;
+}
+
+thread_local bool local_destroyed = false;
+
+struct LocalCache {
+  void* slots[NR_CLASS][NR_LOCAL_SLOT];
+  int count[NR_CLASS] = {};
+
+  ~LocalCache() {
+    local_destroyed = true;
+    for (int c = 0; c < NR_CLASS; ++c)
+      for (int i = 0; i < count[c]; ++i) {
+        pooled_bytes -= class_size(c);
+        if (!release_to_global(slots[c][i], c))
+          free(slots[c][i]);
+      }
+  }
+};
+
+// Null after the cache of this thread is destroyed, at thread exit.
+LocalCache* local() {
+  if (local_destroyed)
+    return nullptr;
+  static thread_local LocalCache cache;
+  return &cache;
+}
+
+} // namespace
+
+void* BufferPool::allocate(size_t bytes) {
+  nr_allocate++;
+  if (bytes > MAX_POOLED_SIZE)
+    return system_allocate(bytes);
+  int c = size_class(bytes);
+  LocalCache* cache = local();
+  if (cache && cache->count[c] > 0) {
+    pooled_bytes -= class_size(c);
+    return cache->slots[c][--cache->count[c]];
+  }
+  void* ret = allocate_from_global(c);
+  return ret ? ret : system_allocate(class_size(c));
+}
+
+void BufferPool::release(void* ptr, size_t bytes) {
+  if (!ptr)
+    return;
+  if (bytes > MAX_POOLED_SIZE) {
+    free(ptr);
+    return;
+  }
+  int c = size_class(bytes);
+  LocalCache* cache = local();
+  if (cache && cache->count[c] < NR_LOCAL_SLOT) {
+    cache->slots[c][cache->count[c]++] = ptr;
+    pooled_bytes += class_size(c);
+    return;
+  }
+  if (!release_to_global(ptr, c))
+    free(ptr);
+}
+
+void BufferPool::set_limit(size_t bytes) {
+  bool over;
+  {
+    lock_guard<mutex> lg(global().mtx);
+    global().limit = bytes;
+    over = global().bytes > bytes;
+  }
+  if (over)
+    trim();
+}
+
+void BufferPool::trim() {
+  Global& g = global();
+  lock_guard<mutex> lg(g.mtx);
+  for (int c = 0; c < NR_CLASS; ++c) {
+    for (void* ptr : g.free[c])
+      free(ptr);
+    pooled_bytes -= g.free[c].size() * class_size(c);
+    g.free[c].clear();
+  }
+  g.bytes = 0;
+}
+
+BufferPool::Stats BufferPool::stats() {
+  return Stats{nr_allocate, nr_system, pooled_bytes};
+}
@@ -0,0 +1,70 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: bufferPool.hh
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+// A pool of 64-byte aligned buffers, so that rendering frames of the same
+// size reuses memory instead of allocating it.
+//
+// Sizes are rounded up to size classes, 4 per power of two. Each thread
+// caches a few released buffers of each class; other released buffers go to
+// a global free list, up to a limit. Buffers can be released by any thread.
+class BufferPool {
+  public:
+    static const size_t ALIGNMENT = 64;
+
+    static void* allocate(size_t bytes);
+    // `bytes` has to be the size given to allocate().
+    static void release(void* ptr, size_t bytes);
+
+    // Max total size of the buffers kept in the global free list.
+    // Defaults to 512MB.
+    static void set_limit(size_t bytes);
+
+    // Return the buffers in the global free list to the system.
+    static void trim();
+
+    struct Stats {
+      long long nr_allocate;      // calls to allocate()
+      long long nr_system;        // allocate() calls served by the system
+      long long pooled_bytes;     // bytes of released buffers kept for reuse
+    };
+    static Stats stats();
+};
+
+// An allocator for standard containers and std::allocate_shared.
+template <typename T>
+struct PoolAllocator {
+  using value_type = T;
+
+  PoolAllocator() {}
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>&) {}
+
+  T* allocate(size_t n)
+  { return static_cast<T*>(BufferPool::allocate(n * sizeof(T))); }
+  void deallocate(T* p, size_t n)
+  { BufferPool::release(p, n * sizeof(T)); }
+};
+
+template <typename T, typename U>
+bool operator == (const PoolAllocator<T>&, const PoolAllocator<U>&) { return true; }
+template <typename T, typename U>
+bool operator != (const PoolAllocator<T>&, const PoolAllocator<U>&) { return false; }
+
+// An uninitialized array of n trivial objects from the pool, returned to the
+// pool when the last reference is dropped. The reference count is pooled as well.
+template <typename T>
+std::shared_ptr<T> make_pooled_array(size_t n) {
+  size_t bytes = n * sizeof(T);
+  T* ptr = static_cast<T*>(BufferPool::allocate(bytes));
+  return std::shared_ptr<T>(ptr,
+      [bytes](T* p) { BufferPool::release(p, bytes); }, PoolAllocator<T>());
+}
@@ -14,6 +14,7 @@
 #include <thread>
 #include <iostream>
 #include "lib/debugutils.hh"
+#include "lib/profiler.hh"
 
 
 namespace render {
@@ -31,6 +32,7 @@ class ExecutorInThread {
     // Run job in the dedicated thread and return the result.
     template <typename T>
     T execute_sync(std::function<T()>&& job) {
+      PROFILE_ZONE("ExecutorInThread::execute_sync");
       std::packaged_task<T()> task(job);
       auto res = task.get_future();
       execute_async([&task]() { task(); });
@@ -39,10 +41,11 @@ class ExecutorInThread {
     }
 
     void execute_sync(std::function<void()>&& job) {
+      PROFILE_ZONE("ExecutorInThread::execute_sync");
       std::packaged_task<void()> task(job);
       auto res = task.get_future();
       execute_async([&task]() { task(); });
-      res.wait();
+      res.get();  // rethrows an exception of the job
     }
 
     // push job to the queue for future execution in the dedicated thread
@@ -53,6 +56,7 @@ class ExecutorInThread {
     }
 
     void work() {
+      Profiler::set_thread_name("ExecutorInThread");
       std::unique_lock<std::mutex> lk(mutex_, std::defer_lock);
       while (!stopped.load()) {
         lk.lock();
@@ -61,7 +65,10 @@ class ExecutorInThread {
           auto job = jobs_.front();
           jobs_.pop();
           lk.unlock();
-          job();
+          {
+            PROFILE_ZONE("ExecutorInThread::job");
+            job();
+          }
           //print_debug("Finsih Run Job\n");
         } else {  // just wait on cv
           //print_debug("Empty, watiing\n");
@@ -0,0 +1,54 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: framestack.cc
+
+#include "framestack.hh"
+
+#include <cstring>
+
+#include "debugutils.hh"
+#include "utils.hh"
+
+FrameStack::FrameStack(int k, int rows, int cols, int channels):
+  k_{k}, rows_{rows}, cols_{cols}, channels_{channels} {
+    m_assert(k > 0 && rows > 0 && cols > 0 && channels > 0);
+    buf_ = create_auto_buf<unsigned char>(
+        (size_t)2 * k_ * frame_elements(), true);
+}
+
+Matuc FrameStack::next_frame() {
+  // aliasing constructor: share the ownership of the whole buffer
+  std::shared_ptr<unsigned char> ptr{buf_, slot(head_)};
+  return Matuc{rows_, cols_, channels_, std::move(ptr)};
+}
+
+void FrameStack::commit() {
+  size_t len = frame_elements();
+  unsigned char* src = slot(head_);
+  if (empty_) {
+    // replicate the first frame of an episode to the whole history
+    for (int i = 0; i < 2 * k_; ++i)
+      if (i != head_)
+        memcpy(slot(i), src, len);
+    empty_ = false;
+  } else {
+    memcpy(slot(head_ + k_), src, len);
+  }
+  head_ = (head_ + 1) % k_;
+}
+
+void FrameStack::push(const Matuc& frame) {
+  m_assert(frame.rows() == rows_ && frame.cols() == cols_ &&
+      frame.channels() == channels_);
+  memcpy(slot(head_), frame.ptr(), frame_elements());
+  commit();
+}
+
+void FrameStack::reset() {
+  head_ = 0;
+  empty_ = true;
+  memset(buf_.get(), 0, (size_t)2 * k_ * frame_elements());
+}
@@ -0,0 +1,66 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: framestack.hh
+
+#pragma once
+
+#include <memory>
+#include "mat.h"
+
+// A ring buffer of the K most recent frames, each of size h x w x c.
+//
+// The buffer holds 2K slots and every frame is written into both slot i and
+// slot i + K. Therefore the K most recent frames are always stored
+// contiguously (oldest first) starting at data(), and can be exposed without
+// any copy.
+class FrameStack {
+  public:
+    FrameStack(int k, int rows, int cols, int channels);
+
+    FrameStack(const FrameStack&) = delete;
+    FrameStack& operator = (const FrameStack&) = delete;
+
+    // A Mat pointing to the slot where the next frame should be written.
+    // Call commit() after writing to it.
+    // The slot may be part of the current window, so data() shouldn't be
+    // read between next_frame() and commit().
+    Matuc next_frame();
+
+    // Publish the frame written to next_frame().
+    void commit();
+
+    // Copy a frame into the stack. Same as writing to next_frame() then commit().
+    void push(const Matuc& frame);
+
+    // Start a new episode.
+    // The first frame pushed afterwards is used to fill all K slots.
+    void reset();
+
+    // The K most recent frames, from the oldest to the latest,
+    // as a contiguous K x h x w x c buffer.
+    // The pointer is invalidated by the next commit().
+    const unsigned char* data() const { return slot(head_); }
+
+    int size() const { return k_; }
+    int rows() const { return rows_; }
+    int cols() const { return cols_; }
+    int channels() const { return channels_; }
+    int frame_elements() const { return rows_ * cols_ * channels_; }
+
+    // Whether any frame was pushed since the last reset().
+    bool empty() const { return empty_; }
+
+  private:
+    int k_, rows_, cols_, channels_;
+    // the slot to write the next frame to, in [0, K).
+    // It is also the beginning of the current window.
+    int head_ = 0;
+    bool empty_ = true;
+    std::shared_ptr<unsigned char> buf_;
+
+    unsigned char* slot(int i) const
+    { return buf_.get() + i * frame_elements(); }
+};
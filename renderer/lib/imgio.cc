@@ -6,7 +6,12 @@
 //File: imgio.cc
 
 
+#include <cctype>
+#include <csetjmp>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <stdexcept>
 #include <vector>
 #define cimg_display 0
 
@@ -55,8 +60,171 @@ void write_rgb(const char* fname, const Mat32f& mat) {
 	img.save(fname);
 }
 
+namespace {
+
+// An image file, closed (and removed if incomplete) on destruction.
+class OutputFile {
+  public:
+    explicit OutputFile(const char* fname): fname_{fname} {
+      fp = fopen(fname, "wb");
+      if (!fp)
+        throw std::runtime_error(ssprintf("Cannot open %s for writing", fname));
+    }
+    ~OutputFile() {
+      fclose(fp);
+      if (!done)
+        remove(fname_);
+    }
+    FILE* fp;
+    bool done = false;
+  private:
+    const char* fname_;
+};
+
+struct JpegError {
+  jpeg_error_mgr mgr;
+  jmp_buf jmp;
+};
+
+void jpeg_error_exit(j_common_ptr cinfo) {
+  longjmp(reinterpret_cast<JpegError*>(cinfo->err)->jmp, 1);
+}
+
+bool has_suffix(const string& s, const char* suffix) {
+  size_t n = strlen(suffix);
+  if (s.size() < n)
+    return false;
+  for (size_t i = 0; i < n; ++i)
+    if (tolower(s[s.size() - n + i]) != suffix[i])
+      return false;
+  return true;
+}
+
+// Whether a png or jpeg file decodes to 4 channels with CImg, from its
+// header. -1 if it cannot be read.
+int png_has_alpha(FILE* fp) {
+	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+	png_infop info = png ? png_create_info_struct(png) : nullptr;
+	if (!info || setjmp(png_jmpbuf(png))) {
+		png_destroy_read_struct(&png, &info, nullptr);
+		return -1;
+	}
+	png_init_io(png, fp);
+	png_read_info(png, info);
+	// CImg expands a tRNS chunk to an alpha channel
+	int ret = (png_get_color_type(png, info) & PNG_COLOR_MASK_ALPHA) ||
+		png_get_valid(png, info, PNG_INFO_tRNS);
+	png_destroy_read_struct(&png, &info, nullptr);
+	return ret;
+}
+
+int jpeg_has_alpha(FILE* fp) {
+	jpeg_decompress_struct cinfo;
+	JpegError err;
+	cinfo.err = jpeg_std_error(&err.mgr);
+	err.mgr.error_exit = jpeg_error_exit;
+	jpeg_create_decompress(&cinfo);
+	if (setjmp(err.jmp)) {
+		jpeg_destroy_decompress(&cinfo);
+		return -1;
+	}
+	jpeg_stdio_src(&cinfo, fp);
+	jpeg_read_header(&cinfo, TRUE);
+	int ret = cinfo.num_components == 4;
+	jpeg_destroy_decompress(&cinfo);
+	return ret;
+}
+
+} // namespace
+
+void write_png(const char* fname, const Matuc& mat, int compression) {
+	m_assert(mat.channels() >= 1 && mat.channels() <= 4);
+	static const int color_types[] = {PNG_COLOR_TYPE_GRAY, PNG_COLOR_TYPE_GRAY_ALPHA,
+		PNG_COLOR_TYPE_RGB, PNG_COLOR_TYPE_RGB_ALPHA};
+	OutputFile out{fname};
+	png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+	png_infop info = png ? png_create_info_struct(png) : nullptr;
+	if (!info || setjmp(png_jmpbuf(png))) {
+		png_destroy_write_struct(&png, &info);
+		throw std::runtime_error(ssprintf("Failed to write %s", fname));
+	}
+	png_init_io(png, out.fp);
+	png_set_compression_level(png, compression);
+	png_set_IHDR(png, info, mat.cols(), mat.rows(), 8, color_types[mat.channels() - 1],
+			PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	png_write_info(png, info);
+	for (int i = 0; i < mat.rows(); ++i)
+		png_write_row(png, const_cast<unsigned char*>(mat.ptr(i)));
+	png_write_end(png, nullptr);
+	png_destroy_write_struct(&png, &info);
+	out.done = true;
+}
+
+void write_jpeg(const char* fname, const Matuc& mat, int quality) {
+	if (mat.channels() != 1 && mat.channels() != 3)
+		throw std::runtime_error(ssprintf(
+					"Cannot write a %d-channel image to %s", mat.channels(), fname));
+	OutputFile out{fname};
+	jpeg_compress_struct cinfo;
+	JpegError err;
+	cinfo.err = jpeg_std_error(&err.mgr);
+	err.mgr.error_exit = jpeg_error_exit;
+	if (setjmp(err.jmp)) {
+		jpeg_destroy_compress(&cinfo);
+		throw std::runtime_error(ssprintf("Failed to write %s", fname));
+	}
+	jpeg_create_compress(&cinfo);
+	jpeg_stdio_dest(&cinfo, out.fp);
+	cinfo.image_width = mat.cols();
+	cinfo.image_height = mat.rows();
+	cinfo.input_components = mat.channels();
+	cinfo.in_color_space = mat.channels() == 1 ? JCS_GRAYSCALE : JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, quality, TRUE);
+	jpeg_start_compress(&cinfo, TRUE);
+	while (cinfo.next_scanline < cinfo.image_height) {
+		JSAMPROW row = const_cast<unsigned char*>(mat.ptr(cinfo.next_scanline));
+		jpeg_write_scanlines(&cinfo, &row, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	out.done = true;
+}
+
+void write_image(const char* fname, const Matuc& mat, int level) {
+	string name{fname};
+	if (has_suffix(name, ".png"))
+		write_png(fname, mat, level < 0 ? 6 : level);
+	else if (has_suffix(name, ".jpg") || has_suffix(name, ".jpeg"))
+		write_jpeg(fname, mat, level < 0 ? 90 : level);
+	else
+		throw std::runtime_error(ssprintf("Unknown image format of %s", fname));
+}
+
+bool image_has_alpha(const char* fname) {
+	if (! exists_file(fname))
+		error_exit(ssprintf("File \"%s\" not exists!", fname));
+	string name{fname};
+	int ret = -1;
+	if (has_suffix(name, ".png") || has_suffix(name, ".jpg") || has_suffix(name, ".jpeg")) {
+		FILE* fp = fopen(fname, "rb");
+		if (fp) {
+			ret = has_suffix(name, ".png") ? png_has_alpha(fp) : jpeg_has_alpha(fp);
+			fclose(fp);
+		}
+	}
+	if (ret < 0)
+		return read_img(fname).channels() == 4;
+	return ret;
+}
+
 void write_rgb(const char* fname, const Matuc& mat) {
 	m_assert(mat.channels() == 3);
+	string name{fname};
+	if (has_suffix(name, ".png") || has_suffix(name, ".jpg") || has_suffix(name, ".jpeg")) {
+		write_image(fname, mat);
+		return;
+	}
 	CImg<unsigned char> img(mat.cols(), mat.rows(), 1, 3);
 	REP(i, mat.rows())
 		REP(j, mat.cols()) {
@@ -0,0 +1,496 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: imgkernels.cc
+
+#include "imgkernels.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HOUSE3D_X86_SIMD
+#include <immintrin.h>
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#include "debugutils.hh"
+#include "profiler.hh"
+
+using namespace std;
+
+namespace {
+
+using uchar = unsigned char;
+
+template <typename T>
+using PooledVector = vector<T, PoolAllocator<T>>;
+
+SimdLevel detect_simd_level() {
+#ifdef HOUSE3D_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return SimdLevel::AVX2;
+  if (__builtin_cpu_supports("ssse3"))
+    return SimdLevel::SSSE3;
+#endif
+  return SimdLevel::SCALAR;
+}
+
+SimdLevel env_simd_level(SimdLevel max_level) {
+  const char* env = getenv("HOUSE3D_SIMD");
+  if (!env || !*env)
+    return max_level;
+  SimdLevel level;
+  if (strcmp(env, "scalar") == 0)
+    level = SimdLevel::SCALAR;
+  else if (strcmp(env, "ssse3") == 0)
+    level = SimdLevel::SSSE3;
+  else if (strcmp(env, "avx2") == 0)
+    level = SimdLevel::AVX2;
+  else
+    error_exit("HOUSE3D_SIMD has to be one of scalar, ssse3, avx2\n");
+  return min(level, max_level);
+}
+
+// -1 until the first call of simd_level()
+atomic<int> current_level{-1};
+
+inline bool use(SimdLevel level) { return simd_level() >= level; }
+
+// ---------------------------------------------------------------------------
+// RGBA -> RGB
+
+void rgba_to_rgb_row(const uchar* src, uchar* dst, int w) {
+  for (int j = 0; j < w; ++j) {
+    dst[0] = src[0];
+    dst[1] = src[1];
+    dst[2] = src[2];
+    src += 4;
+    dst += 3;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// RGB -> grey
+
+// round((r + g + b) / 3), exact for all sums in [0, 765]
+inline uchar grey_value(int r, int g, int b) {
+  return ((r + g + b + 1) * 21846) >> 16;
+}
+
+void rgb_to_grey_row(const uchar* src, uchar* dst, int w) {
+  for (int j = 0; j < w; ++j, src += 3)
+    dst[j] = grey_value(src[0], src[1], src[2]);
+}
+
+// ---------------------------------------------------------------------------
+// Row swap
+
+void swap_rows(uchar* a, uchar* b, size_t len) {
+  uchar buf[1024];
+  while (len) {
+    size_t n = min(len, sizeof(buf));
+    memcpy(buf, a, n);
+    memcpy(a, b, n);
+    memcpy(b, buf, n);
+    a += n;
+    b += n;
+    len -= n;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Bilinear resize
+//
+// The horizontal pass interpolates a source row into int16, scaled by 128.
+// The vertical pass blends two such rows with weights summing to 128, and
+// rounds the result, scaled by 128 * 128, back to uint8.
+
+const int WEIGHT_BITS = 7;
+const int WEIGHT_ONE = 1 << WEIGHT_BITS;
+
+// For each of the n_dst outputs, the two inputs and the weight of the second.
+struct BilinearTable {
+  PooledVector<int> s0, s1;
+  PooledVector<int16_t> w;
+
+  BilinearTable(int n_src, int n_dst): s0(n_dst), s1(n_dst), w(n_dst) {
+    double scale = (double)n_src / n_dst;
+    for (int d = 0; d < n_dst; ++d) {
+      double f = (d + 0.5) * scale - 0.5;
+      int s = floor(f);
+      double r = f - s;
+      if (s < 0) {
+        s = 0;
+        r = 0;
+      } else if (s >= n_src - 1) {
+        s = n_src - 1;
+        r = 0;
+      }
+      s0[d] = s;
+      s1[d] = min(s + 1, n_src - 1);
+      w[d] = lround(r * WEIGHT_ONE);
+    }
+  }
+};
+
+void bilinear_hpass_scalar(const uchar* src, int16_t* dst, const BilinearTable& tab,
+    int n_dst, int ch) {
+  for (int d = 0; d < n_dst; ++d) {
+    const uchar* p0 = src + tab.s0[d] * ch;
+    const uchar* p1 = src + tab.s1[d] * ch;
+    int w1 = tab.w[d], w0 = WEIGHT_ONE - w1;
+    for (int c = 0; c < ch; ++c)
+      *(dst++) = p0[c] * w0 + p1[c] * w1;
+  }
+}
+
+#ifdef HOUSE3D_X86_SIMD
+// The horizontal pass computes 8 outputs at a time from a 32-byte window of
+// the source row: two shuffles gather the byte pairs to interpolate, and one
+// multiply-add applies their weights.
+struct HpassBlock {
+  uchar lo[16], hi[16];  // shuffles of the bytes in [base, base + 16), [base + 16, base + 32)
+  uchar w[16];           // the weights of each pair
+  int base, start;       // the window in the source row, the first output
+};
+
+// The blocks covering a row, the last one overlapping the previous one if
+// the row length is not a multiple of 8. Empty if a block spans more than
+// 32 bytes, i.e. when downscaling by more than about 3.
+struct HpassPlan {
+  PooledVector<HpassBlock> blocks;
+
+  HpassPlan(const BilinearTable& tab, int n_src, int n_dst, int ch) {
+    const int n = n_dst * ch, row_bytes = n_src * ch;
+    if (n < 8 || row_bytes < 32)
+      return;
+    for (int start = 0; start < n; start += 8) {
+      start = min(start, n - 8);
+      HpassBlock b;
+      b.start = start;
+      // the first pixel of the block, whose channels may come after others
+      b.base = min(tab.s0[start / ch] * ch, row_bytes - 32);
+      for (int k = 0; k < 8; ++k) {
+        int e = start + k, dk = e / ch, c = e % ch;
+        int i0 = tab.s0[dk] * ch + c - b.base, i1 = tab.s1[dk] * ch + c - b.base;
+        if (i0 < 0 || i1 >= 32) {
+          blocks.clear();
+          return;
+        }
+        b.lo[2 * k] = i0 < 16 ? i0 : 0x80;
+        b.hi[2 * k] = i0 < 16 ? 0x80 : i0 - 16;
+        b.lo[2 * k + 1] = i1 < 16 ? i1 : 0x80;
+        b.hi[2 * k + 1] = i1 < 16 ? 0x80 : i1 - 16;
+        b.w[2 * k] = WEIGHT_ONE - tab.w[dk];
+        b.w[2 * k + 1] = tab.w[dk];
+      }
+      blocks.push_back(b);
+    }
+  }
+};
+
+// The pixels are biased to int8 for the unsigned x signed multiply-add:
+// w0 * (p0 - 128) + w1 * (p1 - 128) is in [-16384, 16256] since the weights
+// sum to 128, and adding 16384 back gives p0 * w0 + p1 * w1 exactly.
+TARGET_SSSE3 void bilinear_hpass_ssse3(const uchar* src, int16_t* dst,
+    const HpassPlan& plan) {
+  const __m128i bias = _mm_set1_epi8(-128), unbias = _mm_set1_epi16(WEIGHT_ONE * 128);
+  for (auto& b : plan.blocks) {
+    const uchar* p = src + b.base;
+    __m128i v = _mm_or_si128(
+        _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)p), _mm_loadu_si128((const __m128i*)b.lo)),
+        _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 16)), _mm_loadu_si128((const __m128i*)b.hi)));
+    v = _mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)b.w), _mm_xor_si128(v, bias));
+    _mm_storeu_si128((__m128i*)(dst + b.start), _mm_add_epi16(v, unbias));
+  }
+}
+
+#endif
+
+void bilinear_vpass_scalar(const int16_t* h0, const int16_t* h1, uchar* dst,
+    int n, int w1) {
+  int w0 = WEIGHT_ONE - w1;
+  const int shift = 2 * WEIGHT_BITS, half = 1 << (shift - 1);
+  for (int i = 0; i < n; ++i)
+    dst[i] = (h0[i] * w0 + h1[i] * w1 + half) >> shift;
+}
+
+#ifdef HOUSE3D_X86_SIMD
+// Blend 8 int16 of two rows. `w` has the weights of both rows in each int32.
+TARGET_SSSE3 inline __m128i blend8(const int16_t* p0, const int16_t* p1, __m128i w) {
+  const __m128i half = _mm_set1_epi32(1 << (2 * WEIGHT_BITS - 1));
+  __m128i a = _mm_loadu_si128((const __m128i*)p0),
+          b = _mm_loadu_si128((const __m128i*)p1);
+  __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w),
+          hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w);
+  lo = _mm_srai_epi32(_mm_add_epi32(lo, half), 2 * WEIGHT_BITS);
+  hi = _mm_srai_epi32(_mm_add_epi32(hi, half), 2 * WEIGHT_BITS);
+  return _mm_packs_epi32(lo, hi);
+}
+
+// 16 int16 in order: the lane-wise unpack and pack cancel out
+TARGET_AVX2 inline __m256i blend16(const int16_t* p0, const int16_t* p1, __m256i w) {
+  const __m256i half = _mm256_set1_epi32(1 << (2 * WEIGHT_BITS - 1));
+  __m256i a = _mm256_loadu_si256((const __m256i*)p0),
+          b = _mm256_loadu_si256((const __m256i*)p1);
+  __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w),
+          hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w);
+  lo = _mm256_srai_epi32(_mm256_add_epi32(lo, half), 2 * WEIGHT_BITS);
+  hi = _mm256_srai_epi32(_mm256_add_epi32(hi, half), 2 * WEIGHT_BITS);
+  return _mm256_packs_epi32(lo, hi);
+}
+
+TARGET_SSSE3 int bilinear_vpass_ssse3(const int16_t* h0, const int16_t* h1,
+    uchar* dst, int n, int w1) {
+  const __m128i w = _mm_set1_epi32((w1 << 16) | (WEIGHT_ONE - w1));
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i r = _mm_packus_epi16(blend8(h0 + i, h1 + i, w), blend8(h0 + i + 8, h1 + i + 8, w));
+    _mm_storeu_si128((__m128i*)(dst + i), r);
+  }
+  return i;
+}
+
+TARGET_AVX2 int bilinear_vpass_avx2(const int16_t* h0, const int16_t* h1,
+    uchar* dst, int n, int w1) {
+  const __m256i w = _mm256_set1_epi32((w1 << 16) | (WEIGHT_ONE - w1));
+  int i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i r = _mm256_packus_epi16(blend16(h0 + i, h1 + i, w),
+        blend16(h0 + i + 16, h1 + i + 16, w));
+    r = _mm256_permute4x64_epi64(r, _MM_SHUFFLE(3, 1, 2, 0));
+    _mm256_storeu_si256((__m256i*)(dst + i), r);
+  }
+  return i;
+}
+#endif
+
+void bilinear_vpass(const int16_t* h0, const int16_t* h1, uchar* dst, int n, int w1) {
+  int i = 0;
+#ifdef HOUSE3D_X86_SIMD
+  if (use(SimdLevel::AVX2))
+    i = bilinear_vpass_avx2(h0, h1, dst, n, w1);
+  if (use(SimdLevel::SSSE3))
+    i += bilinear_vpass_ssse3(h0 + i, h1 + i, dst + i, n - i, w1);
+#endif
+  bilinear_vpass_scalar(h0 + i, h1 + i, dst + i, n - i, w1);
+}
+
+// ---------------------------------------------------------------------------
+// Area resize
+
+// Sum `n` uint8 into uint16 accumulators.
+void accumulate(const uchar* src, uint16_t* acc, int n) {
+  for (int i = 0; i < n; ++i)
+    acc[i] += src[i];
+}
+
+// Downscale by integer factors fy x fx, with fy <= 257 so that the column
+// sums fit in uint16.
+void resize_area_integer(const Matuc& src, Matuc& dst, int fy, int fx) {
+  const int ch = src.channels(), area = fy * fx;
+  const int n_src = src.cols() * ch;
+  PooledVector<uint16_t> acc(n_src);
+  for (int r = 0; r < dst.rows(); ++r) {
+    fill(acc.begin(), acc.end(), 0);
+    for (int k = 0; k < fy; ++k)
+      accumulate(src.ptr(r * fy + k), acc.data(), n_src);
+    uchar* out = dst.ptr(r);
+    for (int d = 0; d < dst.cols(); ++d) {
+      const uint16_t* p = acc.data() + d * fx * ch;
+      for (int c = 0; c < ch; ++c) {
+        int sum = 0;
+        for (int k = 0; k < fx; ++k)
+          sum += p[k * ch + c];
+        *(out++) = (sum + area / 2) / area;
+      }
+    }
+  }
+}
+
+// The inputs overlapping each output and their weights, which sum to 1.
+struct AreaTable {
+  PooledVector<int> begin;      // of each output, into src and weight; n_dst + 1
+  PooledVector<int> src;
+  PooledVector<float> weight;
+
+  AreaTable(int n_src, int n_dst): begin(n_dst + 1) {
+    double scale = (double)n_src / n_dst;
+    for (int d = 0; d < n_dst; ++d) {
+      begin[d] = src.size();
+      double lo = d * scale, hi = min((d + 1) * scale, (double)n_src);
+      for (int s = floor(lo); s < hi; ++s) {
+        double w = min(hi, s + 1.0) - max(lo, (double)s);
+        if (w <= 1e-9)
+          continue;
+        src.push_back(s);
+        weight.push_back(w / scale);
+      }
+    }
+    begin[n_dst] = src.size();
+  }
+};
+
+void resize_area_general(const Matuc& in, Matuc& out) {
+  const int ch = in.channels(), n_dst = out.cols() * ch;
+  AreaTable tx(in.cols(), out.cols()), ty(in.rows(), out.rows());
+  PooledVector<float> row(n_dst), acc(n_dst);
+  for (int r = 0; r < out.rows(); ++r) {
+    fill(acc.begin(), acc.end(), 0.f);
+    for (int i = ty.begin[r]; i < ty.begin[r + 1]; ++i) {
+      const uchar* p = in.ptr(ty.src[i]);
+      fill(row.begin(), row.end(), 0.f);
+      for (int d = 0; d < out.cols(); ++d)
+        for (int k = tx.begin[d]; k < tx.begin[d + 1]; ++k) {
+          const uchar* pc = p + tx.src[k] * ch;
+          for (int c = 0; c < ch; ++c)
+            row[d * ch + c] += pc[c] * tx.weight[k];
+        }
+      float wy = ty.weight[i];
+      for (int k = 0; k < n_dst; ++k)
+        acc[k] += row[k] * wy;
+    }
+    uchar* pout = out.ptr(r);
+    for (int k = 0; k < n_dst; ++k)
+      pout[k] = min(255, (int)lround(acc[k]));
+  }
+}
+
+void check_resize(const Matuc& src, Matuc& dst) {
+  if (src.rows() <= 0 || src.cols() <= 0 || dst.rows() <= 0 || dst.cols() <= 0 ||
+      src.channels() != dst.channels())
+    error_exit("resize: invalid shapes\n");
+}
+
+} // namespace
+
+SimdLevel max_simd_level() {
+  static SimdLevel level = detect_simd_level();
+  return level;
+}
+
+SimdLevel simd_level() {
+  int level = current_level.load(memory_order_relaxed);
+  if (level < 0) {
+    level = (int)env_simd_level(max_simd_level());
+    current_level = level;
+  }
+  return (SimdLevel)level;
+}
+
+void set_simd_level(SimdLevel level) {
+  current_level = (int)min(level, max_simd_level());
+}
+
+const char* simd_level_name(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::SCALAR: return "scalar";
+    case SimdLevel::SSSE3: return "ssse3";
+    case SimdLevel::AVX2: return "avx2";
+  }
+  return "unknown";
+}
+
+void rgba_to_rgb(const Matuc& src, Matuc& dst, bool flip) {
+  PROFILE_ZONE("rgba_to_rgb");
+  m_assert(src.channels() == 4 && dst.channels() == 3);
+  m_assert(src.rows() == dst.rows() && src.cols() == dst.cols());
+  int H = src.rows(), W = src.cols();
+  for (int i = 0; i < H; ++i)
+    rgba_to_rgb_row(src.ptr(i), dst.ptr(flip ? H - 1 - i : i), W);
+}
+
+void rgb_to_grey(const Matuc& src, Matuc& dst) {
+  m_assert(src.channels() == 3 && dst.channels() == 1);
+  m_assert(src.rows() == dst.rows() && src.cols() == dst.cols());
+  int W = src.cols();
+  for (int i = 0; i < src.rows(); ++i)
+    rgb_to_grey_row(src.ptr(i), dst.ptr(i), W);
+}
+
+void flip_rows(void* data, int rows, size_t row_bytes) {
+  uchar* base = static_cast<uchar*>(data);
+  for (int h = 0, hh = rows - 1; h < hh; ++h, --hh)
+    swap_rows(base + h * row_bytes, base + hh * row_bytes, row_bytes);
+}
+
+void resize_bilinear(const Matuc& src, Matuc& dst) {
+  PROFILE_ZONE("resize_bilinear<uint8>");
+  check_resize(src, dst);
+  const int ch = src.channels(), n = dst.cols() * ch;
+  BilinearTable tx(src.cols(), dst.cols()), ty(src.rows(), dst.rows());
+  // the horizontally interpolated source rows cached in rows[0] and rows[1]
+  PooledVector<int16_t> rows[2] = {PooledVector<int16_t>(n), PooledVector<int16_t>(n)};
+  int cached[2] = {-1, -1};
+#ifdef HOUSE3D_X86_SIMD
+  HpassPlan plan(tx, src.cols(), use(SimdLevel::SSSE3) ? dst.cols() : 0, ch);
+#endif
+  auto hpass = [&](int s, int16_t* out) {
+#ifdef HOUSE3D_X86_SIMD
+    if (!plan.blocks.empty())
+      return bilinear_hpass_ssse3(src.ptr(s), out, plan);
+#endif
+    bilinear_hpass_scalar(src.ptr(s), out, tx, dst.cols(), ch);
+  };
+  for (int r = 0; r < dst.rows(); ++r) {
+    int s0 = ty.s0[r], s1 = ty.s1[r];
+    if (cached[1] == s0) {
+      swap(rows[0], rows[1]);
+      swap(cached[0], cached[1]);
+    }
+    if (cached[0] != s0) {
+      hpass(s0, rows[0].data());
+      cached[0] = s0;
+    }
+    if (cached[1] != s1) {
+      hpass(s1, rows[1].data());
+      cached[1] = s1;
+    }
+    bilinear_vpass(rows[0].data(), rows[1].data(), dst.ptr(r), n, ty.w[r]);
+  }
+}
+
+void resize_area(const Matuc& src, Matuc& dst) {
+  PROFILE_ZONE("resize_area<uint8>");
+  check_resize(src, dst);
+  if (dst.rows() > src.rows() || dst.cols() > src.cols())
+    return resize_bilinear(src, dst);
+  if (src.rows() % dst.rows() == 0 && src.cols() % dst.cols() == 0 &&
+      src.rows() / dst.rows() <= 257)
+    return resize_area_integer(src, dst, src.rows() / dst.rows(), src.cols() / dst.cols());
+  resize_area_general(src, dst);
+}
+
+void resize_nearest(const Matuc& src, Matuc& dst) {
+  PROFILE_ZONE("resize_nearest<uint8>");
+  check_resize(src, dst);
+  const int ch = src.channels();
+  // the source pixel containing the center of each output pixel
+  auto nearest = [](int d, int n_src, int n_dst) {
+    return min(int(((2LL * d + 1) * n_src) / (2LL * n_dst)), n_src - 1);
+  };
+  PooledVector<int> sx(dst.cols());
+  for (int d = 0; d < dst.cols(); ++d)
+    sx[d] = nearest(d, src.cols(), dst.cols()) * ch;
+  for (int r = 0; r < dst.rows(); ++r) {
+    const uchar* ps = src.ptr(nearest(r, src.rows(), dst.rows()));
+    uchar* pd = dst.ptr(r);
+    if (ch == 1) {
+      for (int d = 0; d < dst.cols(); ++d)
+        pd[d] = ps[sx[d]];
+    } else {
+      for (int d = 0; d < dst.cols(); ++d, pd += ch)
+        memcpy(pd, ps + sx[d], ch);
+    }
+  }
+}
@@ -0,0 +1,54 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: imgkernels.hh
+
+#pragma once
+
+#include <cstddef>
+
+#include "mat.h"
+
+// Kernels on uint8 images. The bilinear resize is vectorized with SSSE3 and
+// AVX2, chosen at runtime, so that a binary built without -mavx2 still uses
+// AVX2 where available; other architectures run the scalar code. All
+// implementations give identical results. The other kernels are scalar loops,
+// which the compiler vectorizes as well as hand-written code.
+
+enum class SimdLevel { SCALAR = 0, SSSE3 = 1, AVX2 = 2 };
+
+// The best level supported by the CPU.
+SimdLevel max_simd_level();
+
+// The level used by the kernels: max_simd_level(), capped by the environment
+// variable HOUSE3D_SIMD ("scalar", "ssse3" or "avx2") if set.
+SimdLevel simd_level();
+
+// Override the level, e.g. to compare implementations. Capped by max_simd_level().
+void set_simd_level(SimdLevel level);
+
+const char* simd_level_name(SimdLevel level);
+
+// Drop the alpha channel of a h x w x 4 image into a h x w x 3 image,
+// flipping it vertically if `flip`.
+void rgba_to_rgb(const Matuc& src, Matuc& dst, bool flip);
+
+// The rounded average of the channels of a h x w x 3 image, into h x w x 1.
+void rgb_to_grey(const Matuc& src, Matuc& dst);
+
+// Swap row i and row (rows - 1 - i) of a buffer, in place.
+void flip_rows(void* data, int rows, size_t row_bytes);
+
+// Bilinear interpolation with 7-bit fixed-point weights, with any number of
+// channels. Samples pixel centers, like resize<float>.
+void resize_bilinear(const Matuc& src, Matuc& dst);
+
+// Average of the source pixels covered by each output pixel, to downscale
+// without aliasing. Upscaling falls back to resize_bilinear.
+void resize_area(const Matuc& src, Matuc& dst);
+
+// Nearest neighbor, which never mixes values, e.g. for SEMANTIC and
+// INSTANCE label maps.
+void resize_nearest(const Matuc& src, Matuc& dst);
@@ -13,6 +13,7 @@
 
 #include "utils.hh"
 #include "debugutils.hh"
+#include "imgkernels.hh"
 #include "timer.hh"
 
 using namespace std;
@@ -104,6 +105,11 @@ void resize<float>(const Mat32f &src, Mat32f &dst) {
 	return resize_bilinear(src, dst);
 }
 
+template <>
+void resize<unsigned char>(const Matuc &src, Matuc &dst) {
+	return ::resize_bilinear(src, dst);
+}
+
 Matuc cvt_f2uc(const Mat32f& mat) {
 	m_assert(mat.channels() == 3);
 	Matuc ret(mat.rows(), mat.cols(), 3);
@@ -115,43 +121,37 @@ Matuc cvt_f2uc(const Mat32f& mat) {
 	return ret;
 }
 
-void vflip(Matuc& mat) {
-  int len = mat.cols() * mat.channels() * sizeof(Matuc::value_type);
-  char* buf = new char[len];
-  int H = mat.rows();
-  for (int h = 0; h < H; ++h) {
-    int hh = H - 1 - h;
-    if (h >= hh) break;
-    auto ptr1 = mat.ptr(h),
-         ptr2 = mat.ptr(hh);
-    memcpy(buf, ptr1, len);
-    memcpy(ptr1, ptr2, len);
-    memcpy(ptr2, buf, len);
-  }
-  delete[] buf;
+template <typename T>
+void vflip(Mat<T>& mat) {
+  flip_rows(mat.ptr(), mat.rows(), (size_t)mat.cols() * mat.channels() * sizeof(T));
 }
 
-Matuc hconcat(std::vector<Matuc>& srcs) {
+void rgba_to_rgb_vflip(const Matuc& src, Matuc& dst) {
+  rgba_to_rgb(src, dst, true);
+}
+
+template <typename T>
+Mat<T> hconcat(std::vector<Mat<T>>& srcs) {
   int rows = srcs[0].rows();
   int channels = srcs[0].channels();
   int cols = 0;
-  for (Matuc& cur : srcs) {
+  for (Mat<T>& cur : srcs) {
     m_assert(cur.rows() == rows);
     m_assert(cur.channels() == channels);
     cols += cur.cols();
   }
 
-  Matuc buf(rows, cols, channels);
+  Mat<T> buf(rows, cols, channels);
   int offset = 0;
-  for (Matuc& cur : srcs) {
-    int len = cur.cols() * channels;
-    for (int r = 0; r < rows; r++) {
-      auto out = buf.ptr(r, offset);
-      auto in = cur.ptr(r);
-      memcpy(out, in, len);
-    }
+  for (Mat<T>& cur : srcs) {
+    copy_cols(cur, buf, offset);
     offset += cur.cols();
   }
 
   return buf;
 }
+
+template void vflip<unsigned char>(Matuc&);
+template void vflip<float>(Mat32f&);
+template Matuc hconcat<unsigned char>(std::vector<Matuc>&);
+template Mat32f hconcat<float>(std::vector<Mat32f>&);
@@ -15,10 +15,23 @@
 
 // return a image of hxwx[1,3,4]
 Matuc read_img(const char* fname);
+// Whether read_img(fname) would return 4 channels. Only reads the header
+// of png and jpeg files.
+bool image_has_alpha(const char* fname);
 void write_rgb(const char* fname, const Mat32f& mat);
 
 void write_rgb(const char* fname, const Matuc& mat);
 
+// Encode a h x w x [1,2,3,4] image straight from its rows, with libpng.
+// compression: zlib level in [0, 9].
+// Throws std::runtime_error on failure, and leaves no partial file.
+void write_png(const char* fname, const Matuc& mat, int compression = 6);
+// Encode a h x w x [1,3] image with libjpeg, with quality in [1, 100].
+void write_jpeg(const char* fname, const Matuc& mat, int quality = 90);
+// write_png or write_jpeg by the extension of fname.
+// level: compression of png or quality of jpeg; -1 for the default.
+void write_image(const char* fname, const Matuc& mat, int level = -1);
+
 Mat32f rgb2grey(const Mat32f& mat);
 
 template <typename T>
@@ -31,12 +44,29 @@ void fill(Mat<T>& mat, T c) {
 	}
 }
 
+// Bilinear resize. See lib/imgkernels.hh for other uint8 filters.
 template <typename T>
 void resize(const Mat<T> &src, Mat<T> &dst);
 
 Matuc cvt_f2uc(const Mat32f& mat);
 
 // in-place vertical flip
-void vflip(Matuc& mat);
+template <typename T>
+void vflip(Mat<T>& mat);
 
-Matuc hconcat(std::vector<Matuc>& srcs);
+// Drop the alpha channel of a h x w x 4 image and flip it vertically,
+// e.g. to convert the output of glReadPixels.
+void rgba_to_rgb_vflip(const Matuc& src, Matuc& dst);
+
+// Copy `src` into the columns [col, col + src.cols()) of `dst`.
+template <typename T>
+void copy_cols(const Mat<T>& src, Mat<T>& dst, int col) {
+  m_assert(src.rows() == dst.rows() && src.channels() == dst.channels());
+  m_assert(col >= 0 && col + src.cols() <= dst.cols());
+  size_t row_bytes = (size_t)src.cols() * src.channels() * sizeof(T);
+  for (int r = 0; r < src.rows(); ++r)
+    memcpy(dst.ptr(r, col), src.ptr(r), row_bytes);
+}
+
+template <typename T>
+Mat<T> hconcat(std::vector<Mat<T>>& srcs);
@@ -7,16 +7,28 @@
 
 #include <memory>
 #include <cstring>
+#include <type_traits>
+#include "lib/bufferPool.hh"
 #include "lib/debugutils.hh"
 
 template <typename T>
 class Mat {
+    static_assert(std::is_trivial<T>::value, "Mat buffers are uninitialized memory from BufferPool");
     public:
         using value_type = T;
 				Mat(){}
+				// The buffer is 64-byte aligned, from BufferPool, and returns
+				// to it when the last Mat (or numpy array) referring to it is gone.
 				Mat(int rows, int cols, int channels):
 					m_rows(rows), m_cols(cols), m_channels(channels),
-					m_data{new T[rows * cols * channels], std::default_delete<T[]>() }
+					m_data{make_pooled_array<T>((size_t)rows * cols * channels)}
+				{ }
+
+				// Use an existing buffer of size rows * cols * channels.
+				// The Mat shares the ownership of `data`.
+				Mat(int rows, int cols, int channels, std::shared_ptr<T> data):
+					m_rows(rows), m_cols(cols), m_channels(channels),
+					m_data{std::move(data)}
 				{ }
 
 				virtual ~Mat(){}
@@ -0,0 +1,39 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: meminfo.cc
+
+#include "meminfo.hh"
+
+#include <cstdio>
+#include <sys/resource.h>
+#include <unistd.h>
+
+size_t current_rss_bytes() {
+#ifdef __linux__
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (!f)
+    return 0;
+  long pages_total, pages_resident;
+  int nr = fscanf(f, "%ld %ld", &pages_total, &pages_resident);
+  fclose(f);
+  if (nr != 2)
+    return 0;
+  return static_cast<size_t>(pages_resident) * sysconf(_SC_PAGESIZE);
+#else
+  return 0;
+#endif
+}
+
+size_t peak_rss_bytes() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#ifdef __APPLE__
+  return usage.ru_maxrss;         // bytes
+#else
+  return usage.ru_maxrss * 1024;  // kilobytes
+#endif
+}
@@ -0,0 +1,16 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: meminfo.hh
+
+#pragma once
+
+#include <cstddef>
+
+// Resident memory of this process, in bytes. Returns 0 if unknown.
+size_t current_rss_bytes();
+
+// The high-water mark of resident memory of this process, in bytes.
+size_t peak_rss_bytes();
@@ -0,0 +1,93 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: microbench.cc
+
+#include "microbench.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#ifdef __linux__
+#include <sched.h>
+#endif
+#include <csv.h>
+
+#include "debugutils.hh"
+#include "strutils.hh"
+
+using namespace std;
+
+BenchResult run_benchmark(const string& name, const BenchOptions& opt,
+    const function<void()>& func, const function<void()>& setup) {
+  using Clock = chrono::steady_clock;
+  for (int i = 0; i < opt.warmup; ++i) {
+    if (setup)
+      setup();
+    func();
+  }
+
+  vector<double> samples;
+  double total = 0;
+  while ((int)samples.size() < opt.repetitions || total < opt.min_time * 1e6) {
+    if (setup)
+      setup();
+    auto start = Clock::now();
+    func();
+    double us = chrono::duration<double, micro>(Clock::now() - start).count();
+    samples.push_back(us);
+    total += us;
+  }
+
+  sort(samples.begin(), samples.end());
+  int n = samples.size();
+  // Distribution-free confidence interval of the median, from the ranks
+  // n/2 -+ 1.96 * sqrt(n) / 2 of the sorted samples.
+  double half_width = 0.98 * sqrt(n);
+  int lo = max(0, (int)floor(n / 2.0 - half_width));
+  int hi = min(n - 1, (int)ceil(n / 2.0 + half_width));
+  double median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+  return BenchResult{name, n, median, samples[lo], samples[hi], samples[0], total / n};
+}
+
+bool pin_to_cpu(int cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+  (void)cpu;
+  return false;
+#endif
+}
+
+map<string, BenchResult> read_baseline(const string& fname) {
+  io::CSVReader<7> reader{fname};
+  reader.read_header(io::ignore_extra_column, "name", "repetitions", "median_us",
+      "ci_low_us", "ci_high_us", "min_us", "mean_us");
+  map<string, BenchResult> ret;
+  BenchResult r;
+  while (reader.read_row(r.name, r.repetitions, r.median_us,
+        r.ci_low_us, r.ci_high_us, r.min_us, r.mean_us))
+    ret[r.name] = r;
+  return ret;
+}
+
+void write_baseline(const string& fname, const vector<BenchResult>& results) {
+  ofstream fout(fname);
+  if (!fout.good())
+    error_exit(ssprintf("Cannot open %s\n", fname.c_str()));
+  fout << "name,repetitions,median_us,ci_low_us,ci_high_us,min_us,mean_us\n";
+  for (auto& r : results)
+    fout << ssprintf("%s,%d,%.4f,%.4f,%.4f,%.4f,%.4f\n", r.name.c_str(), r.repetitions,
+        r.median_us, r.ci_low_us, r.ci_high_us, r.min_us, r.mean_us);
+}
+
+bool is_regression(const BenchResult& cur, const BenchResult& base, double threshold) {
+  return cur.median_us > base.median_us * (1 + threshold) &&
+    cur.ci_low_us > base.ci_high_us;
+}
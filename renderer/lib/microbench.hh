@@ -0,0 +1,51 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: microbench.hh
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// A small harness to benchmark single kernels.
+//
+// Every repetition is timed separately. Results are summarized by the
+// median and its 95% confidence interval, which are robust to the outliers
+// caused by interrupts and frequency scaling.
+
+struct BenchOptions {
+  int warmup = 3;
+  int repetitions = 30;   // at least this many timed repetitions
+  double min_time = 0.2;  // and at least this many seconds in total
+};
+
+struct BenchResult {
+  std::string name;
+  int repetitions;
+  double median_us, ci_low_us, ci_high_us;  // 95% CI of the median
+  double min_us, mean_us;
+};
+
+// Run func() repeatedly. If given, setup() is called before each run
+// outside of the timed region, e.g. to restore the input of an in-place
+// kernel.
+BenchResult run_benchmark(const std::string& name, const BenchOptions& opt,
+    const std::function<void()>& func,
+    const std::function<void()>& setup = nullptr);
+
+// Pin the calling thread to one CPU. Returns false if it failed or is not
+// supported on this platform.
+bool pin_to_cpu(int cpu);
+
+// Baselines are csv files of results, keyed by benchmark name.
+std::map<std::string, BenchResult> read_baseline(const std::string& fname);
+void write_baseline(const std::string& fname, const std::vector<BenchResult>& results);
+
+// Whether `cur` is slower than `base` by more than `threshold` (e.g. 0.1
+// for 10%), and the confidence intervals of the two medians do not overlap.
+bool is_regression(const BenchResult& cur, const BenchResult& base, double threshold);
@@ -0,0 +1,37 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: parallel.hh
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Split [0, n) into contiguous chunks of at least `min_chunk` items, and call
+// func(begin, end) for each chunk in parallel, one thread per chunk.
+inline void parallel_for(int n, int min_chunk,
+    const std::function<void(int, int)>& func) {
+  if (n <= 0)
+    return;
+  int nr_thread = std::max<int>(std::thread::hardware_concurrency(), 1);
+  int nr_chunk = std::max(std::min(nr_thread, n / std::max(min_chunk, 1)), 1);
+  int chunk_size = (n + nr_chunk - 1) / nr_chunk;
+  nr_chunk = (n + chunk_size - 1) / chunk_size;
+  if (nr_chunk == 1) {
+    func(0, n);
+    return;
+  }
+  std::vector<std::thread> threads;
+  threads.reserve(nr_chunk - 1);
+  for (int i = 1; i < nr_chunk; ++i)
+    threads.emplace_back(func, i * chunk_size, std::min(n, (i + 1) * chunk_size));
+  // the calling thread works on the first chunk
+  func(0, std::min(n, chunk_size));
+  for (auto& th : threads)
+    th.join();
+}
@@ -0,0 +1,301 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: profiler.cc
+
+#include "profiler.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unistd.h>
+
+#include "debugutils.hh"
+#include "strutils.hh"
+
+using namespace std;
+
+namespace {
+
+const int BLOCK_SIZE = 4096;
+
+// Events of a thread are appended to a linked list of blocks.
+// Only the owner thread writes. Readers see the events before `size`.
+struct Block {
+  Profiler::Event events[BLOCK_SIZE];
+  atomic<int> size{0};
+  atomic<Block*> next{nullptr};
+};
+
+struct ThreadBuffer {
+  int tid;
+  string name;  // protected by registry_mutex
+  // Protects the list of blocks against being freed while read. The owner
+  // appends events to `tail` without it, and only takes it to add a block.
+  mutex m;
+  Block* head;
+  Block* tail;  // only changed by the owner thread
+  atomic<int64_t> nr_event{0};  // in the blocks
+  int generation;  // of clear() when the owner last emptied the buffer
+
+  ThreadBuffer(int tid, int generation):
+    tid{tid}, head{new Block}, tail{head}, generation{generation} {}
+  ~ThreadBuffer() { free_blocks(); }
+
+  void free_blocks() {
+    while (head) {
+      Block* next = head->next.load();
+      delete head;
+      head = next;
+    }
+  }
+};
+
+struct RetiredEvent {
+  int tid;
+  Profiler::Event event;
+};
+
+mutex registry_mutex;
+// Never destroyed: threads may still record during static destruction.
+// Buffers of the running threads.
+vector<ThreadBuffer*>* registry = new vector<ThreadBuffer*>;
+// Events and names of the threads which have exited, until clear().
+vector<RetiredEvent>* retired = new vector<RetiredEvent>;
+map<int, string>* retired_names = new map<int, string>;
+int next_tid = 0;
+
+atomic<int64_t> max_events{Profiler::DEFAULT_MAX_EVENTS};
+atomic<int64_t> nr_dropped{0};
+
+// Events which started before this are discarded.
+atomic<int64_t> clear_before_ns{numeric_limits<int64_t>::min()};
+// Incremented by clear(). The block being written by a thread is only freed
+// by the thread itself, when it sees a new generation.
+atomic<int> clear_generation{0};
+
+const int64_t origin_ns = Profiler::now_ns();
+
+// Move the events of an exiting thread to `retired`, and free its buffer.
+void retire(ThreadBuffer* buf) {
+  lock_guard<mutex> lg(registry_mutex);
+  registry->erase(find(registry->begin(), registry->end(), buf));
+  int64_t cutoff = clear_before_ns.load();
+  bool has_event = false;
+  for (Block* b = buf->head; b; b = b->next.load()) {
+    int n = b->size.load();
+    for (int i = 0; i < n; ++i) {
+      if (b->events[i].start_ns < cutoff)
+        continue;
+      if ((int64_t)retired->size() >= max_events.load()) {
+        nr_dropped++;
+        continue;
+      }
+      retired->push_back(RetiredEvent{buf->tid, b->events[i]});
+      has_event = true;
+    }
+  }
+  if (has_event && !buf->name.empty())
+    (*retired_names)[buf->tid] = buf->name;
+  delete buf;
+}
+
+// Owns the buffer of a thread, which is retired when the thread exits.
+struct ThreadBufferOwner {
+  ThreadBuffer* buf = nullptr;
+  ~ThreadBufferOwner() {
+    if (buf)
+      retire(buf);
+    buf = nullptr;
+  }
+};
+
+ThreadBuffer* thread_buffer() {
+  thread_local ThreadBufferOwner owner;
+  if (!owner.buf) {
+    lock_guard<mutex> lg(registry_mutex);
+    owner.buf = new ThreadBuffer(next_tid++, clear_generation.load());
+    registry->push_back(owner.buf);
+  }
+  return owner.buf;
+}
+
+// Call func(tid, event) for each event. Must hold registry_mutex.
+template <typename F>
+void foreach_event(F func) {
+  int64_t cutoff = clear_before_ns.load();
+  for (auto& e : *retired)
+    if (e.event.start_ns >= cutoff)
+      func(e.tid, e.event);
+  for (auto* buf : *registry) {
+    lock_guard<mutex> lg(buf->m);
+    for (Block* b = buf->head; b; b = b->next.load(memory_order_acquire)) {
+      int n = b->size.load(memory_order_acquire);
+      for (int i = 0; i < n; ++i)
+        if (b->events[i].start_ns >= cutoff)
+          func(buf->tid, b->events[i]);
+    }
+  }
+}
+
+string json_escape(const string& s) {
+  string ret;
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      ret += '\\';
+    if (static_cast<unsigned char>(c) < 0x20)
+      ret += ssprintf("\\u%04x", c);
+    else
+      ret += c;
+  }
+  return ret;
+}
+
+} // namespace
+
+atomic<bool> Profiler::enabled_{false};
+
+int64_t Profiler::now_ns() {
+  return chrono::duration_cast<chrono::nanoseconds>(
+      chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::record(const char* name, int64_t start_ns, int64_t end_ns) {
+  ThreadBuffer* buf = thread_buffer();
+  int generation = clear_generation.load(memory_order_relaxed);
+  if (buf->generation != generation) {
+    Block* head = new Block;
+    lock_guard<mutex> lg(buf->m);
+    buf->free_blocks();
+    buf->head = buf->tail = head;
+    buf->nr_event.store(0, memory_order_relaxed);
+    buf->generation = generation;
+  }
+  if (buf->nr_event.load(memory_order_relaxed) >= max_events.load(memory_order_relaxed)) {
+    nr_dropped.fetch_add(1, memory_order_relaxed);
+    return;
+  }
+  Block* b = buf->tail;
+  int n = b->size.load(memory_order_relaxed);
+  if (n == BLOCK_SIZE) {
+    Block* next = new Block;
+    lock_guard<mutex> lg(buf->m);
+    b->next.store(next, memory_order_release);
+    buf->tail = b = next;
+    n = 0;
+  }
+  b->events[n] = Event{name, start_ns, end_ns - start_ns};
+  b->size.store(n + 1, memory_order_release);
+  buf->nr_event.fetch_add(1, memory_order_relaxed);
+}
+
+void Profiler::clear() {
+  lock_guard<mutex> lg(registry_mutex);
+  clear_before_ns.store(now_ns());
+  clear_generation++;
+  for (auto* buf : *registry) {
+    // the owner may be appending to the tail, which is kept
+    lock_guard<mutex> lg2(buf->m);
+    int64_t nr_freed = 0;
+    while (buf->head != buf->tail) {
+      Block* next = buf->head->next.load();
+      nr_freed += buf->head->size.load();
+      delete buf->head;
+      buf->head = next;
+    }
+    buf->nr_event.fetch_sub(nr_freed);
+  }
+  vector<RetiredEvent>().swap(*retired);
+  retired_names->clear();
+  nr_dropped.store(0);
+}
+
+void Profiler::set_max_events(int64_t n) {
+  max_events.store(n);
+}
+
+int64_t Profiler::num_dropped() {
+  return nr_dropped.load();
+}
+
+void Profiler::set_thread_name(const string& name) {
+  ThreadBuffer* buf = thread_buffer();
+  lock_guard<mutex> lg(registry_mutex);
+  buf->name = name;
+}
+
+void Profiler::write_chrome_trace(const string& fname) {
+  ofstream fout(fname);
+  if (!fout.good())
+    error_exit(ssprintf("Cannot open %s\n", fname.c_str()));
+  int pid = getpid();
+  lock_guard<mutex> lg(registry_mutex);
+  fout << "{\"traceEvents\":[\n";
+  bool first = true;
+  map<int, string> names = *retired_names;
+  for (auto* buf : *registry)
+    if (!buf->name.empty())
+      names[buf->tid] = buf->name;
+  for (auto& itr : names) {
+    fout << (first ? "" : ",\n") << ssprintf(
+        "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+        "\"args\":{\"name\":\"%s\"}}",
+        pid, itr.first, json_escape(itr.second).c_str());
+    first = false;
+  }
+  foreach_event([&](int tid, const Event& e) {
+    fout << (first ? "" : ",\n") << ssprintf(
+        "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+        json_escape(e.name).c_str(), pid, tid,
+        (e.start_ns - origin_ns) / 1e3, e.duration_ns / 1e3);
+    first = false;
+  });
+  fout << "\n]}\n";
+}
+
+vector<Profiler::ZoneSummary> Profiler::summary() {
+  map<string, ZoneSummary> zones;
+  {
+    lock_guard<mutex> lg(registry_mutex);
+    foreach_event([&](int, const Event& e) {
+      auto itr = zones.find(e.name);
+      if (itr == zones.end())
+        itr = zones.emplace(e.name, ZoneSummary{e.name, 0, 0, 0, 0}).first;
+      ZoneSummary& z = itr->second;
+      double ms = e.duration_ns / 1e6;
+      z.count++;
+      z.total_ms += ms;
+      z.max_ms = max(z.max_ms, ms);
+    });
+  }
+  vector<ZoneSummary> ret;
+  for (auto& itr : zones) {
+    itr.second.mean_ms = itr.second.total_ms / itr.second.count;
+    ret.push_back(itr.second);
+  }
+  sort(ret.begin(), ret.end(), [](const ZoneSummary& a, const ZoneSummary& b) {
+      return a.total_ms > b.total_ms; });
+  return ret;
+}
+
+string Profiler::summary_table() {
+  string ret = ssprintf("%-40s %10s %12s %10s %10s\n",
+      "zone", "count", "total(ms)", "mean(ms)", "max(ms)");
+  for (auto& z : summary())
+    ret += ssprintf("%-40s %10lld %12.3f %10.3f %10.3f\n",
+        z.name.c_str(), (long long)z.count, z.total_ms, z.mean_ms, z.max_ms);
+  int64_t dropped = num_dropped();
+  if (dropped)
+    ret += ssprintf("%lld events dropped, see Profiler::set_max_events\n", (long long)dropped);
+  return ret;
+}
+
+void Profiler::print_summary() {
+  print_debug("%s", summary_table().c_str());
+}
@@ -0,0 +1,103 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: profiler.hh
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A thread-safe profiler of scoped zones.
+//
+// Each thread records its zones into its own buffer, without any lock.
+// When the profiler is disabled (the default), a zone costs one atomic load.
+// Each running thread keeps at most max_events events, and so do all exited
+// threads together. Further events are dropped and counted until clear().
+//
+// Usage:
+//   void f() {
+//     PROFILE_ZONE("f");   // the name has to be a string literal
+//     ...
+//   }
+//   Profiler::enable();
+//   ...
+//   Profiler::write_chrome_trace("trace.json");  // open in chrome://tracing
+//   Profiler::print_summary();
+class Profiler {
+  public:
+    struct Event {
+      const char* name;
+      int64_t start_ns, duration_ns;
+    };
+
+    struct ZoneSummary {
+      std::string name;
+      int64_t count;
+      double total_ms, mean_ms, max_ms;
+    };
+
+    static void enable(bool enabled = true) { enabled_.store(enabled, std::memory_order_relaxed); }
+    static void disable() { enable(false); }
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    static const int64_t DEFAULT_MAX_EVENTS = 1 << 20;
+
+    // Discard the events recorded so far, and free their memory.
+    static void clear();
+
+    // Keep at most n events per thread, 2^20 by default.
+    static void set_max_events(int64_t n);
+    // The number of events dropped since the last clear().
+    static int64_t num_dropped();
+
+    // Name the calling thread in the trace.
+    static void set_thread_name(const std::string& name);
+
+    // Write all events in the Chrome trace event format.
+    static void write_chrome_trace(const std::string& fname);
+
+    // Per-zone statistics, sorted by total time.
+    static std::vector<ZoneSummary> summary();
+    // The summary as a text table.
+    static std::string summary_table();
+    static void print_summary();
+
+    // Called by ProfileZone.
+    static void record(const char* name, int64_t start_ns, int64_t end_ns);
+    static int64_t now_ns();
+
+  private:
+    static std::atomic<bool> enabled_;
+};
+
+
+class ProfileZone {
+  public:
+    explicit ProfileZone(const char* name): name_{name} {
+      if (Profiler::enabled())
+        start_ns_ = Profiler::now_ns();
+    }
+
+    ~ProfileZone() {
+      if (start_ns_ >= 0)
+        Profiler::record(name_, start_ns_, Profiler::now_ns());
+    }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator = (const ProfileZone&) = delete;
+
+  private:
+    const char* name_;
+    int64_t start_ns_ = -1;
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_ZONE(name) \
+  ProfileZone PROFILE_CONCAT(_profile_zone_, __COUNTER__)(name)
+#define PROFILE_FUNC PROFILE_ZONE(__func__)
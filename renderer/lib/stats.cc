@@ -0,0 +1,51 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: stats.cc
+
+#include "stats.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "debugutils.hh"
+
+RollingStats::RollingStats(int capacity): capacity_{capacity} {
+  m_assert(capacity > 0);
+  samples_.reserve(capacity);
+}
+
+void RollingStats::add(double v) {
+  if ((int)samples_.size() < capacity_) {
+    samples_.push_back(v);
+  } else {
+    samples_[next_] = v;
+    next_ = (next_ + 1) % capacity_;
+  }
+  ++total_count_;
+}
+
+double RollingStats::percentile(double p) const {
+  if (samples_.empty())
+    return 0;
+  std::vector<double> sorted{samples_};
+  std::sort(sorted.begin(), sorted.end());
+  double rank = std::min(std::max(p, 0.), 100.) / 100. * (sorted.size() - 1);
+  size_t lo = std::floor(rank), hi = std::ceil(rank);
+  return sorted[lo] + (sorted[hi] - sorted[lo]) * (rank - lo);
+}
+
+double RollingStats::mean() const {
+  if (samples_.empty())
+    return 0;
+  return std::accumulate(samples_.begin(), samples_.end(), 0.) / samples_.size();
+}
+
+void RollingStats::clear() {
+  samples_.clear();
+  next_ = 0;
+  total_count_ = 0;
+}
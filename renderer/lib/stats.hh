@@ -0,0 +1,38 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: stats.hh
+
+#pragma once
+
+#include <vector>
+
+// Keep the most recent `capacity` samples, and compute statistics over them.
+class RollingStats {
+  public:
+    explicit RollingStats(int capacity = 512);
+
+    void add(double v);
+
+    // p in [0, 100]. Linear interpolation between the closest samples.
+    // Returns 0 if there is no sample.
+    double percentile(double p) const;
+
+    double mean() const;
+
+    // number of samples in the window
+    int size() const { return samples_.size(); }
+
+    // number of samples ever added
+    long long total_count() const { return total_count_; }
+
+    void clear();
+
+  private:
+    int capacity_;
+    int next_ = 0;   // where to write the next sample, once the window is full
+    long long total_count_ = 0;
+    std::vector<double> samples_;
+};
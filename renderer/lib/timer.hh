@@ -62,37 +62,11 @@ class GuardedTimer: public Timer {
 
 };
 
-// record the total running time of a region across the lifecycle of the whole program
-// call TotalTimer::print() before exiting main()
-class TotalTimer {
-	public:
-		TotalTimer(const std::string& msg):
-			msg(msg) {
-				timer.restart();
-			}
-
-		~TotalTimer();
-
-		static void print();
-
-		std::string msg;
-		Timer timer;
-
-		static std::map<std::string, std::pair<int, double>> rst;
-};
-
-// Build a global instance of this class, to call print() before program exit.
-struct TotalTimerGlobalGuard {
-	~TotalTimerGlobalGuard() { TotalTimer::print(); }
-};
-
-
 #define GUARDED_FUNC_TIMER \
 	GuardedTimer _long_long_name_guarded_timer(__func__)
 
-#define TOTAL_FUNC_TIMER \
-	TotalTimer _long_long_name_total_timer(__func__)
-
+// To record the total running time of regions across threads, use
+// PROFILE_ZONE in profiler.hh.
 
 class Speedometer {
   constexpr static int interval = 100;
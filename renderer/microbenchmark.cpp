@@ -0,0 +1,333 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: microbenchmark.cpp
+
+// Microbenchmarks of the loader, capture and image kernels, on synthetic
+// inputs.
+//
+// Usage:
+//   ./microbenchmark.bin [--filter name] [--size 640x480] [--obj-boxes 2000]
+//     [--reps 30] [--warmup 3] [--min-time 0.2] [--cpu 0] [--device 0] [--no-gl]
+//     [--save baseline.csv] [--baseline baseline.csv] [--threshold 0.1]
+//
+// With --baseline, results are compared against a file written by --save.
+// A kernel regresses if its median is slower by more than the threshold and
+// the confidence intervals do not overlap. The exit code is 1 if any kernel
+// regresses. Pin to an idle CPU (--cpu) and keep the machine quiet for
+// stable numbers.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "gl/fbScope.hh"
+#include "gl/glContext.hh"
+#include "lib/debugutils.hh"
+#include "lib/imgkernels.hh"
+#include "lib/imgproc.hh"
+#include "lib/microbench.hh"
+#include "lib/strutils.hh"
+#include "model/obj.hh"
+#include "suncg/render.hh"
+
+using namespace render;
+using namespace std;
+
+namespace {
+
+struct Options {
+  string filter;
+  Geometry size{640, 480};
+  int obj_boxes = 2000;
+  BenchOptions bench;
+  int cpu = 0;      // -1 to not pin
+  int device = 0;
+  bool gl = true;
+  string save_file, baseline_file;
+  double threshold = 0.1;
+};
+
+[[noreturn]] void usage(const char* prog) {
+  cerr << "Usage: " << prog << " [--filter name] [--size 640x480] [--obj-boxes 2000]"
+       << " [--reps 30] [--warmup 3] [--min-time 0.2] [--cpu 0] [--device 0] [--no-gl]"
+       << " [--save baseline.csv] [--baseline baseline.csv] [--threshold 0.1]" << endl;
+  exit(1);
+}
+
+Options parse_args(int argc, char* argv[]) {
+  Options opt;
+  for (int i = 1; i < argc; ++i) {
+    string key = argv[i];
+    if (key == "--no-gl") {
+      opt.gl = false;
+      continue;
+    }
+    if (i + 1 >= argc)
+      usage(argv[0]);
+    string val = argv[++i];
+    if (key == "--filter") {
+      opt.filter = val;
+    } else if (key == "--size") {
+      if (sscanf(val.c_str(), "%dx%d", &opt.size.w, &opt.size.h) != 2 ||
+          opt.size.w <= 1 || opt.size.h <= 1)
+        error_exit(ssprintf("Invalid size %s\n", val.c_str()));
+    } else if (key == "--obj-boxes") {
+      opt.obj_boxes = stoi(val);
+    } else if (key == "--reps") {
+      opt.bench.repetitions = stoi(val);
+    } else if (key == "--warmup") {
+      opt.bench.warmup = stoi(val);
+    } else if (key == "--min-time") {
+      opt.bench.min_time = stod(val);
+    } else if (key == "--cpu") {
+      opt.cpu = stoi(val);
+    } else if (key == "--device") {
+      opt.device = stoi(val);
+    } else if (key == "--save") {
+      opt.save_file = val;
+    } else if (key == "--baseline") {
+      opt.baseline_file = val;
+    } else if (key == "--threshold") {
+      opt.threshold = stod(val);
+    } else {
+      usage(argv[0]);
+    }
+  }
+  return opt;
+}
+
+// An image with some structure, so that codecs don't take shortcuts.
+template <typename T>
+Mat<T> synthetic_image(int h, int w, int c, T scale) {
+  Mat<T> ret{h, w, c};
+  for (int i = 0; i < h; ++i) {
+    T* p = ret.ptr(i);
+    for (int j = 0; j < w; ++j)
+      for (int k = 0; k < c; ++k)
+        *(p++) = static_cast<T>(((i * 7 + j * 13 + k * 61) % 256) / 255.0 * scale);
+  }
+  return ret;
+}
+
+// Write an obj of `nr_box` boxes into dir, with 8 materials alternating
+// between the faces of each box.
+string write_synthetic_obj(const string& dir, int nr_box) {
+  const int nr_material = 8;
+  string mtl_file = dir + "/bench.mtl", obj_file = dir + "/bench.obj";
+  ofstream mtl(mtl_file);
+  for (int i = 0; i < nr_material; ++i)
+    mtl << ssprintf("newmtl m%d\nKd %.2f 0.5 0.5\nKa 0 0 0\nd 1\n", i, i / 8.0);
+
+  ofstream obj(obj_file);
+  obj << "mtllib bench.mtl\n";
+  // corners of a unit cube, and the 4 corners of each face
+  static const int faces[6][4] = {
+    {0, 1, 3, 2}, {4, 6, 7, 5}, {0, 4, 5, 1}, {2, 3, 7, 6}, {0, 2, 6, 4}, {1, 5, 7, 3}};
+  for (int b = 0; b < nr_box; ++b) {
+    float x = b % 50, z = b / 50;
+    obj << "g Model#" << b << "\n";
+    for (int v = 0; v < 8; ++v)
+      obj << ssprintf("v %.2f %.2f %.2f\nvt %d %d\n",
+          x + (v & 1) * 0.8f, (v >> 1 & 1) * 0.8f, z + (v >> 2 & 1) * 0.8f, v & 1, v >> 1 & 1);
+    for (int f = 0; f < 6; ++f) {
+      obj << "usemtl m" << (b + f) % nr_material << "\n";
+      int base = b * 8 + 1;
+      const int* c = faces[f];
+      obj << ssprintf("f %d/%d %d/%d %d/%d\nf %d/%d %d/%d %d/%d\n",
+          base + c[0], base + c[0], base + c[1], base + c[1], base + c[2], base + c[2],
+          base + c[0], base + c[0], base + c[2], base + c[2], base + c[3], base + c[3]);
+    }
+  }
+  return obj_file;
+}
+
+class Runner {
+  public:
+    explicit Runner(const Options& opt): opt_{opt} {
+      if (!opt.baseline_file.empty())
+        baseline_ = read_baseline(opt.baseline_file);
+      cout << ssprintf("%-36s %12s %25s %12s %s\n", "kernel", "median(us)",
+          "95% CI(us)", "min(us)", baseline_.empty() ? "" : "vs. baseline");
+    }
+
+    void run(const string& name, const function<void()>& func,
+        const function<void()>& setup = nullptr) {
+      if (name.find(opt_.filter) == string::npos)
+        return;
+      BenchResult r = run_benchmark(name, opt_.bench, func, setup);
+      results_.push_back(r);
+      string cmp;
+      auto itr = baseline_.find(name);
+      if (itr != baseline_.end()) {
+        double change = r.median_us / itr->second.median_us - 1;
+        bool regress = is_regression(r, itr->second, opt_.threshold);
+        nr_regression_ += regress;
+        cmp = ssprintf("%+.1f%%%s", change * 100, regress ? " REGRESSION" : "");
+      }
+      cout << ssprintf("%-36s %12.2f %12.2f - %10.2f %12.2f %s\n", name.c_str(),
+          r.median_us, r.ci_low_us, r.ci_high_us, r.min_us, cmp.c_str());
+    }
+
+    const vector<BenchResult>& results() const { return results_; }
+    int nr_regression() const { return nr_regression_; }
+
+  private:
+    const Options& opt_;
+    map<string, BenchResult> baseline_;
+    vector<BenchResult> results_;
+    int nr_regression_ = 0;
+};
+
+void bench_loader(Runner& runner, const Options& opt, const string& tmpdir) {
+  string obj_file = write_synthetic_obj(tmpdir, opt.obj_boxes);
+  string suffix = ssprintf("/%dboxes", opt.obj_boxes);
+  runner.run("ObjLoader::load" + suffix, [&]() { ObjLoader loader{obj_file}; });
+
+  ObjLoader orig{obj_file}, loader = orig;
+  runner.run("split_shapes_by_material" + suffix,
+      [&]() { loader.split_shapes_by_material(); },
+      [&]() { loader = orig; });
+}
+
+void bench_image(Runner& runner, const Options& opt, const string& tmpdir) {
+  int h = opt.size.h, w = opt.size.w;
+  string size = ssprintf("/%dx%d", w, h);
+
+  Matuc img = synthetic_image<unsigned char>(h, w, 3, 255);
+  for (const char* ext : {"png", "jpg"}) {
+    string fname = tmpdir + "/bench." + ext;
+    write_rgb(fname.c_str(), img);
+    runner.run(ssprintf("read_img/%s", ext) + size, [&]() { read_img(fname.c_str()); });
+  }
+
+  runner.run("vflip<uint8>" + size, [&]() { vflip(img); });
+
+  Mat32f imgf = synthetic_image<float>(h, w, 3, 1.f);
+  runner.run("vflip<float>" + size, [&]() { vflip(imgf); });
+
+  // the six faces of a cube map
+  vector<Matuc> faces(6, synthetic_image<unsigned char>(h, h, 3, 255));
+  runner.run(ssprintf("hconcat<uint8>/6x%dx%d", h, h), [&]() { hconcat(faces); });
+
+  Mat32f half{h / 2, w / 2, 3};
+  runner.run("resize<float>" + size + ssprintf("->%dx%d", w / 2, h / 2),
+      [&]() { resize(imgf, half); });
+
+  Matuc rgba = synthetic_image<unsigned char>(h, w, 4, 255), rgb{h, w, 3};
+  runner.run("rgba_to_rgb_vflip" + size, [&]() { rgba_to_rgb_vflip(rgba, rgb); });
+
+  Matuc depth2{h, w, 2};
+  runner.run("depth_to_2channel" + size, [&]() { depth_to_2channel(img, depth2); });
+}
+
+// The uint8 kernels. Those with SIMD code run at each level the CPU supports,
+// named e.g. "resize_bilinear/640x480->320x240@avx2", and their outputs are
+// checked against the scalar ones first.
+void bench_simd(Runner& runner, const Options& opt) {
+  int h = opt.size.h, w = opt.size.w;
+  string size = ssprintf("/%dx%d", w, h);
+  Matuc rgba = synthetic_image<unsigned char>(h, w, 4, 255);
+  Matuc rgb = synthetic_image<unsigned char>(h, w, 3, 255);
+  Matuc rgb_out{h, w, 3}, grey{h, w, 1}, half{h / 2, w / 2, 3}, third{h / 3, w / 3, 3},
+        large{h * 3 / 2, w * 3 / 2, 3};
+
+  struct Kernel {
+    string name;
+    function<void()> func;
+    const Matuc& output;
+    bool simd;
+  };
+  vector<Kernel> kernels{
+    {"rgba_to_rgb" + size, [&]() { rgba_to_rgb(rgba, rgb_out, true); }, rgb_out, false},
+    {"rgb_to_grey" + size, [&]() { rgb_to_grey(rgb, grey); }, grey, false},
+    {"vflip<uint8>" + size, [&]() { vflip(rgb_out); }, rgb_out, false},
+    {"resize_bilinear" + size + ssprintf("->%dx%d", w / 2, h / 2),
+      [&]() { resize_bilinear(rgb, half); }, half, true},
+    {"resize_bilinear" + size + ssprintf("->%dx%d", w * 3 / 2, h * 3 / 2),
+      [&]() { resize_bilinear(rgb, large); }, large, true},
+    {"resize_area" + size + ssprintf("->%dx%d", w / 2, h / 2),
+      [&]() { resize_area(rgb, half); }, half, false},
+    {"resize_area" + size + ssprintf("->%dx%d", w / 3, h / 3),
+      [&]() { resize_area(rgb, third); }, third, false},
+    {"resize_nearest" + size + ssprintf("->%dx%d", w / 3, h / 3),
+      [&]() { resize_nearest(rgb, third); }, third, false},
+  };
+
+  SimdLevel prev = simd_level();
+  vector<Matuc> expected;
+  set_simd_level(SimdLevel::SCALAR);
+  for (auto& k : kernels) {
+    k.func();
+    expected.push_back(k.output.clone());
+  }
+  for (int l = 0; l <= (int)max_simd_level(); ++l) {
+    SimdLevel level = (SimdLevel)l;
+    set_simd_level(level);
+    for (size_t i = 0; i < kernels.size(); ++i) {
+      Kernel& k = kernels[i];
+      if (!k.simd && level != SimdLevel::SCALAR)
+        continue;
+      k.func();
+      if (memcmp(k.output.ptr(), expected[i].ptr(), expected[i].elements()) != 0)
+        error_exit(ssprintf("%s differs between scalar and %s\n",
+              k.name.c_str(), simd_level_name(level)));
+      runner.run(k.simd ? k.name + "@" + simd_level_name(level) : k.name, k.func);
+    }
+  }
+  set_simd_level(prev);
+}
+
+void bench_gl(Runner& runner, const Options& opt) {
+  std::unique_ptr<GLContext> ctx{createHeadlessContext(opt.size, opt.device)};
+  cout << "GL_RENDERER: " << glGetString(GL_RENDERER) << endl;
+  string size = ssprintf("/%dx%d", opt.size.w, opt.size.h);
+  Framebuffer fb{opt.size};
+  fb.bind();
+  glClearColor(0.2f, 0.4f, 0.6f, 1.f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  Matuc rgb{opt.size.h, opt.size.w, 3};
+  runner.run("Framebuffer::capture" + size, [&]() { fb.capture(rgb); });
+  runner.run("Framebuffer::readRGBA" + size, [&]() { fb.readRGBA(); });
+  fb.unbind();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  Options opt = parse_args(argc, argv);
+  if (opt.cpu >= 0 && !pin_to_cpu(opt.cpu))
+    print_debug("Failed to pin to cpu %d\n", opt.cpu);
+
+  char tmpl[] = "/tmp/microbenchXXXXXX";
+  if (!mkdtemp(tmpl))
+    error_exit("Cannot create a temporary directory\n");
+  string tmpdir = tmpl;
+
+  Runner runner{opt};
+  bench_loader(runner, opt, tmpdir);
+  bench_image(runner, opt, tmpdir);
+  bench_simd(runner, opt);
+  if (opt.gl)
+    bench_gl(runner, opt);
+
+  for (const char* f : {"bench.obj", "bench.mtl", "bench.png", "bench.jpg"})
+    unlink((tmpdir + "/" + f).c_str());
+  rmdir(tmpdir.c_str());
+
+  if (!opt.save_file.empty())
+    write_baseline(opt.save_file, runner.results());
+  if (runner.nr_regression()) {
+    cout << runner.nr_regression() << " kernel(s) regressed by more than "
+         << opt.threshold * 100 << "%" << endl;
+    return 1;
+  }
+}
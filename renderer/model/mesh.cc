@@ -8,11 +8,38 @@
 #include "gl/api.hh"
 #include "mesh.hh"
 #include "gl/utils.hh"
+#include "gl/memoryStats.hh"
+#include "simplify.hh"
+
+#include <algorithm>
+#include <limits>
 
 using namespace std;
 
 namespace render {
 
+void Mesh::build_lods(int nr_level) {
+  // not worth the memory for meshes of a few faces
+  const size_t MIN_FACES = 64;
+  lods.clear();
+  lods.reserve(max(nr_level - 1, 0));
+  const vector<Vertex>* prev = &vertices;
+  float error = 0;
+  for (int k = 1; k < nr_level; ++k) {
+    size_t nr_face = prev->size() / 3;
+    if (nr_face < MIN_FACES)
+      break;
+    float e;
+    auto simplified = simplify_triangles(*prev, nr_face / 4, &e);
+    if (simplified.size() / 3 > nr_face * 3 / 4)
+      break;    // cannot be simplified much further
+    // the errors of successive levels add up
+    error += e;
+    lods.push_back(MeshLOD{move(simplified), error});
+    prev = &lods.back().vertices;
+  }
+}
+
 void Mesh::activate() {
   glGenVertexArrays(1, VAO);
   glGenBuffers(1, VBO);
@@ -25,6 +52,8 @@ void Mesh::activate() {
   // again translates to 3/2 floats which translates to a byte array.
   glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex),
       vertices.data(), GL_STATIC_DRAW);
+  GPUMemory::allocate(GPUMemory::VERTEX_BUFFER, GPUMemory::Object::BUFFER,
+      VBO, vertices.size() * sizeof(Vertex));
 
   // Set the vertex attribute pointers
   // Vertex Positions
@@ -39,10 +68,16 @@ void Mesh::activate() {
 }
 
 void Mesh::deactivate() {
-  if (VAO)
-    glDeleteVertexArrays(1, VAO);
-  if (VBO)
+  // reset the names, which may be reused by other meshes
+  if (VAO) {
+    GLStateCache::deleteVertexArray(VAO);
+    VAO.obj = 0;
+  }
+  if (VBO) {
+    GPUMemory::release(GPUMemory::Object::BUFFER, VBO);
     glDeleteBuffers(1, VBO);
+    VBO.obj = 0;
+  }
 }
 
 void Mesh::draw() {
@@ -51,5 +86,173 @@ void Mesh::draw() {
   glCheckError("Mesh::draw::glDrawArrays");
 }
 
+
+void MeshBatch::activate(const vector<Mesh>& meshes) {
+  int nr_mesh = meshes.size();
+  first_.clear();
+  levels_.assign(nr_mesh, {});
+  bounds_.clear();
+  selected_.clear();
+  size_t total = 0, max_level = 0;
+  for (int i = 0; i < nr_mesh; ++i) {
+    auto& m = meshes[i];
+    first_.push_back(total);
+    levels_[i].push_back(Level{(GLint)total, (GLint)m.vertices.size(), 0.f});
+    total += m.vertices.size();
+    max_level = max(max_level, m.lods.size());
+
+    glm::vec3 lo{numeric_limits<float>::max()}, hi{numeric_limits<float>::lowest()};
+    for (auto& v : m.vertices) {
+      lo = glm::min(lo, v.pos);
+      hi = glm::max(hi, v.pos);
+    }
+    bounds_.emplace_back((lo + hi) * 0.5f, glm::length(hi - lo) * 0.5f);
+  }
+  first_.push_back(total);
+  // level k of all meshes after level k - 1, so that full meshes are contiguous
+  for (size_t k = 0; k < max_level; ++k)
+    for (int i = 0; i < nr_mesh; ++i)
+      if (k < meshes[i].lods.size()) {
+        auto& lod = meshes[i].lods[k];
+        levels_[i].push_back(Level{(GLint)total, (GLint)lod.vertices.size(), lod.error});
+        total += lod.vertices.size();
+      }
+  has_lod_ = max_level > 0;
+
+  glGenVertexArrays(1, VAO);
+  glGenBuffers(1, VBO);
+  glGenBuffers(1, indexVBO);
+  VertexArrayGuard VAG{VAO};
+
+  // allocate first, then copy each mesh without an intermediate buffer
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, total * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+  for (int i = 0; i < nr_mesh; ++i)
+    for (size_t k = 0; k < levels_[i].size(); ++k) {
+      auto& data = k == 0 ? meshes[i].vertices : meshes[i].lods[k - 1].vertices;
+      glBufferSubData(GL_ARRAY_BUFFER, levels_[i][k].first * sizeof(Vertex),
+          data.size() * sizeof(Vertex), data.data());
+    }
+  GPUMemory::allocate(GPUMemory::VERTEX_BUFFER, GPUMemory::Object::BUFFER,
+      VBO, total * sizeof(Vertex));
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, normal));
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, texcoord));
+
+  vector<GLuint> index(total);
+  for (int i = 0; i < nr_mesh; ++i)
+    for (auto& l : levels_[i])
+      fill(index.begin() + l.first, index.begin() + l.first + l.count, i);
+  glBindBuffer(GL_ARRAY_BUFFER, indexVBO);
+  glBufferData(GL_ARRAY_BUFFER, total * sizeof(GLuint), index.data(), GL_STATIC_DRAW);
+  GPUMemory::allocate(GPUMemory::VERTEX_BUFFER, GPUMemory::Object::BUFFER,
+      indexVBO, total * sizeof(GLuint));
+  glEnableVertexAttribArray(3);
+  glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), (GLvoid*)0);
+  glCheckError("MeshBatch::activate");
+}
+
+void MeshBatch::deactivate() {
+  if (VAO) {
+    GLStateCache::deleteVertexArray(VAO);
+    VAO.obj = 0;
+  }
+  for (auto buf : {&VBO, &indexVBO}) {
+    if (*buf) {
+      GPUMemory::release(GPUMemory::Object::BUFFER, *buf);
+      glDeleteBuffers(1, *buf);
+      buf->obj = 0;
+    }
+  }
+}
+
+void MeshBatch::select_lod(const glm::mat4& camera_matrix, int viewport_w, int viewport_h,
+    float pixel_error) {
+  if (!has_lod_)
+    return;
+  auto row = [&](int r) {
+    return glm::vec4{camera_matrix[0][r], camera_matrix[1][r], camera_matrix[2][r], camera_matrix[3][r]};
+  };
+  glm::vec4 w_row = row(3);
+  float w_scale = glm::length(glm::vec3{w_row});
+  if (w_scale == 0) {   // not a perspective
+    clear_lod();
+    return;
+  }
+  // pixels per unit length at w = 1
+  float scale = max(glm::length(glm::vec3{row(0)}) * viewport_w,
+                    glm::length(glm::vec3{row(1)}) * viewport_h) * 0.5f;
+  int nr_mesh = levels_.size();
+  selected_.assign(nr_mesh, 0);
+  for (int i = 0; i < nr_mesh; ++i) {
+    auto& levels = levels_[i];
+    if (levels.size() == 1)
+      continue;
+    // w of the nearest point of the bounding sphere
+    float w = glm::dot(glm::vec3{w_row}, glm::vec3{bounds_[i]}) + w_row.w - bounds_[i].w * w_scale;
+    if (w <= 0)
+      continue;
+    for (int k = levels.size() - 1; k > 0; --k)
+      if (levels[k].error * scale <= pixel_error * w) {
+        selected_[i] = k;
+        break;
+      }
+  }
+}
+
+void MeshBatch::clear_lod() {
+  selected_.clear();
+}
+
+MeshBatch::LODStats MeshBatch::lod_stats() const {
+  LODStats ret;
+  ret.nr_mesh = levels_.size();
+  size_t level_sum = 0;
+  for (int i = 0; i < ret.nr_mesh; ++i) {
+    int k = selected_.empty() ? 0 : selected_[i];
+    if (levels_[i].size() > 1) {
+      ret.nr_mesh_with_lod++;
+      level_sum += k;
+    }
+    if (!visible_.empty() && !visible_[i])
+      continue;
+    ret.full_triangles += levels_[i][0].count / 3;
+    ret.drawn_triangles += levels_[i][k].count / 3;
+  }
+  if (ret.nr_mesh_with_lod)
+    ret.mean_level = (double)level_sum / ret.nr_mesh_with_lod;
+  return ret;
+}
+
+void MeshBatch::draw(int begin, int end) {
+  VertexArrayGuard VAG{VAO};
+  if (selected_.empty() && visible_.empty()) {
+    glDrawArrays(GL_TRIANGLES, first_[begin], first_[end] - first_[begin]);
+    glCheckError("MeshBatch::draw::glDrawArrays");
+    return;
+  }
+  // merge the ranges that follow each other, e.g. full meshes
+  draw_first_.clear();
+  draw_count_.clear();
+  for (int i = begin; i < end; ++i) {
+    if (!visible_.empty() && !visible_[i])
+      continue;
+    auto& l = levels_[i][selected_.empty() ? 0 : selected_[i]];
+    if (!draw_first_.empty() && draw_first_.back() + draw_count_.back() == l.first)
+      draw_count_.back() += l.count;
+    else {
+      draw_first_.push_back(l.first);
+      draw_count_.push_back(l.count);
+    }
+  }
+  if (draw_first_.empty())
+    return;
+  glMultiDrawArrays(GL_TRIANGLES, draw_first_.data(), draw_count_.data(), draw_first_.size());
+  glCheckError("MeshBatch::draw::glMultiDrawArrays");
+}
+
 }
 
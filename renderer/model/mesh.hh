@@ -8,16 +8,25 @@
 #pragma once
 #include <vector>
 #include <array>
+#include <utility>
 
 #include "gl/geometry.hh"
 #include "gl/utils.hh"
 
 namespace render {
 
+// A simplified version of a mesh, see model/simplify.hh
+struct MeshLOD {
+  std::vector<Vertex> vertices;
+  float error;  // estimated distance to the full mesh, in world units
+};
+
 // Mesh is a bunch of vertices (usaully triangles)
 class Mesh {
   public:
     std::vector<Vertex> vertices;
+    // coarser levels of detail, from fine to coarse. Only drawn by MeshBatch.
+    std::vector<MeshLOD> lods;
 
     Mesh() {}
     Mesh(const Mesh&) = delete;
@@ -26,6 +35,10 @@ class Mesh {
 
     ~Mesh() { deactivate(); }
 
+    // Build up to `nr_level` - 1 levels of detail, each with about a quarter
+    // of the faces of the previous one. Small meshes are not simplified.
+    void build_lods(int nr_level);
+
     // setup GL buffers for rendering
     void activate();
     void deactivate();
@@ -34,5 +47,75 @@ class Mesh {
     GLIntResource<GLuint> VAO, VBO;
 };
 
+// The meshes of a scene in one vertex array, so that a range of consecutive
+// meshes is drawn with one call, in the same order as drawing each mesh.
+// The index of the mesh of each vertex is the integer attribute 3.
+//
+// The levels of detail of the meshes are stored after all the full meshes.
+// After select_lod(), each mesh is drawn at the selected level.
+// Meshes hidden by set_visible() are skipped.
+class MeshBatch {
+  public:
+    MeshBatch() {}
+    MeshBatch(const MeshBatch&) = delete;
+    MeshBatch& operator = (const MeshBatch&) = delete;
+
+    ~MeshBatch() { deactivate(); }
+
+    // setup GL buffers for the vertices of `meshes`, and their levels of detail
+    void activate(const std::vector<Mesh>& meshes);
+    void deactivate();
+
+    // Whether any mesh has levels of detail.
+    bool has_lod() const { return has_lod_; }
+
+    // For each mesh, select the coarsest level whose error projects to at
+    // most `pixel_error` pixels in a viewport of `viewport_w` x `viewport_h`,
+    // through the perspective `camera_matrix`.
+    void select_lod(const glm::mat4& camera_matrix, int viewport_w, int viewport_h,
+        float pixel_error);
+    // draw the full meshes
+    void clear_lod();
+
+    struct LODStats {
+      int nr_mesh = 0;
+      int nr_mesh_with_lod = 0;     // with at least one simplified level
+      size_t full_triangles = 0;    // of the visible meshes
+      size_t drawn_triangles = 0;   // of the visible meshes, at the selected levels
+      double mean_level = 0;        // selected, over the meshes with levels of detail
+    };
+    // For the levels selected for the following draws.
+    LODStats lod_stats() const;
+
+    // Whether to draw each mesh, or empty to draw all of them.
+    // Kept when the batch is activated again.
+    void set_visible(std::vector<unsigned char> visible) { visible_ = std::move(visible); }
+
+    // draw meshes [begin, end)
+    void draw(int begin, int end);
+
+  protected:
+    struct Level {
+      GLint first, count;
+      float error;
+    };
+
+    GLIntResource<GLuint> VAO, VBO, indexVBO;
+    // the first vertex of each mesh, and the total number of vertices
+    std::vector<GLint> first_;
+
+    bool has_lod_ = false;
+    // levels of each mesh, from the full mesh to the coarsest one
+    std::vector<std::vector<Level>> levels_;
+    // bounding sphere of each mesh: center, radius
+    std::vector<glm::vec4> bounds_;
+    // selected level of each mesh, empty to draw the full meshes
+    std::vector<unsigned char> selected_;
+    std::vector<unsigned char> visible_;
+    // arguments of glMultiDrawArrays
+    std::vector<GLint> draw_first_;
+    std::vector<GLsizei> draw_count_;
+};
+
 } // namespace render
 
@@ -13,10 +13,12 @@
 #include <unordered_set>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "gl/memoryStats.hh"
+#include "gl/stateCache.hh"
 #include "lib/debugutils.hh"
 #include "lib/strutils.hh"
 #include "lib/utils.hh"
-#include "lib/timer.hh"
+#include "lib/profiler.hh"
 #include "lib/imgproc.hh"
 
 using namespace std;
@@ -34,7 +36,7 @@ string getBaseDir(const string &filepath) {
 namespace render {
 
 bool ObjLoader::load(string fname) {
-  //TotalTimer tm("ObjLoader::load");
+  PROFILE_ZONE("ObjLoader::load");
   base_dir = getBaseDir(fname);
 #ifdef _WIN32
   base_dir += "\\";
@@ -120,6 +122,7 @@ TriangleFace ObjLoader::convertFace(
 }
 
 void ObjLoader::split_shapes_by_material() {
+  PROFILE_ZONE("ObjLoader::split_shapes_by_material");
   vector<Shape> new_shapes;
   vector<int> new_shape_ids;
 
@@ -169,6 +172,7 @@ void ObjLoader::split_shapes_by_material() {
 }
 
 void ObjLoader::sort_by_transparent(const TextureRegistry& tex) {
+  PROFILE_ZONE("ObjLoader::sort_by_transparent");
   auto is_transparent_material = [this,&tex](int matid) {
      auto& m = this->materials[matid];
      if (m.dissolve < 1.0)
@@ -192,46 +196,59 @@ void ObjLoader::sort_by_transparent(const TextureRegistry& tex) {
 
 TextureRegistry::TextureRegistry(
     const vector<tinyobj::material_t>& materials,
-    string base_dir): base_dir_(base_dir) {
+    string base_dir, bool load): base_dir_(base_dir) {
   for (size_t i = 0; i < materials.size(); i++) {
     auto& m = materials[i];
     string texname = m.diffuse_texname;
     if (texname.empty()) continue;
-    if (get(texname) == 0)
-      loadTexture(texname);
+    if (!files_.count(texname)) {
+      string filename = squeeze_path(texname);
+      if (!exists_file(texname.c_str())) {
+        // Append base dir.
+        filename = squeeze_path(base_dir_ + texname);
+        if (!exists_file(filename.c_str()))
+          error_exit(ssprintf("Cannot find texture %s\n", texname.c_str()));
+      }
+      files_[texname] = filename;
+    }
 
     if (m.specular_texname.length() or m.normal_texname.length()
         or m.specular_highlight_texname.length() or m.ambient_texname.length()) {
       print_debug("Material %s has unsupported texture!\n", m.name.c_str());
     }
   }
+  if (load) {
+    this->load();
+  } else {
+    PROFILE_ZONE("TextureRegistry::image_has_alpha");
+    for (auto& itr : files_)
+      transparent_[itr.first] = image_has_alpha(itr.second.c_str());
+  }
 }
 
 
-void TextureRegistry::loadTexture(const string& texname) {
-  string filename = squeeze_path(texname);
-  if (!exists_file(texname.c_str())) {
-    // Append base dir.
-    filename = squeeze_path(base_dir_ + texname);
-    if (!exists_file(filename.c_str()))
-      error_exit(ssprintf("Cannot find texture %s\n", texname.c_str()));
+void TextureRegistry::load() {
+  if (loaded_) return;
+  PROFILE_ZONE("TextureRegistry::load");
+  for (auto& itr : files_) {
+    Matuc image = read_img(itr.second.c_str());
+    vflip(image);
+    m_assert(image.channels() >= 3);
+    transparent_[itr.first] = image.channels() == 4;
+    texture_images_[itr.first] = std::move(image);
   }
-
-  Matuc image = read_img(filename.c_str());
-  vflip(image);
-  m_assert(image.channels() >= 3);
-  texture_images_[texname] = std::move(image);
+  loaded_ = true;
 }
 
 void TextureRegistry::activate() {
   m_assert(!activated_);
-  //TotalTimer tmmm("loadTexture::activate");
+  PROFILE_ZONE("TextureRegistry::activate");
 
   for (auto& itr : texture_images_) {
     auto& image = itr.second;
     GLuint tid;
     glGenTextures(1, &tid);
-    glBindTexture(GL_TEXTURE_2D, tid);
+    GLStateCache::bindTexture(GL_TEXTURE_2D, tid);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     if (image.channels() == 3)
@@ -239,7 +256,9 @@ void TextureRegistry::activate() {
     else
       glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width(), image.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, image.ptr());
     glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    GPUMemory::allocate(GPUMemory::TEXTURE, GPUMemory::Object::TEXTURE, tid,
+        GPUMemory::texture_size(image.width(), image.height(),
+          image.channels() == 3 ? GL_RGB : GL_RGBA, true));
     map_[itr.first] = tid;
   }
   activated_ = true;
@@ -247,8 +266,10 @@ void TextureRegistry::activate() {
 
 void TextureRegistry::deactivate() {
   activated_ = false;
-  for (auto& item: map_)
-    glDeleteTextures(1, &item.second);
+  for (auto& item: map_) {
+    GPUMemory::release(GPUMemory::Object::TEXTURE, item.second);
+    GLStateCache::deleteTexture(item.second);
+  }
   map_.clear();
 }
 
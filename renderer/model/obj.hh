@@ -64,9 +64,11 @@ class ObjLoader {
 // maintain mapping from texture name to registered OpenGL texture id
 class TextureRegistry {
   public:
+    // load: whether to decode the textures now. Otherwise only their headers
+    // are read, and nothing is uploaded by activate() until load() is called.
     TextureRegistry(
         const std::vector<tinyobj::material_t>& materials,
-        std::string base_dir);
+        std::string base_dir, bool load = true);
 
     TextureRegistry(const TextureRegistry&) = delete;
     TextureRegistry& operator = (const TextureRegistry&) = delete;
@@ -80,21 +82,29 @@ class TextureRegistry {
     }
 
     bool is_transparent(std::string texname) const {
-      auto itr = texture_images_.find(texname);
-      if (itr == texture_images_.end()) return false;
-      return itr->second.channels() == 4;
+      auto itr = transparent_.find(texname);
+      if (itr == transparent_.end()) return false;
+      return itr->second;
     }
 
+    // Decode the textures, if not done by the constructor.
+    // They are uploaded by the next activate().
+    void load();
+    bool loaded() const { return loaded_; }
+
     // populate map_ by texture_images_
     void activate();
     void deactivate();
 
   private:
     bool activated_ = false;
-    // load a texture to OpenGL and return its texture id
-    void loadTexture(const std::string& texname);
+    bool loaded_ = false;
 
-    // texname -> image, loaded and cached at the beginning
+    // texname -> file
+    std::unordered_map<std::string, std::string> files_;
+    // texname -> whether the texture has an alpha channel
+    std::unordered_map<std::string, bool> transparent_;
+    // texname -> image, loaded and cached by load()
     std::unordered_map<std::string, Matuc> texture_images_;
     // texname -> opengl resource id
     std::unordered_map<std::string, GLuint> map_;
@@ -100,6 +100,8 @@ void SimpleObjScene::draw() {
   glClearColor(0.2f, 0.3f, 0.3f, 1.0f); // TODO background color
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+  GLStateCache::activeTexture(GL_TEXTURE0);
+  glUniform1i(shader_.texture_loc, 0);  // use TU0
   int nr_mesh = mesh_.size();
   for (int i = 0; i < nr_mesh; ++i) {
     const auto& material = materials_[i];
@@ -114,11 +116,8 @@ void SimpleObjScene::draw() {
     }
 
     auto mode = BasicShader::RenderMode::LIGHTING;
-    if (material.texture) {
-      glActiveTexture(GL_TEXTURE0);
-      glUniform1i(shader_.texture_loc, 0);  // use TU0
+    if (material.texture)
       mode = BasicShader::RenderMode::TEXTURE_LIGHTING;
-    }
     glUniform1ui(shader_.mode_loc, static_cast<GLuint>(mode));
 
     TextureGuard TG{material.texture};
@@ -7,20 +7,26 @@
 
 #pragma once
 
+#include <algorithm>
+#include <list>
 #include <unordered_map>
 #include <string>
+#include <utility>
 
 #include "scene.hh"
 
 namespace render {
 
 // Manage cache scenes, as well as the activating scenes.
+// With a capacity, the least recently used scenes are evicted.
 class SceneCache {
   public:
-    SceneCache() {}
+    // capacity: max number of cached scenes, including the current one.
+    // 0 means unlimited.
+    explicit SceneCache(int capacity = 0): capacity_{capacity} {}
     ~SceneCache() {
       for (auto& pair: cached_scenes_)
-        delete pair.second;
+        delete pair.second.first;
     }
     SceneCache(const SceneCache&) = delete;
     SceneCache& operator =(const SceneCache&) = delete;
@@ -31,12 +37,14 @@ class SceneCache {
     ObjSceneBase* get(const std::string& name) {
       auto itr = cached_scenes_.find(name);
       if (itr != cached_scenes_.end()) {
-        ObjSceneBase* new_scene = itr->second;
+        ObjSceneBase* new_scene = itr->second.first;
         if (new_scene != scene_) {
           scene_->deactivate();
           new_scene->activate();
           scene_ = new_scene;
         }
+        // mark as the most recently used
+        lru_.splice(lru_.begin(), lru_, itr->second.second);
         return scene_;
       }
       return nullptr;
@@ -49,17 +57,54 @@ class SceneCache {
       if (scene_)
         scene_->deactivate();
       scene_ = ptr;
-      cached_scenes_[name] = ptr;
+      auto itr = cached_scenes_.find(name);
+      if (itr != cached_scenes_.end()) {
+        if (itr->second.first != ptr)
+          delete itr->second.first;
+        lru_.erase(itr->second.second);
+      }
+      lru_.push_front(name);
+      cached_scenes_[name] = {ptr, lru_.begin()};
+      evict_();
+    }
+
+    bool contains(const std::string& name) const {
+      return cached_scenes_.count(name) > 0;
+    }
+
+    int size() const { return cached_scenes_.size(); }
+
+    int capacity() const { return capacity_; }
+
+    // Evict the least recently used scenes, if more than `capacity` are cached.
+    void set_capacity(int capacity) {
+      capacity_ = capacity;
+      evict_();
     }
 
   private:
-    // cache previously loaded scenes
+    using LRUList = std::list<std::string>;
+
+    // cache previously loaded scenes, and their position in lru_.
     // This hash owns all the pointers.
-    std::unordered_map<std::string, ObjSceneBase*> cached_scenes_;
+    std::unordered_map<std::string, std::pair<ObjSceneBase*, LRUList::iterator>> cached_scenes_;
+
+    // names of the cached scenes, the most recently used first
+    LRUList lru_;
+    int capacity_;
 
     // The current scene
     ObjSceneBase* scene_ = nullptr;  // doesn't own this pointer. Only this scene should be activated.
+
+    void evict_() {
+      // The current scene is the most recently used one, so it is never evicted.
+      while (capacity_ > 0 && (int)lru_.size() > capacity_) {
+        auto itr = cached_scenes_.find(lru_.back());
+        delete itr->second.first;  // already deactivated
+        cached_scenes_.erase(itr);
+        lru_.pop_back();
+      }
+    }
 };
 
 }
-
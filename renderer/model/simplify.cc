@@ -0,0 +1,270 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: simplify.cc
+
+#include "simplify.hh"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+using namespace std;
+
+namespace {
+
+// A symmetric 4x4 matrix, as the 10 coefficients of its upper triangle:
+// xx xy xz xd yy yz yd zz zd dd
+struct Quadric {
+  double a[10] = {0};
+
+  // the squared distance to the plane n.p + d = 0, for a unit normal n
+  static Quadric plane(const glm::dvec3& n, double d) {
+    Quadric q;
+    double v[4] = {n.x, n.y, n.z, d};
+    int k = 0;
+    for (int i = 0; i < 4; ++i)
+      for (int j = i; j < 4; ++j)
+        q.a[k++] = v[i] * v[j];
+    return q;
+  }
+
+  Quadric& operator += (const Quadric& o) {
+    for (int i = 0; i < 10; ++i)
+      a[i] += o.a[i];
+    return *this;
+  }
+
+  double error(const glm::dvec3& p) const {
+    double x = p.x, y = p.y, z = p.z;
+    double e = a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+      + a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+      + a[7] * z * z + 2 * a[8] * z + a[9];
+    return max(e, 0.);
+  }
+
+  // The point of minimum error, if well defined.
+  bool optimum(glm::dvec3& p) const {
+    glm::dmat3 A{a[0], a[1], a[2], a[1], a[4], a[5], a[2], a[5], a[7]};
+    double det = glm::determinant(A);
+    if (fabs(det) < 1e-12)
+      return false;
+    p = glm::inverse(A) * glm::dvec3{-a[3], -a[6], -a[8]};
+    return true;
+  }
+};
+
+struct PositionHash {
+  size_t operator()(const glm::vec3& p) const {
+    uint32_t v[3];
+    memcpy(v, &p, sizeof(v));
+    return (v[0] * 73856093u) ^ (v[1] * 19349663u) ^ (v[2] * 83492791u);
+  }
+};
+
+struct Collapse {
+  double cost;
+  int v0, v1;             // collapse v1 into v0
+  int stamp0, stamp1;     // versions of the vertices when it was computed
+  glm::dvec3 target;
+
+  bool operator > (const Collapse& o) const { return cost > o.cost; }
+};
+
+} // namespace
+
+namespace render {
+
+vector<Vertex> simplify_triangles(
+    const vector<Vertex>& vertices, size_t target_faces, float* error) {
+  size_t nr_face = vertices.size() / 3;
+  if (error)
+    *error = 0.f;
+  if (nr_face <= target_faces)
+    return vertices;
+
+  // merge vertices at the same position
+  vector<glm::dvec3> pos;
+  vector<array<int, 3>> faces(nr_face);
+  {
+    unordered_map<glm::vec3, int, PositionHash> index;
+    for (size_t f = 0; f < nr_face; ++f)
+      for (int k = 0; k < 3; ++k) {
+        auto& p = vertices[f * 3 + k].pos;
+        auto itr = index.find(p);
+        if (itr == index.end()) {
+          itr = index.emplace(p, pos.size()).first;
+          pos.emplace_back(p);
+        }
+        faces[f][k] = itr->second;
+      }
+  }
+  int nr_vertex = pos.size();
+
+  vector<Quadric> quadrics(nr_vertex);
+  vector<vector<int>> vertex_faces(nr_vertex);
+  unordered_map<uint64_t, int> edge_faces;
+  auto edge_key = [](int u, int w) {
+    return (uint64_t)min(u, w) << 32 | (uint32_t)max(u, w);
+  };
+  for (size_t f = 0; f < nr_face; ++f) {
+    auto& v = faces[f];
+    glm::dvec3 n = glm::cross(pos[v[1]] - pos[v[0]], pos[v[2]] - pos[v[0]]);
+    double len = glm::length(n);
+    if (len > 0) {
+      n /= len;
+      Quadric q = Quadric::plane(n, -glm::dot(n, pos[v[0]]));
+      for (int k = 0; k < 3; ++k)
+        quadrics[v[k]] += q;
+    }
+    for (int k = 0; k < 3; ++k) {
+      vertex_faces[v[k]].push_back(f);
+      edge_faces[edge_key(v[k], v[(k + 1) % 3])]++;
+    }
+  }
+  // a plane through each boundary edge, perpendicular to its face, keeps
+  // the boundary in place
+  for (size_t f = 0; f < nr_face; ++f) {
+    auto& v = faces[f];
+    glm::dvec3 n = glm::cross(pos[v[1]] - pos[v[0]], pos[v[2]] - pos[v[0]]);
+    for (int k = 0; k < 3; ++k) {
+      int u = v[k], w = v[(k + 1) % 3];
+      if (edge_faces[edge_key(u, w)] != 1)
+        continue;
+      glm::dvec3 m = glm::cross(pos[w] - pos[u], n);
+      double len = glm::length(m);
+      if (len == 0)
+        continue;
+      m /= len;
+      Quadric q = Quadric::plane(m, -glm::dot(m, pos[u]));
+      quadrics[u] += q;
+      quadrics[w] += q;
+    }
+  }
+
+  vector<bool> face_alive(nr_face, true);
+  vector<int> stamp(nr_vertex, 0);
+  priority_queue<Collapse, vector<Collapse>, greater<Collapse>> heap;
+
+  auto push = [&](int v0, int v1) {
+    Quadric q = quadrics[v0];
+    q += quadrics[v1];
+    glm::dvec3 mid = (pos[v0] + pos[v1]) * 0.5;
+    Collapse c{numeric_limits<double>::max(), v0, v1, stamp[v0], stamp[v1], mid};
+    auto consider = [&](const glm::dvec3& p) {
+      double e = q.error(p);
+      if (e < c.cost) {
+        c.cost = e;
+        c.target = p;
+      }
+    };
+    glm::dvec3 opt;
+    // the optimum may be far away for nearly flat regions
+    if (q.optimum(opt) && glm::length(opt - mid) <= glm::length(pos[v1] - pos[v0]))
+      consider(opt);
+    consider(pos[v0]);
+    consider(pos[v1]);
+    consider(mid);
+    heap.push(c);
+  };
+  for (size_t f = 0; f < nr_face; ++f)
+    for (int k = 0; k < 3; ++k) {
+      int u = faces[f][k], w = faces[f][(k + 1) % 3];
+      // each interior edge is seen from both faces, in opposite directions
+      if (u < w || edge_faces[edge_key(u, w)] == 1)
+        push(u, w);
+    }
+
+  // whether moving v to p flips or degenerates a face that does not contain `other`
+  auto flips = [&](int v, int other, const glm::dvec3& p) {
+    for (int f : vertex_faces[v]) {
+      if (!face_alive[f])
+        continue;
+      auto& fv = faces[f];
+      if (fv[0] == other || fv[1] == other || fv[2] == other)
+        continue;
+      glm::dvec3 a = pos[fv[0]], b = pos[fv[1]], c = pos[fv[2]];
+      glm::dvec3 n_old = glm::cross(b - a, c - a);
+      (fv[0] == v ? a : fv[1] == v ? b : c) = p;
+      glm::dvec3 n_new = glm::cross(b - a, c - a);
+      double l_old = glm::length(n_old), l_new = glm::length(n_new);
+      if (l_old == 0)
+        continue;
+      if (l_new < 1e-6 * l_old || glm::dot(n_old, n_new) < 0.2 * l_old * l_new)
+        return true;
+    }
+    return false;
+  };
+
+  double max_cost = 0;
+  size_t nr_alive = nr_face;
+  vector<int> neighbors;
+  while (nr_alive > target_faces && !heap.empty()) {
+    Collapse c = heap.top();
+    heap.pop();
+    if (c.stamp0 != stamp[c.v0] || c.stamp1 != stamp[c.v1])
+      continue;
+    int v0 = c.v0, v1 = c.v1;
+    if (flips(v0, v1, c.target) || flips(v1, v0, c.target))
+      continue;
+
+    pos[v0] = c.target;
+    quadrics[v0] += quadrics[v1];
+    stamp[v0]++;
+    stamp[v1]++;
+    for (int f : vertex_faces[v1]) {
+      if (!face_alive[f])
+        continue;
+      auto& fv = faces[f];
+      bool shared = fv[0] == v0 || fv[1] == v0 || fv[2] == v0;
+      if (shared) {
+        face_alive[f] = false;
+        nr_alive--;
+        continue;
+      }
+      replace(fv.begin(), fv.end(), v1, v0);
+      vertex_faces[v0].push_back(f);
+    }
+    vertex_faces[v1].clear();
+    vertex_faces[v1].shrink_to_fit();
+    auto& vf = vertex_faces[v0];
+    vf.erase(remove_if(vf.begin(), vf.end(), [&](int f) { return !face_alive[f]; }), vf.end());
+    max_cost = max(max_cost, c.cost);
+
+    neighbors.clear();
+    for (int f : vf)
+      for (int u : faces[f])
+        if (u != v0)
+          neighbors.push_back(u);
+    sort(neighbors.begin(), neighbors.end());
+    neighbors.erase(unique(neighbors.begin(), neighbors.end()), neighbors.end());
+    for (int u : neighbors)
+      push(v0, u);
+  }
+
+  vector<Vertex> ret;
+  ret.reserve(nr_alive * 3);
+  for (size_t f = 0; f < nr_face; ++f) {
+    if (!face_alive[f])
+      continue;
+    for (int k = 0; k < 3; ++k) {
+      ret.push_back(vertices[f * 3 + k]);
+      ret.back().pos = glm::vec3{pos[faces[f][k]]};
+    }
+  }
+  if (error)
+    *error = sqrt(max_cost);
+  return ret;
+}
+
+}
@@ -0,0 +1,29 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: simplify.hh
+
+#pragma once
+#include <vector>
+
+#include "gl/geometry.hh"
+
+namespace render {
+
+// Simplify a triangle list (3 vertices per face) to at most `target_faces`
+// faces, by collapsing edges in the order of their quadric error
+// (Garland & Heckbert, 1997).
+//
+// Vertices at the same position are merged. Open boundaries are preserved
+// by constraint planes, and collapses that would flip a face are rejected,
+// so fewer faces may be removed than requested. Each face keeps the normal
+// and texture coordinates of its corners.
+//
+// error: if not null, set to an estimate of the largest distance between
+//  the result and the input surface.
+std::vector<Vertex> simplify_triangles(
+    const std::vector<Vertex>& vertices, size_t target_faces, float* error = nullptr);
+
+}
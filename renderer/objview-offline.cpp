@@ -17,6 +17,7 @@
 #include "gl/camera.hh"
 #include "gl/fbScope.hh"
 #include "lib/timer.hh"
+#include "lib/profiler.hh"
 #include "lib/imgproc.hh"
 
 #include "model/shader.hh"
@@ -25,12 +26,12 @@ using namespace render;
 using namespace std;
 
 int main(int argc, char* argv[]) {
-  TotalTimerGlobalGuard TGGG;
   if (argc < 2)
     return 1;
   bool benchmark = argc == 3;
   // argv[1]: obj filename
   // argv[2]: if exists, run benchmarks instead of write output
+  Profiler::enable();
 
   Geometry geo{800, 600};
   unique_ptr<GLContext> ctx{createHeadlessContext(geo, 0)};
@@ -69,6 +70,7 @@ int main(int argc, char* argv[]) {
     auto mat = fb.capture();
     if (not benchmark) {
       write_rgb("out.jpg", mat);
+      Profiler::print_summary();
       break;
     }
   }
@@ -5,13 +5,21 @@
 // LICENSE file in the root directory of this source tree.
 //File: pybind.cc
 
+#include <cstring>
+
 #include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
 #include <pybind11/operators.h>
 
 
 #include "suncg/render.hh"
+#include "gl/programCache.hh"
 #include "lib/mat.h"
-#include "lib/timer.hh"
+#include "lib/affinity.hh"
+#include "lib/asyncWriter.hh"
+#include "lib/bufferPool.hh"
+#include "lib/framestack.hh"
+#include "lib/profiler.hh"
 
 #include "house.hh"
 
@@ -20,7 +28,151 @@ using namespace render;
 namespace py = pybind11;
 
 namespace {
-//TotalTimerGlobalGuard TGGG;
+
+// NORMAL and POSITION modes produce float images.
+template <typename API>
+py::object render(API& api) {
+  if (api.isFloatMode())
+    return py::cast(api.renderFloat());
+  return py::cast(api.render());
+}
+
+template <typename API>
+py::object renderCubeMap(API& api) {
+  if (api.isFloatMode())
+    return py::cast(api.renderCubeMapFloat());
+  return py::cast(api.renderCubeMap());
+}
+
+py::dict toDict(const std::map<std::string, std::map<std::string, double>>& m) {
+  py::dict ret;
+  for (auto& group : m) {
+    py::dict stats;
+    for (auto& kv : group.second)
+      stats[py::str(kv.first)] = kv.second;
+    ret[py::str(group.first)] = stats;
+  }
+  return ret;
+}
+
+// Copy a h x w x c (or h x w) uint8 buffer, e.g. a numpy array, into a Mat.
+Matuc toMat(py::buffer b) {
+  py::buffer_info info = b.request();
+  if (info.format != py::format_descriptor<unsigned char>::format() ||
+      (info.ndim != 2 && info.ndim != 3))
+    throw std::runtime_error("Expect a h x w x c array of uint8");
+  int h = info.shape[0], w = info.shape[1], c = info.ndim == 3 ? info.shape[2] : 1;
+  Matuc ret{h, w, c};
+  const char* src = static_cast<const char*>(info.ptr);
+  unsigned char* dst = ret.ptr();
+  if (info.strides[0] == w * c && info.strides[1] == c) {
+    memcpy(dst, src, ret.elements());
+    return ret;
+  }
+  for (int i = 0; i < h; ++i)
+    for (int j = 0; j < w; ++j)
+      for (int k = 0; k < c; ++k)
+        *(dst++) = src[i * info.strides[0] + j * info.strides[1] +
+          (info.ndim == 3 ? k * info.strides[2] : 0)];
+  return ret;
+}
+
+// poses: (x, y, z, yaw, pitch) of each pose.
+// sink: None to return a list of nr_pose x h x w x c arrays, one per mode;
+// a directory to write the frames to, as `ext` files (see DirectoryTrajectorySink);
+// or a function called with (pose index, mode, frame) for each frame.
+template <typename API>
+py::object renderTrajectory(API& api, py::iterable poses, py::iterable modes,
+    py::object sink, const std::string& ext, int threads, int level) {
+  std::vector<TrajectoryPose> pose_vec;
+  for (auto p : poses) {
+    auto v = p.cast<py::sequence>();
+    if (v.size() != 5)
+      throw std::runtime_error("Expect (x, y, z, yaw, pitch) for each pose");
+    pose_vec.push_back(TrajectoryPose{
+        {v[0].cast<float>(), v[1].cast<float>(), v[2].cast<float>()},
+        v[3].cast<float>(), v[4].cast<float>()});
+  }
+  std::vector<SUNCGScene::RenderMode> mode_vec;
+  for (auto m : modes)
+    mode_vec.push_back(m.cast<SUNCGScene::RenderMode>());
+
+  if (sink.is_none()) {
+    ArrayTrajectorySink array_sink;
+    {
+      py::gil_scoped_release release;
+      api.renderTrajectory(pose_vec, mode_vec, array_sink);
+    }
+    py::list ret;
+    Geometry geo = array_sink.resolution();
+    for (int m = 0; m < array_sink.nr_mode(); ++m) {
+      size_t c = array_sink.channels(m);
+      auto owner = new std::shared_ptr<unsigned char>(array_sink.array(m));
+      py::capsule free_when_done(owner, [](void* p) {
+        delete static_cast<std::shared_ptr<unsigned char>*>(p);
+      });
+      ret.append(py::array_t<unsigned char>(
+          {(size_t)array_sink.nr_pose(), (size_t)geo.h, (size_t)geo.w, c},
+          {geo.h * geo.w * c, geo.w * c, c, (size_t)1},
+          owner->get(), free_when_done));
+    }
+    return ret;
+  }
+  if (py::isinstance<py::str>(sink)) {
+    DirectoryTrajectorySink dir_sink{sink.cast<std::string>(), ext, threads, level};
+    py::gil_scoped_release release;
+    api.renderTrajectory(pose_vec, mode_vec, dir_sink);
+    return py::none();
+  }
+  py::function func = sink.cast<py::function>();
+  CallbackTrajectorySink callback_sink{
+    [&func, &mode_vec](int pose, int mode, const Matuc& frame) {
+      py::gil_scoped_acquire acquire;
+      func(pose, mode_vec[mode], frame);
+    }};
+  py::gil_scoped_release release;
+  api.renderTrajectory(pose_vec, mode_vec, callback_sink);
+  return py::none();
+}
+
+template <typename API>
+py::dict getFrameStats(API& api) {
+  return toDict(api.getFrameStats());
+}
+
+template <typename API>
+py::dict getMemoryStats(API& api) {
+  return toDict(api.getMemoryStats());
+}
+
+template <typename API>
+py::dict getStateCacheStats(API& api) {
+  return toDict(api.getStateCacheStats());
+}
+
+template <typename API>
+py::dict getLevelOfDetailStats(API& api) {
+  py::dict ret;
+  for (auto& kv : api.getLevelOfDetailStats())
+    ret[py::str(kv.first)] = kv.second;
+  return ret;
+}
+
+template <typename API>
+void setHiddenCategories(API& api, py::iterable categories) {
+  vector<string> names;
+  for (auto c : categories)
+    names.push_back(c.cast<string>());
+  api.setHiddenCategories(names);
+}
+
+template <typename API>
+py::list getHiddenCategories(API& api) {
+  py::list ret;
+  for (auto& c : api.getHiddenCategories())
+    ret.append(c);
+  return ret;
+}
 }
 
 using namespace pybind11::literals;
@@ -33,10 +185,28 @@ PYBIND11_MODULE(objrender, m) {
     .def("setMode", &SUNCGRenderAPI::setMode)
     .def("loadSceneSUNCG", &SUNCGRenderAPI::loadScene)
     .def("loadScene", &SUNCGRenderAPI::loadScene)
+    .def("setSceneCacheCapacity", &SUNCGRenderAPI::setSceneCacheCapacity, "capacity"_a)
+    .def("setLevelOfDetail", &SUNCGRenderAPI::setLevelOfDetail, "levels"_a, "pixel_error"_a=1.f)
+    .def("setHiddenCategories", &setHiddenCategories<SUNCGRenderAPI>, "categories"_a)
+    .def("getHiddenCategories", &getHiddenCategories<SUNCGRenderAPI>)
+    .def("isSceneCached", &SUNCGRenderAPI::isSceneCached)
     .def("resolution", &SUNCGRenderAPI::resolution)
-    .def("render", &SUNCGRenderAPI::render)
-    .def("renderCubeMap", &SUNCGRenderAPI::renderCubeMap)
+    .def("render", &render<SUNCGRenderAPI>)
+    .def("renderToStack", &SUNCGRenderAPI::renderToStack)
+    .def("renderCubeMap", &renderCubeMap<SUNCGRenderAPI>)
+    .def("renderPanorama", &SUNCGRenderAPI::renderPanorama, "mode"_a, "w"_a, "h"_a, "fov"_a=180.f)
+    .def("renderPointCloud", &SUNCGRenderAPI::renderPointCloud, "voxel_size"_a=0.f, "labels"_a=false)
+    .def("renderWithFlow", &SUNCGRenderAPI::renderWithFlow, "prev_camera"_a)
+    .def("renderTrajectory", &renderTrajectory<SUNCGRenderAPI>, "poses"_a, "modes"_a,
+        "sink"_a=py::none(), "ext"_a="png", "threads"_a=4, "level"_a=-1)
+    .def("enableFrameStats", &SUNCGRenderAPI::enableFrameStats, "enable"_a=true)
+    .def("getFrameStats", &getFrameStats<SUNCGRenderAPI>)
+    .def("getMemoryStats", &getMemoryStats<SUNCGRenderAPI>)
+    .def("getStateCacheStats", &getStateCacheStats<SUNCGRenderAPI>)
+    .def("getLevelOfDetailStats", &getLevelOfDetailStats<SUNCGRenderAPI>)
     .def("getNameFromInstanceColor", &SUNCGRenderAPI::getNameFromInstanceColor)
+    .def("startRecording", &SUNCGRenderAPI::startRecording, "fname"_a)
+    .def("stopRecording", &SUNCGRenderAPI::stopRecording)
       ;
 
 
@@ -48,13 +218,34 @@ PYBIND11_MODULE(objrender, m) {
     .def("setMode", &SUNCGRenderAPIThread::setMode)
     .def("loadSceneSUNCG", &SUNCGRenderAPIThread::loadScene)
     .def("loadScene", &SUNCGRenderAPIThread::loadScene)
+    .def("setSceneCacheCapacity", &SUNCGRenderAPIThread::setSceneCacheCapacity, "capacity"_a)
+    .def("setLevelOfDetail", &SUNCGRenderAPIThread::setLevelOfDetail, "levels"_a, "pixel_error"_a=1.f)
+    .def("setHiddenCategories", &setHiddenCategories<SUNCGRenderAPIThread>, "categories"_a)
+    .def("getHiddenCategories", &getHiddenCategories<SUNCGRenderAPIThread>)
+    .def("isSceneCached", &SUNCGRenderAPIThread::isSceneCached)
     .def("resolution", &SUNCGRenderAPIThread::resolution)
-    .def("render", &SUNCGRenderAPIThread::render)
-    .def("renderCubeMap", &SUNCGRenderAPIThread::renderCubeMap)
+    .def("render", &render<SUNCGRenderAPIThread>)
+    .def("renderToStack", &SUNCGRenderAPIThread::renderToStack)
+    .def("renderCubeMap", &renderCubeMap<SUNCGRenderAPIThread>)
+    .def("renderPanorama", &SUNCGRenderAPIThread::renderPanorama, "mode"_a, "w"_a, "h"_a, "fov"_a=180.f)
+    .def("renderPointCloud", &SUNCGRenderAPIThread::renderPointCloud, "voxel_size"_a=0.f, "labels"_a=false)
+    .def("renderWithFlow", &SUNCGRenderAPIThread::renderWithFlow, "prev_camera"_a)
+    .def("renderTrajectory", &renderTrajectory<SUNCGRenderAPIThread>, "poses"_a, "modes"_a,
+        "sink"_a=py::none(), "ext"_a="png", "threads"_a=4, "level"_a=-1)
+    .def("enableFrameStats", &SUNCGRenderAPIThread::enableFrameStats, "enable"_a=true)
+    .def("getFrameStats", &getFrameStats<SUNCGRenderAPIThread>)
+    .def("getMemoryStats", &getMemoryStats<SUNCGRenderAPIThread>)
+    .def("getStateCacheStats", &getStateCacheStats<SUNCGRenderAPIThread>)
+    .def("getLevelOfDetailStats", &getLevelOfDetailStats<SUNCGRenderAPIThread>)
     .def("getNameFromInstanceColor", &SUNCGRenderAPIThread::getNameFromInstanceColor)
+    .def("startRecording", &SUNCGRenderAPIThread::startRecording, "fname"_a)
+    .def("stopRecording", &SUNCGRenderAPIThread::stopRecording)
       ;
 
   auto camera = py::class_<Camera>(m, "Camera")
+    .def(py::init<glm::vec3, float, float>(), "pos"_a, "yaw"_a=-90.f, "pitch"_a=0.f)
+    // a snapshot of the camera pose, e.g. for renderWithFlow
+    .def("__copy__", [](const Camera& c) { return Camera(c); })
     .def("shift", &Camera::shift)
     .def("turn", &Camera::turn)
     .def("updateDirection", &Camera::updateDirection)
@@ -78,6 +269,14 @@ PYBIND11_MODULE(objrender, m) {
     .value("DEPTH", SUNCGScene::RenderMode::DEPTH)
     .value("INSTANCE", SUNCGScene::RenderMode::INSTANCE)
     .value("INVDEPTH", SUNCGScene::RenderMode::INVDEPTH)
+    .value("NORMAL", SUNCGScene::RenderMode::NORMAL)
+    .value("POSITION", SUNCGScene::RenderMode::POSITION)
+    .value("RGB_FLAT", SUNCGScene::RenderMode::RGB_FLAT)
+    .export_values();
+
+  py::enum_<PanoramaMode>(m, "PanoramaMode")
+    .value("EQUIRECTANGULAR", PanoramaMode::EQUIRECTANGULAR)
+    .value("FISHEYE", PanoramaMode::FISHEYE)
     .export_values();
 
   py::enum_<Camera::Movement>(camera, "Movement")
@@ -89,6 +288,51 @@ PYBIND11_MODULE(objrender, m) {
     .value("Down", Camera::Movement::DOWN)
     .export_values();
 
+  // Profile the rendering code in all threads.
+  // The trace can be opened in chrome://tracing.
+  py::class_<Profiler>(m, "Profiler")
+    .def_static("enable", &Profiler::enable, "enabled"_a=true)
+    .def_static("disable", &Profiler::disable)
+    .def_static("clear", &Profiler::clear)
+    .def_static("setMaxEvents", &Profiler::set_max_events, "n"_a)
+    .def_static("numDropped", &Profiler::num_dropped)
+    .def_static("writeChromeTrace", &Profiler::write_chrome_trace, "fname"_a)
+    .def_static("summary", &Profiler::summary_table);
+
+  // Shader programs loaded from the disk cache, and compiled, by this process.
+  py::class_<ProgramCache>(m, "ProgramCache")
+    .def_static("numHit", &ProgramCache::nr_hit)
+    .def_static("numMiss", &ProgramCache::nr_miss);
+
+  // The pool of image buffers. Frames of the same size reuse released
+  // buffers: "miss" counts the allocations served by the system.
+  py::class_<BufferPool>(m, "BufferPool")
+    .def_static("stats", []() {
+        BufferPool::Stats s = BufferPool::stats();
+        py::dict ret;
+        ret["allocate"] = s.nr_allocate;
+        ret["hit"] = s.nr_allocate - s.nr_system;
+        ret["miss"] = s.nr_system;
+        ret["pooled_bytes"] = s.pooled_bytes;
+        return ret;
+      })
+    .def_static("setLimit", &BufferPool::set_limit, "bytes"_a)
+    .def_static("trim", &BufferPool::trim);
+
+  // Linux cpu lists, as in sysfs and HOUSE3D_CPU_AFFINITY, e.g. "0-3,8".
+  m.def("parseCpuList", [](const std::string& s) {
+      py::list ret;
+      for (int c : parse_cpulist(s))
+        ret.append(c);
+      return ret;
+    }, "cpulist"_a);
+  m.def("formatCpuList", [](py::iterable cpus) {
+      std::vector<int> v;
+      for (auto c : cpus)
+        v.push_back(c.cast<int>());
+      return format_cpulist(v);
+    }, "cpus"_a);
+
   py::class_<House>(m, "_House")
     .def("f", &House::f);
 
@@ -121,4 +365,67 @@ PYBIND11_MODULE(objrender, m) {
           {sizeof(unsigned char) * m.cols() * m.channels(),
           sizeof(unsigned char) * m.channels(), sizeof(unsigned char)});
       });
+
+  py::class_<Mat32f>(m, "Mat32f", py::buffer_protocol()).def_buffer([](Mat32f &m) -> py::buffer_info {
+      return py::buffer_info(m.ptr(),
+          sizeof(float),
+          py::format_descriptor<float>::format(),
+          3,
+          {(unsigned long)m.rows(), (unsigned long)m.cols(),
+          (unsigned long)m.channels()},
+          {sizeof(float) * m.cols() * m.channels(),
+          sizeof(float) * m.channels(), sizeof(float)});
+      });
+
+  // Exposed as a k x c x h x w view of the k most recent frames, oldest first.
+  // The view points into the ring buffer, not to a copy: the next push or
+  // render into the stack overwrites slots of the window it shows.
+  py::class_<FrameStack>(m, "FrameStack", py::buffer_protocol(),
+      "The k most recent frames, as a k x c x h x w buffer, oldest first.\n"
+      "np.array(stack, copy=False) is a live view into the ring buffer, "
+      "valid until the next push or render into the stack. Copy it, e.g. "
+      "with np.array(stack), to keep the frames, and take a new view after "
+      "each push.")
+    .def(py::init<int, int, int, int>(), "Initialize", "k"_a, "h"_a, "w"_a, "c"_a)
+    .def("push", &FrameStack::push)
+    .def("reset", &FrameStack::reset)
+    .def("size", &FrameStack::size)
+    .def_buffer([](FrameStack &s) -> py::buffer_info {
+      size_t c = s.channels();
+      return py::buffer_info(const_cast<unsigned char*>(s.data()),
+          sizeof(unsigned char),
+          py::format_descriptor<unsigned char>::format(),
+          4,
+          {(unsigned long)s.size(), c,
+          (unsigned long)s.rows(), (unsigned long)s.cols()},
+          {sizeof(unsigned char) * s.frame_elements(), sizeof(unsigned char),
+          sizeof(unsigned char) * s.cols() * c, sizeof(unsigned char) * c});
+      });
+
+  // Mat objects returned by render() are queued without a copy; other arrays
+  // are copied first. Waiting for the queue releases the GIL.
+  py::class_<AsyncWriter>(m, "AsyncWriter")
+    .def(py::init<int, int, const std::string&, size_t>(), "Initialize",
+        "threads"_a=4, "capacity"_a=64, "raw_dir"_a="", "shard_bytes"_a=size_t(1) << 30)
+    .def("write", &AsyncWriter::write, "fname"_a, "img"_a, "level"_a=-1,
+        py::call_guard<py::gil_scoped_release>())
+    .def("write", [](AsyncWriter& w, const std::string& fname, py::buffer img, int level) {
+        Matuc mat = toMat(img);
+        py::gil_scoped_release release;
+        w.write(fname, mat, level);
+      }, "fname"_a, "img"_a, "level"_a=-1)
+    .def("writeRaw", &AsyncWriter::writeRaw, "key"_a, "img"_a,
+        py::call_guard<py::gil_scoped_release>())
+    .def("writeRaw", [](AsyncWriter& w, const std::string& key, py::buffer img) {
+        Matuc mat = toMat(img);
+        py::gil_scoped_release release;
+        w.writeRaw(key, mat);
+      }, "key"_a, "img"_a)
+    .def("flush", &AsyncWriter::flush, py::call_guard<py::gil_scoped_release>())
+    .def("stats", [](AsyncWriter& w) {
+        py::dict ret;
+        for (auto& kv : w.stats())
+          ret[py::str(kv.first)] = kv.second;
+        return ret;
+      });
 }
@@ -83,7 +83,7 @@ void RectangleScene::draw() {
 }
 
 RectangleScene::~RectangleScene() {
-    glDeleteVertexArrays(1, &VAO);
+    GLStateCache::deleteVertexArray(VAO);
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &EBO);
 }
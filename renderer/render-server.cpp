@@ -0,0 +1,80 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: render-server.cpp
+
+// Serve renders to client processes over a Unix socket, with a few GL
+// contexts shared by all clients. See suncg/renderServer.hh, and
+// House3D/renderclient.py for the client.
+//
+// Usage:
+//   ./render-server.bin /tmp/house3d.sock --width 120 --height 90
+//     [--device 0] [--contexts 2] [--slots 4] [--cache 0]
+//
+// --contexts: number of GL contexts on the device.
+// --slots: number of frames of each client kept in shared memory.
+// --cache: scene cache capacity of each context, 0 for unlimited.
+
+#include <csignal>
+#include <iostream>
+#include <string>
+
+#include "suncg/renderServer.hh"
+#include "lib/strutils.hh"
+
+using namespace render;
+using namespace std;
+
+namespace {
+
+RenderServer* server = nullptr;
+
+void handle_signal(int) {
+  if (server)
+    server->stop();
+}
+
+[[noreturn]] void usage(const char* prog) {
+  cerr << "Usage: " << prog << " socket --width 120 --height 90 [--device 0]"
+       << " [--contexts 2] [--slots 4] [--cache 0]" << endl;
+  exit(1);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc < 2)
+    usage(argv[0]);
+  string socket_path = argv[1];
+  Geometry geo{0, 0};
+  int device = 0, nr_context = 2, nr_slot = 4, cache = 0;
+  for (int i = 2; i < argc; ++i) {
+    string key = argv[i];
+    if (i + 1 >= argc)
+      usage(argv[0]);
+    int val = stoi(argv[++i]);
+    if (key == "--width") geo.w = val;
+    else if (key == "--height") geo.h = val;
+    else if (key == "--device") device = val;
+    else if (key == "--contexts") nr_context = val;
+    else if (key == "--slots") nr_slot = val;
+    else if (key == "--cache") cache = val;
+    else usage(argv[0]);
+  }
+  if (geo.w <= 0 || geo.h <= 0)
+    usage(argv[0]);
+
+  // a client that exits should not kill the server
+  signal(SIGPIPE, SIG_IGN);
+
+  RenderServer srv{socket_path, geo, device, nr_context, nr_slot, cache};
+  server = &srv;
+  signal(SIGINT, handle_signal);
+  signal(SIGTERM, handle_signal);
+  cout << ssprintf("Serving %dx%d frames on %s with %d contexts on device %d",
+      geo.w, geo.h, socket_path.c_str(), nr_context, device) << endl;
+  srv.serve();
+  server = nullptr;
+}
@@ -0,0 +1,223 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: replay-render.cpp
+
+// Replay a call log written by SUNCGRenderAPI::startRecording (or with
+// HOUSE3D_RECORD=prefix), and report the timing of each kind of call,
+// compared to the recording.
+//
+// Usage:
+//   ./replay-render.bin calls.log [--device 0] [--repeat 1] [--realtime]
+//     [--path-map /old/prefix=/new/prefix] [--trace trace.json]
+//
+// --realtime waits between calls as in the recording, instead of replaying
+// as fast as possible. --path-map rewrites the paths of loaded scenes, to
+// replay on another machine. --trace writes a profile of the replay in the
+// Chrome trace format.
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "suncg/render.hh"
+#include "suncg/recorder.hh"
+#include "lib/profiler.hh"
+#include "lib/stats.hh"
+#include "lib/strutils.hh"
+#include "lib/timer.hh"
+
+using namespace render;
+using namespace std;
+
+namespace {
+
+struct Options {
+  string log_file;
+  int device = 0;
+  int repeat = 1;
+  bool realtime = false;
+  vector<pair<string, string>> path_map;
+  string trace_file;
+};
+
+[[noreturn]] void usage(const char* prog) {
+  cerr << "Usage: " << prog << " calls.log [--device 0] [--repeat 1] [--realtime]"
+       << " [--path-map /old/prefix=/new/prefix] [--trace trace.json]" << endl;
+  exit(1);
+}
+
+Options parse_args(int argc, char* argv[]) {
+  if (argc < 2)
+    usage(argv[0]);
+  Options opt;
+  opt.log_file = argv[1];
+  for (int i = 2; i < argc; ++i) {
+    string key = argv[i];
+    if (key == "--realtime") {
+      opt.realtime = true;
+      continue;
+    }
+    if (i + 1 >= argc)
+      usage(argv[0]);
+    string val = argv[++i];
+    if (key == "--device") {
+      opt.device = stoi(val);
+    } else if (key == "--repeat") {
+      opt.repeat = max(stoi(val), 1);
+    } else if (key == "--path-map") {
+      auto eq = val.find('=');
+      if (eq == string::npos)
+        usage(argv[0]);
+      opt.path_map.emplace_back(val.substr(0, eq), val.substr(eq + 1));
+    } else if (key == "--trace") {
+      opt.trace_file = val;
+    } else {
+      usage(argv[0]);
+    }
+  }
+  return opt;
+}
+
+string map_path(const Options& opt, const string& path) {
+  for (auto& m : opt.path_map)
+    if (path.compare(0, m.first.size(), m.first) == 0)
+      return m.second + path.substr(m.first.size());
+  return path;
+}
+
+struct CallStats {
+  RollingStats recorded{1 << 20}, replayed{1 << 20};
+};
+
+void execute(SUNCGRenderAPI& api, const CallRecord& r, const Options& opt) {
+  using Call = CallRecorder::Call;
+  if (CallRecorder::has_pose(r.call))
+    r.pose.apply(*api.getCamera());
+  switch (r.call) {
+    case Call::LOAD_SCENE:
+      api.loadScene(map_path(opt, r.strings[0]), map_path(opt, r.strings[1]),
+          map_path(opt, r.strings[2]));
+      break;
+    case Call::SET_MODE:
+      api.setMode(static_cast<SUNCGScene::RenderMode>(r.ints[0]));
+      break;
+    case Call::SET_LEVEL_OF_DETAIL:
+      api.setLevelOfDetail(r.ints[0], r.floats[0]);
+      break;
+    case Call::SET_HIDDEN_CATEGORIES:
+      api.setHiddenCategories(r.strings);
+      break;
+    case Call::RENDER:
+      api.render();
+      break;
+    case Call::RENDER_FLOAT:
+      api.renderFloat();
+      break;
+    case Call::RENDER_CUBEMAP:
+      api.renderCubeMap();
+      break;
+    case Call::RENDER_CUBEMAP_FLOAT:
+      api.renderCubeMapFloat();
+      break;
+    case Call::RENDER_PANORAMA:
+      api.renderPanorama(static_cast<PanoramaMode>(r.ints[0]), r.ints[1], r.ints[2], r.floats[0]);
+      break;
+    case Call::RENDER_POINT_CLOUD:
+      api.renderPointCloud(r.floats[0], r.ints[0] != 0);
+      break;
+    case Call::RENDER_WITH_FLOW: {
+      Camera prev = *api.getCamera();
+      r.prev_pose.apply(prev);
+      api.renderWithFlow(prev);
+      break;
+    }
+    case Call::RENDER_TRAJECTORY: {
+      vector<SUNCGScene::RenderMode> modes;
+      for (int i = 1; i <= r.ints[0]; ++i)
+        modes.push_back(static_cast<SUNCGScene::RenderMode>(r.ints[i]));
+      vector<TrajectoryPose> poses;
+      for (size_t i = 0; i + 5 <= r.floats.size(); i += 5)
+        poses.push_back(TrajectoryPose{
+            {r.floats[i], r.floats[i + 1], r.floats[i + 2]}, r.floats[i + 3], r.floats[i + 4]});
+      NullTrajectorySink sink;
+      api.renderTrajectory(poses, modes, sink);
+      break;
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  Options opt = parse_args(argc, argv);
+  vector<CallRecord> records;
+  Geometry geo;
+  {
+    CallLogReader reader{opt.log_file};
+    geo = reader.resolution();
+    CallRecord r;
+    while (reader.next(r))
+      records.push_back(r);
+  }
+  if (records.empty())
+    error_exit(ssprintf("No call in %s\n", opt.log_file.c_str()));
+  // setLevelOfDetail applies to the scenes loaded afterwards
+  for (auto& r : records) {
+    if (r.call == CallRecorder::Call::LOAD_SCENE)
+      break;
+    if (r.call != CallRecorder::Call::SET_LEVEL_OF_DETAIL)
+      error_exit("The log has to start with loadScene\n");
+  }
+  cout << records.size() << " calls at " << geo.w << "x" << geo.h << ", recorded over "
+       << records.back().start << " seconds" << endl;
+
+  SUNCGRenderAPI api(geo.w, geo.h, opt.device);
+  api.printContextInfo();
+  if (!opt.trace_file.empty())
+    Profiler::enable();
+
+  map<string, CallStats> stats;
+  Timer total;
+  for (int rep = 0; rep < opt.repeat; ++rep) {
+    Timer epoch;
+    for (auto& r : records) {
+      if (opt.realtime) {
+        double wait = r.start - epoch.duration();
+        if (wait > 0)
+          this_thread::sleep_for(chrono::duration<double>(wait));
+      }
+      Timer tm;
+      execute(api, r, opt);
+      // make the timing comparable to the synchronous calls in Python
+      glFinish();
+      CallStats& s = stats[CallRecorder::call_name(r.call)];
+      s.replayed.add(tm.duration() * 1e3);
+      s.recorded.add(r.duration_ms);
+    }
+  }
+  double secs = total.duration();
+
+  cout << ssprintf("%-20s %8s %28s %28s\n", "call", "count",
+      "recorded p50/p95/mean(ms)", "replayed p50/p95/mean(ms)");
+  for (auto& kv : stats) {
+    auto& s = kv.second;
+    cout << ssprintf("%-20s %8lld %9.3f/%8.3f/%8.3f %9.3f/%8.3f/%8.3f\n", kv.first.c_str(),
+        s.replayed.total_count(),
+        s.recorded.percentile(50), s.recorded.percentile(95), s.recorded.mean(),
+        s.replayed.percentile(50), s.replayed.percentile(95), s.replayed.mean());
+  }
+  cout << ssprintf("Replayed %d calls in %.3f seconds (recorded: %.3f seconds)\n",
+      (int)(records.size() * opt.repeat), secs, records.back().start * opt.repeat);
+
+  if (!opt.trace_file.empty()) {
+    Profiler::disable();
+    Profiler::write_chrome_trace(opt.trace_file);
+    Profiler::print_summary();
+  }
+}
@@ -28,9 +28,11 @@ class ColorMappingReader final {
       reader_->read_header(io::ignore_extra_column, "name", "r", "g", "b");
       std::string name;
       unsigned int r, g, b;
+      int index = 0;
       while (reader_->read_row(name, r, g, b)) {
         std::transform(name.begin(), name.end(), name.begin(), ::tolower);
         colormap_.emplace(name, glm::vec3{r/255.0, g/255.0, b/255.0});
+        color_to_index_.emplace(r * 256 * 256 + g * 256 + b, index++);
       }
     }
 
@@ -48,10 +50,18 @@ class ColorMappingReader final {
       return colormap_["other"];
     }
 
+    // The 0-based row (excluding the header) of the first class with this
+    // color, or -1 if no class has this color.
+    int get_index(int r, int g, int b) const {
+      auto itr = color_to_index_.find(r * 256 * 256 + g * 256 + b);
+      return itr == color_to_index_.end() ? -1 : itr->second;
+    }
+
     int size() const { return colormap_.size(); }
 
   private:
     std::unordered_map<std::string, glm::vec3> colormap_;
+    std::unordered_map<int, int> color_to_index_;
     std::unique_ptr<io::CSVReader<4>> reader_;
 };
 
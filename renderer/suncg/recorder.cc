@@ -0,0 +1,237 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: recorder.cc
+
+#include "recorder.hh"
+
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+
+#include "lib/strutils.hh"
+
+using namespace std;
+
+namespace {
+
+const char MAGIC[8] = "H3DREC1";
+// Flush after this many records, so that a killed worker still leaves a
+// useful log behind.
+const int FLUSH_INTERVAL = 256;
+
+template <typename T>
+void append(string& buf, const T& v) {
+  buf.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template <typename T>
+T read_value(istream& in) {
+  T v;
+  if (!in.read(reinterpret_cast<char*>(&v), sizeof(T)))
+    throw runtime_error("Truncated call log");
+  return v;
+}
+
+double now() {
+  return chrono::duration<double>(
+      chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+namespace render {
+
+const char* CallRecorder::call_name(Call call) {
+  switch (call) {
+    case Call::LOAD_SCENE: return "loadScene";
+    case Call::SET_MODE: return "setMode";
+    case Call::RENDER: return "render";
+    case Call::RENDER_FLOAT: return "renderFloat";
+    case Call::RENDER_CUBEMAP: return "renderCubeMap";
+    case Call::RENDER_CUBEMAP_FLOAT: return "renderCubeMapFloat";
+    case Call::RENDER_PANORAMA: return "renderPanorama";
+    case Call::RENDER_POINT_CLOUD: return "renderPointCloud";
+    case Call::RENDER_WITH_FLOW: return "renderWithFlow";
+    case Call::RENDER_TRAJECTORY: return "renderTrajectory";
+    case Call::SET_LEVEL_OF_DETAIL: return "setLevelOfDetail";
+    case Call::SET_HIDDEN_CATEGORIES: return "setHiddenCategories";
+  }
+  return "unknown";
+}
+
+CallRecorder::CallRecorder(const string& fname, Geometry geo):
+  fout_{fname, ios::binary}, start_time_{now()} {
+  if (!fout_.good())
+    throw runtime_error(ssprintf("Cannot open %s for recording", fname.c_str()));
+  fout_.write(MAGIC, sizeof(MAGIC));
+  int32_t size[2] = {geo.w, geo.h};
+  fout_.write(reinterpret_cast<const char*>(size), sizeof(size));
+}
+
+CallRecorder::~CallRecorder() {
+  fout_.flush();
+}
+
+CallRecorder::Scope::Scope(CallRecorder* rec, Call call, const Camera* camera):
+  rec_{rec}, call_{call} {
+  if (!rec_)
+    return;
+  outermost_ = rec_->depth_++ == 0;
+  if (outermost_) {
+    start_ = now();
+    if (camera)
+      arg(*camera);
+  }
+}
+
+CallRecorder::Scope::~Scope() {
+  if (!rec_)
+    return;
+  rec_->depth_--;
+  // a call that threw is not replayable
+  if (!outermost_ || std::uncaught_exception())
+    return;
+  string header;
+  append(header, static_cast<uint8_t>(call_));
+  append(header, start_ - rec_->start_time_);
+  append(header, static_cast<float>((now() - start_) * 1e3));
+  rec_->fout_.write(header.data(), header.size());
+  rec_->fout_.write(args_.data(), args_.size());
+  if (++rec_->nr_record_ % FLUSH_INTERVAL == 0)
+    rec_->fout_.flush();
+}
+
+CallRecorder::Scope& CallRecorder::Scope::arg(int32_t v) {
+  if (outermost_)
+    append(args_, v);
+  return *this;
+}
+
+CallRecorder::Scope& CallRecorder::Scope::arg(float v) {
+  if (outermost_)
+    append(args_, v);
+  return *this;
+}
+
+CallRecorder::Scope& CallRecorder::Scope::arg(const string& v) {
+  if (outermost_) {
+    append(args_, static_cast<uint32_t>(v.size()));
+    args_ += v;
+  }
+  return *this;
+}
+
+CallRecorder::Scope& CallRecorder::Scope::arg(const Camera& c) {
+  if (outermost_) {
+    float pose[] = {c.pos.x, c.pos.y, c.pos.z, c.front.x, c.front.y, c.front.z,
+      c.yaw, c.pitch, c.near, c.far, c.vertical_fov};
+    args_.append(reinterpret_cast<const char*>(pose), sizeof(pose));
+  }
+  return *this;
+}
+
+
+void CameraPose::apply(Camera& camera) const {
+  camera.pos = pos;
+  camera.yaw = yaw;
+  camera.pitch = pitch;
+  camera.near = near;
+  camera.far = far;
+  camera.vertical_fov = vertical_fov;
+  camera.front = front;
+  camera.right = glm::normalize(glm::cross(front, camera.up));
+}
+
+
+CallLogReader::CallLogReader(const string& fname): fin_{fname, ios::binary} {
+  if (!fin_.good())
+    throw runtime_error(ssprintf("Cannot open %s", fname.c_str()));
+  char magic[sizeof(MAGIC)];
+  if (!fin_.read(magic, sizeof(magic)) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0)
+    throw runtime_error(ssprintf("%s is not a call log", fname.c_str()));
+  geo_.w = read_value<int32_t>(fin_);
+  geo_.h = read_value<int32_t>(fin_);
+}
+
+bool CallLogReader::next(CallRecord& r) {
+  uint8_t call;
+  if (!fin_.read(reinterpret_cast<char*>(&call), 1))
+    return false;
+  if (call < static_cast<uint8_t>(CallRecorder::Call::LOAD_SCENE) ||
+      call > static_cast<uint8_t>(CallRecorder::Call::SET_HIDDEN_CATEGORIES))
+    throw runtime_error(ssprintf("Invalid call %d in call log", call));
+  r.call = static_cast<CallRecorder::Call>(call);
+  r.start = read_value<double>(fin_);
+  r.duration_ms = read_value<float>(fin_);
+  r.strings.clear();
+  r.ints.clear();
+  r.floats.clear();
+
+  auto read_pose = [&](CameraPose& p) {
+    float v[11];
+    for (float& x : v)
+      x = read_value<float>(fin_);
+    p = CameraPose{{v[0], v[1], v[2]}, {v[3], v[4], v[5]}, v[6], v[7], v[8], v[9], v[10]};
+  };
+  auto read_string = [&]() {
+    uint32_t len = read_value<uint32_t>(fin_);
+    string s(len, '\0');
+    if (!fin_.read(&s[0], len))
+      throw runtime_error("Truncated call log");
+    r.strings.push_back(s);
+  };
+
+  if (CallRecorder::has_pose(r.call))
+    read_pose(r.pose);
+  using Call = CallRecorder::Call;
+  switch (r.call) {
+    case Call::LOAD_SCENE:
+      for (int i = 0; i < 3; ++i)
+        read_string();
+      break;
+    case Call::SET_MODE:
+      r.ints.push_back(read_value<int32_t>(fin_));
+      break;
+    case Call::RENDER_PANORAMA:
+      for (int i = 0; i < 3; ++i)
+        r.ints.push_back(read_value<int32_t>(fin_));
+      r.floats.push_back(read_value<float>(fin_));
+      break;
+    case Call::RENDER_POINT_CLOUD:
+      r.floats.push_back(read_value<float>(fin_));
+      r.ints.push_back(read_value<int32_t>(fin_));
+      break;
+    case Call::SET_LEVEL_OF_DETAIL:
+      r.ints.push_back(read_value<int32_t>(fin_));
+      r.floats.push_back(read_value<float>(fin_));
+      break;
+    case Call::SET_HIDDEN_CATEGORIES: {
+      int n = read_value<int32_t>(fin_);
+      for (int i = 0; i < n; ++i)
+        read_string();
+      break;
+    }
+    case Call::RENDER_WITH_FLOW:
+      read_pose(r.prev_pose);
+      break;
+    case Call::RENDER_TRAJECTORY: {
+      int nr_mode = read_value<int32_t>(fin_);
+      r.ints.push_back(nr_mode);
+      for (int i = 0; i < nr_mode; ++i)
+        r.ints.push_back(read_value<int32_t>(fin_));
+      int nr_pose = read_value<int32_t>(fin_);
+      for (int i = 0; i < nr_pose * 5; ++i)
+        r.floats.push_back(read_value<float>(fin_));
+      break;
+    }
+    default:
+      break;
+  }
+  return true;
+}
+
+}
@@ -0,0 +1,124 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: recorder.hh
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gl/api.hh"
+#include "gl/camera.hh"
+#include "lib/geometry.hh"
+
+namespace render {
+
+// Record the calls to SUNCGRenderAPI into a compact binary log, which
+// replay-render.bin re-executes offline.
+//
+// The log starts with a header (magic "H3DREC1\0", int32 width, int32 height),
+// followed by one record per call:
+//   uint8 call, float64 start time in seconds, float32 duration in ms,
+//   [camera pose,] arguments.
+// Render calls carry the camera pose at the time of the call, because Python
+// moves the camera by writing to it directly. Nested calls (e.g. the six
+// renders of a cube map) are not recorded.
+class CallRecorder {
+  public:
+    enum class Call : uint8_t {
+      LOAD_SCENE = 1,           // string obj, string category, string colormap
+      SET_MODE,                 // int32 mode
+      RENDER,                   // pose
+      RENDER_FLOAT,             // pose
+      RENDER_CUBEMAP,           // pose
+      RENDER_CUBEMAP_FLOAT,     // pose
+      RENDER_PANORAMA,          // pose, int32 mode, int32 w, int32 h, float32 fov
+      RENDER_POINT_CLOUD,       // pose, float32 voxel size, int32 labels
+      RENDER_WITH_FLOW,         // pose, pose of the previous camera
+      RENDER_TRAJECTORY,        // pose, int32 nr_mode, int32 modes,
+                                // int32 nr_pose, float32 x, y, z, yaw, pitch of each pose
+      SET_LEVEL_OF_DETAIL,      // int32 levels, float32 pixel error
+      SET_HIDDEN_CATEGORIES,    // int32 n, n strings
+    };
+
+    static const char* call_name(Call call);
+    static bool has_pose(Call call) {
+      return call >= Call::RENDER && call <= Call::RENDER_TRAJECTORY;
+    }
+
+    CallRecorder(const std::string& fname, Geometry geo);
+    ~CallRecorder();
+    CallRecorder(const CallRecorder&) = delete;
+    CallRecorder& operator = (const CallRecorder&) = delete;
+
+    // Times a call, and writes its record when it returns normally.
+    // Calls within another call are ignored.
+    class Scope {
+      public:
+        // rec may be null, then nothing is recorded.
+        Scope(CallRecorder* rec, Call call, const Camera* camera = nullptr);
+        ~Scope();
+
+        Scope& arg(int32_t v);
+        Scope& arg(float v);
+        Scope& arg(const std::string& v);
+        Scope& arg(const Camera& v);
+
+      private:
+        CallRecorder* rec_;
+        bool outermost_ = false;  // only the outermost call is recorded
+        Call call_;
+        double start_;
+        std::string args_;
+    };
+
+  private:
+    std::ofstream fout_;
+    int depth_ = 0;           // number of active scopes
+    int nr_record_ = 0;
+    double start_time_;
+};
+
+
+// A camera pose, as recorded.
+struct CameraPose {
+  glm::vec3 pos, front;
+  float yaw, pitch, near, far, vertical_fov;
+
+  // Restore the pose, including a front that is inconsistent with yaw and
+  // pitch because they were modified without updateDirection().
+  void apply(Camera& camera) const;
+};
+
+// A recorded call.
+struct CallRecord {
+  CallRecorder::Call call;
+  double start;         // seconds since the recording started
+  float duration_ms;
+  CameraPose pose, prev_pose;
+  std::vector<std::string> strings;
+  std::vector<int32_t> ints;
+  std::vector<float> floats;
+};
+
+// Read a log written by CallRecorder.
+class CallLogReader {
+  public:
+    explicit CallLogReader(const std::string& fname);
+
+    Geometry resolution() const { return geo_; }
+
+    // Returns false at the end of the log.
+    bool next(CallRecord& record);
+
+  private:
+    std::ifstream fin_;
+    Geometry geo_;
+};
+
+}
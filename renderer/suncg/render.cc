@@ -7,84 +7,412 @@
 
 #include "render.hh"
 
+#include <cstring>
+#include <stdexcept>
+
 #include "gl/fbScope.hh"
+#include "gl/pointcloud.hh"
 #include "lib/imgproc.hh"
+#include "lib/parallel.hh"
+#include "lib/profiler.hh"
+#include "lib/strutils.hh"
 
 namespace render {
 
+void depth_to_2channel(const Matuc& buf, Matuc& dst) {
+  PROFILE_ZONE("depth_to_2channel");
+  fill(dst, (unsigned char)0);
+  for (int i = 0; i < buf.height(); ++i) {
+    unsigned char* destptr = dst.ptr(i);
+    for (int j = 0; j < buf.width(); ++j) {
+      const unsigned char* ptr = buf.ptr(i, j);
+      if (ptr[0] == ptr[1] and ptr[1] == ptr[2])
+        destptr[j * 2] = ptr[0];
+      else
+        destptr[j * 2 + 1] = 255;
+    }
+  }
+}
+
 
 Matuc SUNCGRenderAPI::render() {
+  Matuc ret{geo_.h, geo_.w, numChannels()};
+  renderTo(ret);
+  return ret;
+}
+
+
+void SUNCGRenderAPI::renderTo(Matuc& dst) {
+  if (dst.rows() != geo_.h || dst.cols() != geo_.w || dst.channels() != numChannels())
+    throw std::runtime_error(ssprintf(
+          "Output buffer has shape %dx%dx%d, expect %dx%dx%d",
+          dst.rows(), dst.cols(), dst.channels(), geo_.h, geo_.w, numChannels()));
+  if (isFloatMode())
+    throw std::runtime_error("Use renderFloat() for NORMAL and POSITION modes");
+  CallRecorder::Scope rec{recorder_.get(), CallRecorder::Call::RENDER, camera_.get()};
+  PROFILE_ZONE("SUNCGRenderAPI::render");
+  FrameStats* stats = frame_stats_.get();
+  if (stats) {
+    stats->beginFrame();
+    stats->beginGPU();
+  }
   FramebufferScope fb{fb_};
+  draw_(camera_->getCameraMatrix(geo_), geo_);
+  if (stats) {
+    stats->endGPU();
+    stats->mark(FrameStats::DRAW);
+  }
+
+  Matuc rgba = fb.readRGBA();
+  if (stats)
+    stats->mark(FrameStats::READBACK);
+
+  postprocess_(rgba, scene_->get_mode(), dst);
+  if (stats) {
+    stats->mark(FrameStats::POSTPROCESS);
+    stats->endFrame();
+  }
+}
+
+
+void SUNCGRenderAPI::postprocess_(const Matuc& rgba, SUNCGScene::RenderMode mode, Matuc& dst) {
+  if (mode == SUNCGScene::RenderMode::DEPTH) {
+    Matuc buf{geo_.h, geo_.w, 3};
+    rgba_to_rgb_vflip(rgba, buf);
+    depth_to_2channel(buf, dst);
+  } else {
+    rgba_to_rgb_vflip(rgba, dst);
+  }
+}
+
+
+void SUNCGRenderAPI::renderTrajectory(const std::vector<TrajectoryPose>& poses,
+    const std::vector<SUNCGScene::RenderMode>& modes, TrajectorySink& sink) {
+  for (auto m : modes)
+    if (SUNCGScene::is_float_mode(m))
+      throw std::runtime_error("renderTrajectory() does not support NORMAL and POSITION modes");
+  CallRecorder::Scope rec{recorder_.get(), CallRecorder::Call::RENDER_TRAJECTORY, camera_.get()};
+  rec.arg(static_cast<int32_t>(modes.size()));
+  for (auto m : modes)
+    rec.arg(static_cast<int32_t>(m));
+  rec.arg(static_cast<int32_t>(poses.size()));
+  for (auto& p : poses)
+    rec.arg(p.pos.x).arg(p.pos.y).arg(p.pos.z).arg(p.yaw).arg(p.pitch);
+  PROFILE_ZONE("SUNCGRenderAPI::renderTrajectory");
+
+  // 3 frames in flight hide the readback latency, see AsyncReadback
+  if (!readback_)
+    readback_.reset(new AsyncReadback{geo_, 3});
+  int nr_mode = modes.size();
+  auto deliver = [&]() {
+    int tag = readback_->front_tag();
+    int pose = tag / nr_mode, mode = tag % nr_mode;
+    Matuc dst = sink.frame(pose, mode);
+    m_assert(dst.rows() == geo_.h && dst.cols() == geo_.w &&
+        dst.channels() == SUNCGScene::num_channels(modes[mode]));
+    postprocess_(readback_->map(), modes[mode], dst);
+    readback_->pop();
+    sink.commit(pose, mode, dst);
+  };
+
+  auto prev_mode = scene_->get_mode();
+  sink.begin(poses.size(), modes, geo_);
+  try {
+    FramebufferScope fb{fb_};
+    for (size_t i = 0; i < poses.size(); ++i) {
+      camera_->pos = poses[i].pos;
+      camera_->yaw = poses[i].yaw;
+      camera_->pitch = poses[i].pitch;
+      camera_->updateDirection();
+      glm::mat4 projection = camera_->getCameraMatrix(geo_);
+      for (int m = 0; m < nr_mode; ++m) {
+        if (readback_->full())
+          deliver();
+        scene_->set_mode(modes[m]);
+        draw_(projection, geo_);
+        readback_->start(i * nr_mode + m);
+      }
+    }
+    while (!readback_->empty())
+      deliver();
+  } catch (...) {
+    while (!readback_->empty())
+      readback_->pop();
+    scene_->set_mode(prev_mode);
+    throw;
+  }
+  scene_->set_mode(prev_mode);
+  sink.end();
+}
+
+
+void SUNCGRenderAPI::enableFrameStats(bool enable) {
+  if (enable)
+    frame_stats_.reset(new FrameStats);
+  else
+    frame_stats_.reset();
+}
+
+
+std::map<std::string, std::map<std::string, double>> SUNCGRenderAPI::getFrameStats() {
+  if (!frame_stats_)
+    return {};
+  return frame_stats_->summary();
+}
+
+
+Mat32f SUNCGRenderAPI::renderFloat() {
+  if (!isFloatMode())
+    throw std::runtime_error("renderFloat() only supports NORMAL and POSITION modes");
+  CallRecorder::Scope rec{recorder_.get(), CallRecorder::Call::RENDER_FLOAT, camera_.get()};
+  PROFILE_ZONE("SUNCGRenderAPI::renderFloat");
+  if (!float_fb_)
+    float_fb_.reset(new Framebuffer{geo_, GL_RGBA32F});
+  FrameStats* stats = frame_stats_.get();
+  if (stats) {
+    stats->beginFrame();
+    stats->beginGPU();
+  }
+  FramebufferScope fb{*float_fb_};
+  draw_(camera_->getCameraMatrix(geo_), geo_);
+  if (stats) {
+    stats->endGPU();
+    stats->mark(FrameStats::DRAW);
+  }
+
+  Mat32f ret = fb.captureFloat(3);
+  if (stats) {
+    // the vertical flip is part of the readback, there is no postprocess
+    stats->mark(FrameStats::READBACK);
+    stats->endFrame();
+  }
+  return ret;
+}
+
+
+std::pair<Matuc, Mat32f> SUNCGRenderAPI::renderWithFlow(const Camera& prev) {
+  if (isFloatMode())
+    throw std::runtime_error("renderWithFlow() does not support NORMAL and POSITION modes");
+  CallRecorder::Scope rec{recorder_.get(), CallRecorder::Call::RENDER_WITH_FLOW, camera_.get()};
+  rec.arg(prev);
+  if (!flow_fb_)
+    flow_fb_.reset(new Framebuffer{geo_, GL_RGBA8, GL_RG16F});
+
+  Shader* shader = scene_->get_shader();
+  shader->use();
+  shader->setInt("flowEnabled", 1);
+  shader->setMat4("prevProjection", prev.getCameraMatrix(geo_));
+  shader->setVec2("viewportSize", glm::vec2(geo_.w, geo_.h));
+
+  Matuc img{geo_.h, geo_.w, numChannels()};
+  Mat32f flow;
+  FrameStats* stats = frame_stats_.get();
+  if (stats) {
+    stats->beginFrame();
+    stats->beginGPU();
+  }
+  {
+    FramebufferScope fb{*flow_fb_};
+    draw_(camera_->getCameraMatrix(geo_), geo_);
+    if (stats) {
+      stats->endGPU();
+      stats->mark(FrameStats::DRAW);
+    }
+    if (scene_->get_mode() == SUNCGScene::RenderMode::DEPTH)
+      depth_to_2channel(fb.capture(), img);
+    else
+      fb.capture(img);
+    flow = fb.captureFloat(2, 1);
+  }
+  if (stats) {
+    // the conversion is part of the readback, there is no postprocess
+    stats->mark(FrameStats::READBACK);
+    stats->endFrame();
+  }
+  shader->setInt("flowEnabled", 0);
+  return std::make_pair(img, flow);
+}
+
+
+void SUNCGRenderAPI::draw_(const glm::mat4& projection, Geometry viewport) {
+  PROFILE_ZONE("SUNCGRenderAPI::draw");
   Shader* shader_ = scene_->get_shader();
   shader_->use();
-  shader_->setMat4("projection", camera_->getCameraMatrix(geo_));
+  shader_->setMat4("projection", projection);
   shader_->setVec3("eye", camera_->pos);
+  if (scene_->num_lod_levels() > 1)
+    scene_->select_lod(projection, viewport.w, viewport.h, lod_pixel_error_);
+  if (scene_->get_mode() == SUNCGScene::RenderMode::RGB) {
+    textures_used_ = true;
+    if (!scene_->textures_loaded()) {
+      GPUMemory::OwnerScope owner{scene_file_};
+      scene_->load_textures();
+    }
+  }
 
   scene_->draw();
+}
 
-  auto buf = fb.capture();
-  if (scene_->get_mode() == SUNCGScene::RenderMode::DEPTH) {
-    Matuc ret(geo_.h, geo_.w, 2);
-    fill(ret, (unsigned char)0);
-    for (int i = 0; i < geo_.h; ++i) {
-      unsigned char* destptr = ret.ptr(i);
-      for (int j = 0; j < geo_.w; ++j) {
-        unsigned char* ptr = buf.ptr(i, j);
-        if (ptr[0] == ptr[1] and ptr[1] == ptr[2])
-          destptr[j * 2] = ptr[0];
-        else
-          destptr[j * 2 + 1] = 255;
-      }
-    }
-    return ret;
-  } else {
-    return buf;
-  }
+
+void SUNCGRenderAPI::renderToStack(FrameStack& stack) {
+  Matuc slot = stack.next_frame();
+  renderTo(slot);
+  stack.commit();
 }
 
 
-Matuc SUNCGRenderAPI::renderCubeMap() {
+template <typename F>
+void SUNCGRenderAPI::renderCubeMapFaces_(F render_face) {
   float prev_fov = camera_->vertical_fov;
   float prev_pitch = camera_->pitch;
   camera_->pitch = 0.f;
   camera_->vertical_fov = 90.f;
 
   // Start with back view
-  std::vector<Matuc> faces;
   camera_->turn(180.f, 0.f);
-  faces.push_back(render());
+  render_face();
 
   // Render left, front, and right views
   for (int i = 1; i < 4; i++) {
     camera_->turn(90.f, 0.f);
-    faces.push_back(render());
+    render_face();
   }
   camera_->turn(-90.f, 0.f);
 
   // Render the top and bottom views
   camera_->turn(0.f, 89.f);
-  faces.push_back(render());
+  render_face();
 
   camera_->turn(0.f, 2 * -89.f);
-  faces.push_back(render());
+  render_face();
 
   // Reset camera
   camera_->vertical_fov = prev_fov;
   camera_->pitch = prev_pitch;
   camera_->updateDirection();
+}
+
 
-  return hconcat(faces);
+Matuc SUNCGRenderAPI::renderCubeMap() {
+  CallRecorder::Scope rec{recorder_.get(), CallRecorder::Call::RENDER_CUBEMAP, camera_.get()};
+  Matuc ret{geo_.h, geo_.w * 6, numChannels()}, face{geo_.h, geo_.w, numChannels()};
+  int idx = 0;
+  renderCubeMapFaces_([&]() {
+    this->renderTo(face);
+    copy_cols(face, ret, geo_.w * idx++);
+  });
+  return ret;
+}
+
+
+Mat32f SUNCGRenderAPI::renderCubeMapFloat() {
+  CallRecorder::Scope rec{recorder_.get(), CallRecorder::Call::RENDER_CUBEMAP_FLOAT, camera_.get()};
+  Mat32f ret{geo_.h, geo_.w * 6, 3};
+  int idx = 0;
+  renderCubeMapFaces_([&]() { copy_cols(this->renderFloat(), ret, geo_.w * idx++); });
+  return ret;
+}
+
+
+Mat32f SUNCGRenderAPI::renderPointCloud(float voxel_size, bool labels) {
+  PROFILE_ZONE("SUNCGRenderAPI::renderPointCloud");
+  CallRecorder::Scope rec{recorder_.get(), CallRecorder::Call::RENDER_POINT_CLOUD, camera_.get()};
+  rec.arg(voxel_size).arg(static_cast<int32_t>(labels));
+  glm::mat4 camera_matrix = camera_->getCameraMatrix(geo_);
+  // SEMANTIC mode is the cheapest to draw, and gives the labels.
+  auto prev_mode = scene_->get_mode();
+  scene_->set_mode(SUNCGScene::RenderMode::SEMANTIC);
+  Mat32f depth;
+  Matuc semantic;
+  {
+    FramebufferScope fb{fb_};
+    draw_(camera_matrix, geo_);
+    depth = fb.captureDepth();
+    if (labels)
+      semantic = fb.capture();
+  }
+  scene_->set_mode(prev_mode);
+
+  if (!labels)
+    return depth_to_point_cloud(depth, nullptr, glm::inverse(camera_matrix), voxel_size);
+
+  Mat<int> label_img{geo_.h, geo_.w, 1};
+  parallel_for(geo_.h, 16, [&](int begin, int end) {
+    // colors come in large patches: cache the last lookup
+    int last_key = -1, last_label = -1;
+    for (int i = begin; i < end; ++i) {
+      const unsigned char* c = semantic.ptr(i);
+      int* l = label_img.ptr(i);
+      for (int j = 0; j < geo_.w; ++j, c += 3) {
+        int key = (c[0] << 16) | (c[1] << 8) | c[2];
+        if (key != last_key) {
+          last_key = key;
+          last_label = scene_->get_class_index_from_color(c[0], c[1], c[2]);
+        }
+        l[j] = last_label;
+      }
+    }
+  });
+  return depth_to_point_cloud(depth, &label_img, glm::inverse(camera_matrix), voxel_size);
+}
+
+
+Matuc SUNCGRenderAPI::renderPanorama(PanoramaMode mode, int w, int h, float fov) {
+  if (w <= 0 || h <= 0)
+    throw std::runtime_error(ssprintf("Invalid panorama size %dx%d", w, h));
+  if (isFloatMode())
+    throw std::runtime_error("renderPanorama() does not support NORMAL and POSITION modes");
+  CallRecorder::Scope rec{recorder_.get(), CallRecorder::Call::RENDER_PANORAMA, camera_.get()};
+  rec.arg(static_cast<int32_t>(mode)).arg(static_cast<int32_t>(w))
+    .arg(static_cast<int32_t>(h)).arg(fov);
+  if (!panorama_)
+    panorama_.reset(new PanoramaRenderer);
+
+  auto render_mode = scene_->get_mode();
+  bool nearest = render_mode != SUNCGScene::RenderMode::RGB &&
+    render_mode != SUNCGScene::RenderMode::RGB_FLAT;
+  // Uncovered pixels: black, which is infinitely far in INVDEPTH mode.
+  // In DEPTH mode, infinity is marked by a non-gray color.
+  glm::vec3 background{0.f, 0.f, 0.f};
+  auto values = PanoramaValues::COLOR;
+  if (render_mode == SUNCGScene::RenderMode::DEPTH) {
+    background = glm::vec3{1.f, 0.f, 0.f};
+    values = PanoramaValues::DEPTH;
+  } else if (render_mode == SUNCGScene::RenderMode::INVDEPTH) {
+    values = PanoramaValues::INVDEPTH;
+  }
+
+  Matuc buf = panorama_->render(*camera_, Geometry{w, h}, mode, fov, nearest,
+      values, background, [this](const glm::mat4& projection, Geometry viewport) {
+        this->draw_(projection, viewport);
+      });
+  glViewport(0, 0, geo_.w, geo_.h);
+
+  if (render_mode == SUNCGScene::RenderMode::DEPTH) {
+    Matuc ret{h, w, 2};
+    depth_to_2channel(buf, ret);
+    return ret;
+  }
+  return buf;
 }
 
 void SUNCGRenderAPI::loadScene(
     std::string obj_file, std::string model_category_file,
     std::string semantic_label_file) {
+  PROFILE_ZONE("SUNCGRenderAPI::loadScene");
+  CallRecorder::Scope rec{recorder_.get(), CallRecorder::Call::LOAD_SCENE};
+  rec.arg(obj_file).arg(model_category_file).arg(semantic_label_file);
+  // GPU memory allocated by the scene is accounted to its obj file
+  GPUMemory::OwnerScope owner{obj_file};
   // check cache for previously loaded scenes
   scene_ = dynamic_cast<SUNCGScene*>(scene_cache_.get(obj_file));
-  if (!scene_) {
-    scene_ = new SUNCGScene{obj_file, model_category_file, semantic_label_file};
+  if (!scene_ || scene_->num_lod_levels() != lod_levels_) {
+    // textures are decoded on the first draw in RGB mode, unless it was used before
+    scene_ = new SUNCGScene{obj_file, model_category_file, semantic_label_file,
+      lod_levels_, textures_used_};
     scene_cache_.put(obj_file, scene_);
   }
+  scene_file_ = obj_file;
   init_camera_();
 }
 
@@ -6,11 +6,16 @@
 //File: render.hh
 
 #pragma once
+#include <atomic>
+#include <cstdlib>
+#include <map>
 #include <string>
 #include <memory>
 #include <utility>
 #include <future>
 #include <queue>
+#include <stdexcept>
+#include <unistd.h>
 #include <glm/glm.hpp>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/component_wise.hpp>
@@ -19,11 +24,24 @@
 #include "gl/fbScope.hh"
 #include "gl/glContext.hh"
 #include "gl/camera.hh"
+#include "gl/frameStats.hh"
+#include "gl/memoryStats.hh"
+#include "gl/stateCache.hh"
+#include "gl/panorama.hh"
+#include "gl/readback.hh"
+#include "recorder.hh"
+#include "trajectory.hh"
 #include "model/scenecache.hh"
 #include "lib/executor.hh"
+#include "lib/framestack.hh"
+#include "lib/strutils.hh"
 
 namespace render {
 
+// Convert a captured h x w x 3 image in DEPTH mode to the h x w x 2 output
+// of DEPTH mode.
+void depth_to_2channel(const Matuc& buf, Matuc& dst);
+
 // An instance of this class has to be created and used in the same thread.
 // If not, use SUNCGRenderAPIThread.
 class SUNCGRenderAPI {
@@ -32,10 +50,14 @@ class SUNCGRenderAPI {
       : context_(render::createHeadlessContext(Geometry{w, h}, device)),
       geo_{w, h}, fb_{geo_} {
         // enable the common context options
-        glEnable(GL_DEPTH_TEST);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glEnable(GL_CULL_FACE);
+        GLStateCache::enable(GL_DEPTH_TEST);
+        GLStateCache::enable(GL_BLEND);
+        GLStateCache::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        GLStateCache::enable(GL_CULL_FACE);
+        // Record every instance of a process, e.g. a Python worker,
+        // without changing its code.
+        if (const char* prefix = getenv("HOUSE3D_RECORD"))
+          startRecording(ssprintf("%s.%d.%d", prefix, getpid(), next_instance_id_()));
       }
 
     // Load the scene objects to GPU, and unload current scene if it exists.
@@ -46,13 +68,63 @@ class SUNCGRenderAPI {
         std::string obj_file, std::string model_category_file,
         std::string semantic_label_file);
 
-    void setMode(SUNCGScene::RenderMode m) { scene_->set_mode(m); }
+    // Keep at most `capacity` loaded scenes (including the current one) in
+    // the cache, and evict the least recently used ones. 0 means unlimited,
+    // which is the default.
+    void setSceneCacheCapacity(int capacity) { scene_cache_.set_capacity(capacity); }
+
+    // Build `levels` - 1 simplified versions of each mesh of the scenes
+    // loaded afterwards, each with about a quarter of the faces of the
+    // previous one, and draw each mesh at the coarsest level whose error is
+    // at most `pixel_error` pixels on screen. The levels are built in parallel
+    // when the scene is loaded. Cached scenes with another number of levels
+    // are loaded again. levels = 1, the default, disables it.
+    void setLevelOfDetail(int levels, float pixel_error = 1.f) {
+      CallRecorder::Scope rec{recorder_.get(), CallRecorder::Call::SET_LEVEL_OF_DETAIL};
+      rec.arg(static_cast<int32_t>(levels)).arg(pixel_error);
+      lod_levels_ = std::max(levels, 1);
+      lod_pixel_error_ = pixel_error;
+    }
+
+    // Do not draw the objects of these classes in the current scene, until
+    // called again. Names are coarse or fine classes of
+    // ModelCategoryMapping.csv (case-insensitive), e.g. {"chair", "plant"},
+    // or "wall", "floor", "ceiling", "ground". Each scene in the cache keeps
+    // its own list. Throws std::runtime_error if no scene is loaded.
+    void setHiddenCategories(const std::vector<std::string>& categories) {
+      SUNCGScene& scene = current_scene_();
+      CallRecorder::Scope rec{recorder_.get(), CallRecorder::Call::SET_HIDDEN_CATEGORIES};
+      rec.arg(static_cast<int32_t>(categories.size()));
+      for (auto& c : categories)
+        rec.arg(c);
+      scene.set_hidden_categories(categories);
+    }
+    // The lower-case names set by setHiddenCategories().
+    std::vector<std::string> getHiddenCategories() const {
+      return current_scene_().get_hidden_categories();
+    }
+
+    // Whether loadScene(obj_file, ...) would be served from the cache.
+    bool isSceneCached(const std::string& obj_file) const {
+      return scene_cache_.contains(obj_file);
+    }
+
+    void setMode(SUNCGScene::RenderMode m) {
+      CallRecorder::Scope rec{recorder_.get(), CallRecorder::Call::SET_MODE};
+      rec.arg(static_cast<int32_t>(m));
+      scene_->set_mode(m);
+    }
 
     // Render the image. The return format depends on the rendering mode, which
     // is set with the method above:
     //
     // For RGB mode, returns a 3-channel RGB image of the rendered scene.
     //
+    // RGB_FLAT mode is RGB with the diffuse color of each material instead
+    //  of its texture. Textures are only decoded and uploaded when a scene is
+    //  first drawn in RGB mode, so scenes rendered without RGB load faster
+    //  and use no texture memory.
+    //
     // For SEMANTIC mode, returns a 3-channel image.
     //  The mapping from color to class is in the CSV.
     //
@@ -79,12 +151,145 @@ class SUNCGRenderAPI {
     //    NEAR = 0.3 # has to match minDepth parameter
     //    depth = NEAR * PIXEL_MAX / inverse_depth_16.astype(np.float)
     //
+    // NORMAL and POSITION modes render floating point values and have to
+    // use renderFloat() instead.
     Matuc render();
 
+    // Render the image in NORMAL or POSITION mode.
+    //
+    // For NORMAL mode, returns a 3-channel float image of unit surface normals
+    //  in world coordinates.
+    // For POSITION mode, returns a 3-channel float image of the world
+    //  coordinates of each pixel.
+    // Pixels without any object are (0, 0, 0).
+    Mat32f renderFloat();
+
+    // Whether the current mode has to be rendered by renderFloat().
+    bool isFloatMode() const {
+      return SUNCGScene::is_float_mode(scene_->get_mode());
+    }
+
+    // Same as render(), but write the image to an existing buffer of size
+    // h * w * c, where c = numChannels().
+    void renderTo(Matuc& dst);
+
+    // Render the image directly into the next slot of the frame stack.
+    // The stack must have the same resolution and number of channels as
+    // the images returned by render().
+    void renderToStack(FrameStack& stack);
+
+    // Number of channels of the image returned by render(), in the current mode.
+    int numChannels() const {
+      return SUNCGScene::num_channels(scene_->get_mode());
+    }
+
+    // Collect the timing of each phase of render(), renderTo(),
+    // renderToStack(), renderFloat() and renderWithFlow(), and of each face
+    // of the cube maps. renderTrajectory() overlaps the phases of several
+    // frames, and renderPanorama() and renderPointCloud() do not fit these
+    // phases, so they are not timed.
+    // Enabling it again resets the statistics.
+    // When disabled (the default), there is no overhead.
+    void enableFrameStats(bool enable = true);
+
+    // Rolling statistics over the recent frames, in milliseconds:
+    // {phase: {"p50", "p90", "p95", "p99", "mean", "count"}}, where phase is one of
+    // "draw" (CPU submission), "gpu" (GPU execution), "readback" (glReadPixels),
+    // "postprocess" (CPU conversion, none in renderFloat() and renderWithFlow())
+    // and "total". "gpu" also has "discarded" (warm-up measurements) and
+    // "stalls" (waits for the GPU because too many frames were in flight).
+    // Returns an empty map if not enabled.
+    std::map<std::string, std::map<std::string, double>> getFrameStats();
+
+    // The GPU memory allocated by this thread, in bytes:
+    // {owner: {"vertex_buffer", "texture", "framebuffer", "total", "peak", "objects"}},
+    // where owner is the obj file of a scene, "renderer" for the framebuffers,
+    // or "total". "peak" is the high-water mark of "total". Scenes in the
+    // cache are not resident on the GPU, and have a total of 0.
+    // Sizes are computed from the requested formats, e.g. 3 bytes per pixel
+    // for RGB textures, and exclude any padding by the driver.
+    std::map<std::string, std::map<std::string, double>> getMemoryStats() const {
+      return GPUMemory::summary();
+    }
+
+    // The number of GL state changes issued by this thread, and of redundant
+    // ones that were skipped: {call: {"issued", "elided"}}. See GLStateCache.
+    std::map<std::string, std::map<std::string, double>> getStateCacheStats() const {
+      return GLStateCache::summary();
+    }
+
+    // The levels of detail of the current scene, as selected for the last
+    // draw, e.g. the last face of a cube map: {"meshes", "meshes_with_lod",
+    // "mean_level", "full_triangles", "drawn_triangles"}. The triangle counts
+    // exclude hidden categories. See setLevelOfDetail().
+    std::map<std::string, double> getLevelOfDetailStats() const {
+      MeshBatch::LODStats s = current_scene_().lod_stats();
+      return {{"meshes", s.nr_mesh}, {"meshes_with_lod", s.nr_mesh_with_lod},
+              {"mean_level", s.mean_level}, {"full_triangles", s.full_triangles},
+              {"drawn_triangles", s.drawn_triangles}};
+    }
+
     // Render a cube map of size 6w * h * c.  See render() for rendering details.
     // Cube map orientations are { BACK, LEFT, FORWARD, RIGHT, UP, DOWN }
     Matuc renderCubeMap();
 
+    // Render a cube map in NORMAL or POSITION mode.
+    Mat32f renderCubeMapFloat();
+
+    // Render the depth of the current view and unproject it to world
+    // coordinates. Works in any mode, and does not change the mode.
+    //
+    // voxel_size: if positive, downsample the points to one point (the
+    //  centroid) per voxel of this size, in meters.
+    // labels: whether to compute the semantic class of each point.
+    //
+    // Returns a N x 4 float matrix. Each row is (x, y, z, label), where label
+    // is the row index of the class in the semantic label file, or -1 if
+    // labels is false.
+    Mat32f renderPointCloud(float voxel_size = 0.f, bool labels = false);
+
+    // Render the image as render() does, and in the same pass the optical
+    // flow from the previous camera pose `prev`.
+    //
+    // Returns the image and a h x w x 2 float flow image. For each pixel, the
+    // flow is the displacement (dx, dy) in pixels to where the same point
+    // appears in the image rendered from `prev`, with x to the right and y
+    // downwards. The flow is 0 where there is no object, and inf for points
+    // behind the previous camera.
+    // The flow is computed with half floats on the GPU.
+    std::pair<Matuc, Mat32f> renderWithFlow(const Camera& prev);
+
+    // Render each pose of a trajectory in each of `modes`, and pass the frames
+    // to `sink` in order. This is the same as setting the camera pos, yaw and
+    // pitch, calling updateDirection(), and render() in each mode, but the
+    // readback of a frame overlaps with drawing the next ones.
+    // The camera stays at the last pose; the mode is restored.
+    // Float modes are not supported.
+    void renderTrajectory(const std::vector<TrajectoryPose>& poses,
+        const std::vector<SUNCGScene::RenderMode>& modes, TrajectorySink& sink);
+
+    // Render a w x h panorama around the camera. See render() for the format
+    // of each rendering mode.
+    // The scene is rendered into a cube map and resampled on the GPU:
+    // EQUIRECTANGULAR covers 360 x 180 degrees around the camera, ignoring its pitch.
+    // FISHEYE is an equidistant fisheye image along the camera front, with
+    //  field of view `fov` (in degrees) across the shorter side. Pixels outside
+    //  of the image circle have the value of an empty (infinitely far) pixel.
+    // SEMANTIC, INSTANCE and depth modes use nearest sampling, so that
+    // the output only contains valid labels and depths.
+    // DEPTH and INVDEPTH give the (inverse) distance from the camera, instead
+    // of the depth along the view axis as in render(). It matches render()
+    // at the image center, and is continuous across the faces of the cube map.
+    Matuc renderPanorama(PanoramaMode mode, int w, int h, float fov = 180.f);
+
+    // Record the following calls to fname, to be replayed by replay-render.bin.
+    // Setting the environment variable HOUSE3D_RECORD=prefix records every
+    // instance to prefix.<pid>.<index>.
+    void startRecording(const std::string& fname) {
+      recorder_.reset(new CallRecorder{fname, geo_});
+    }
+    void stopRecording() { recorder_.reset(); }
+
     // Print OpenGL context info.
     void printContextInfo() const { context_->printInfo(); }
 
@@ -97,6 +302,10 @@ class SUNCGRenderAPI {
     // Get the resolution.
     Geometry resolution() const { return geo_; }
 
+    // The bounding box of the current scene.
+    glm::vec3 getSceneMin() const { return scene_->get_min(); }
+    glm::vec3 getSceneRange() const { return scene_->get_range(); }
+
     // r, g, b: integer in [0, 255]
     // Returns: an object name defined in the obj file, or "" if not found.
     // For SUNCG data, this object name is usually the "modelId" field
@@ -114,6 +323,41 @@ class SUNCGRenderAPI {
     std::unique_ptr<Camera> camera_;
     Geometry geo_;
     Framebuffer fb_;
+    std::unique_ptr<Framebuffer> float_fb_;  // created on first use
+    std::unique_ptr<Framebuffer> flow_fb_;  // created on first use
+    std::unique_ptr<PanoramaRenderer> panorama_;  // created on first use
+    std::unique_ptr<AsyncReadback> readback_;  // created on first use
+    std::unique_ptr<FrameStats> frame_stats_;  // null if disabled
+    std::unique_ptr<CallRecorder> recorder_;  // null if not recording
+    int lod_levels_ = 1;
+    float lod_pixel_error_ = 1.f;
+    std::string scene_file_;  // obj file of the current scene
+    bool textures_used_ = false;  // whether RGB mode was drawn
+
+    static int next_instance_id_() {
+      static std::atomic<int> id{0};
+      return id++;
+    }
+
+    // scene_, which is null until the first loadScene()
+    SUNCGScene& current_scene_() const {
+      if (!scene_)
+        throw std::runtime_error("Call loadScene() first");
+      return *scene_;
+    }
+
+    // draw the scene into the current framebuffer, whose viewport is
+    // `viewport`: geo_, or the faces of a panorama
+    void draw_(const glm::mat4& projection, Geometry viewport);
+
+    // convert a captured (vertically flipped) RGBA image to the output of
+    // render() in `mode`
+    void postprocess_(const Matuc& rgba, SUNCGScene::RenderMode mode, Matuc& dst);
+
+    // turn the camera towards each face of the cube map and call render_face
+    // (a template, to not allocate a std::function)
+    template <typename F>
+    void renderCubeMapFaces_(F render_face);
 
     // set camera "smartly" to some place in the scene
     void init_camera_() {
@@ -134,6 +378,7 @@ class SUNCGRenderAPIThread {
   public:
     SUNCGRenderAPIThread(int w, int h, int device) {
       exec_.execute_sync([=]() {
+            allow_thread_placement();
             this->api_.reset(new SUNCGRenderAPI{w, h, device});
           });
     }
@@ -163,16 +408,110 @@ class SUNCGRenderAPIThread {
           });
     }
 
+    void setSceneCacheCapacity(int capacity) {
+      exec_.execute_sync([=]() { this->api_->setSceneCacheCapacity(capacity); });
+    }
+
+    void setLevelOfDetail(int levels, float pixel_error = 1.f) {
+      exec_.execute_sync([=]() { this->api_->setLevelOfDetail(levels, pixel_error); });
+    }
+
+    void setHiddenCategories(const std::vector<std::string>& categories) {
+      exec_.execute_sync([&]() { this->api_->setHiddenCategories(categories); });
+    }
+
+    std::vector<std::string> getHiddenCategories() {
+      return exec_.execute_sync<std::vector<std::string>>(
+          [=]() { return this->api_->getHiddenCategories(); });
+    }
+
+    void startRecording(const std::string& fname) {
+      exec_.execute_sync([=]() { this->api_->startRecording(fname); });
+    }
+
+    void stopRecording() {
+      exec_.execute_sync([=]() { this->api_->stopRecording(); });
+    }
+
+    // in the rendering thread, which changes the cache in loadScene()
+    bool isSceneCached(const std::string& obj_file) {
+      return exec_.execute_sync<bool>([&]() { return this->api_->isSceneCached(obj_file); });
+    }
+
     Matuc render() {
       return exec_.execute_sync<Matuc>([=]() { return this->api_->render(); });
     }
 
+    void renderToStack(FrameStack& stack) {
+      exec_.execute_sync([&]() { this->api_->renderToStack(stack); });
+    }
+
     Matuc renderCubeMap() {
       return exec_.execute_sync<Matuc>([=]() {
         return this->api_->renderCubeMap();
       });
     }
 
+    Mat32f renderFloat() {
+      return exec_.execute_sync<Mat32f>([=]() { return this->api_->renderFloat(); });
+    }
+
+    Mat32f renderCubeMapFloat() {
+      return exec_.execute_sync<Mat32f>([=]() {
+        return this->api_->renderCubeMapFloat();
+      });
+    }
+
+    bool isFloatMode() const { return api_->isFloatMode(); }
+
+    void enableFrameStats(bool enable = true) {
+      exec_.execute_sync([=]() { this->api_->enableFrameStats(enable); });
+    }
+
+    std::map<std::string, std::map<std::string, double>> getFrameStats() {
+      return exec_.execute_sync<std::map<std::string, std::map<std::string, double>>>(
+          [=]() { return this->api_->getFrameStats(); });
+    }
+
+    std::map<std::string, std::map<std::string, double>> getMemoryStats() {
+      return exec_.execute_sync<std::map<std::string, std::map<std::string, double>>>(
+          [=]() { return this->api_->getMemoryStats(); });
+    }
+
+    std::map<std::string, std::map<std::string, double>> getStateCacheStats() {
+      return exec_.execute_sync<std::map<std::string, std::map<std::string, double>>>(
+          [=]() { return this->api_->getStateCacheStats(); });
+    }
+
+    std::map<std::string, double> getLevelOfDetailStats() {
+      return exec_.execute_sync<std::map<std::string, double>>(
+          [=]() { return this->api_->getLevelOfDetailStats(); });
+    }
+
+    // The sink is called in the rendering thread.
+    void renderTrajectory(const std::vector<TrajectoryPose>& poses,
+        const std::vector<SUNCGScene::RenderMode>& modes, TrajectorySink& sink) {
+      exec_.execute_sync([&]() { this->api_->renderTrajectory(poses, modes, sink); });
+    }
+
+    Mat32f renderPointCloud(float voxel_size = 0.f, bool labels = false) {
+      return exec_.execute_sync<Mat32f>([=]() {
+        return this->api_->renderPointCloud(voxel_size, labels);
+      });
+    }
+
+    std::pair<Matuc, Mat32f> renderWithFlow(const Camera& prev) {
+      return exec_.execute_sync<std::pair<Matuc, Mat32f>>([=]() {
+        return this->api_->renderWithFlow(prev);
+      });
+    }
+
+    Matuc renderPanorama(PanoramaMode mode, int w, int h, float fov = 180.f) {
+      return exec_.execute_sync<Matuc>([=]() {
+        return this->api_->renderPanorama(mode, w, h, fov);
+      });
+    }
+
     std::string getNameFromInstanceColor(int r, int g, int b) const {
         return this->api_->getNameFromInstanceColor(r, g, b);
     }
@@ -0,0 +1,412 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: renderServer.cc
+
+#include "renderServer.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "recorder.hh"
+#include "lib/affinity.hh"
+#include "lib/profiler.hh"
+#include "lib/strutils.hh"
+
+using namespace std;
+
+namespace {
+
+// larger requests are a protocol error
+const uint32_t MAX_REQUEST_BYTES = 1 << 20;
+
+template <typename T>
+void append(string& buf, const T& v) {
+  buf.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+void append_pose(string& buf, const render::Camera& c) {
+  float pose[] = {c.pos.x, c.pos.y, c.pos.z, c.front.x, c.front.y, c.front.z,
+    c.yaw, c.pitch, c.near, c.far, c.vertical_fov};
+  buf.append(reinterpret_cast<const char*>(pose), sizeof(pose));
+}
+
+// The arguments of a request.
+class Request {
+  public:
+    uint32_t op;
+    string args;
+
+    template <typename T>
+    T get() {
+      T v;
+      if (pos_ + sizeof(T) > args.size())
+        throw runtime_error("Truncated request");
+      memcpy(&v, args.data() + pos_, sizeof(T));
+      pos_ += sizeof(T);
+      return v;
+    }
+
+    string get_string() {
+      uint32_t len = get<uint32_t>();
+      if (pos_ + len > args.size())
+        throw runtime_error("Truncated request");
+      pos_ += len;
+      return args.substr(pos_ - len, len);
+    }
+
+    render::CameraPose get_pose() {
+      float v[11];
+      for (float& x : v)
+        x = get<float>();
+      return render::CameraPose{{v[0], v[1], v[2]}, {v[3], v[4], v[5]},
+        v[6], v[7], v[8], v[9], v[10]};
+    }
+
+    void reset() { pos_ = 0; }
+
+  private:
+    size_t pos_ = 0;
+};
+
+bool read_full(int fd, void* buf, size_t n) {
+  char* p = static_cast<char*>(buf);
+  while (n) {
+    ssize_t r = read(fd, p, n);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return false;
+    p += r;
+    n -= r;
+  }
+  return true;
+}
+
+// Returns false when the client disconnects.
+bool read_request(int fd, Request& req) {
+  uint32_t header[2];
+  if (!read_full(fd, header, sizeof(header)))
+    return false;
+  if (header[1] > MAX_REQUEST_BYTES)
+    return false;
+  req.op = header[0];
+  req.args.resize(header[1]);
+  req.reset();
+  return read_full(fd, &req.args[0], header[1]);
+}
+
+// Send a response, and the file descriptor `pass_fd` if not -1.
+bool send_response(int fd, int32_t status, const string& body, int pass_fd = -1) {
+  string buf;
+  append(buf, status);
+  append(buf, static_cast<uint32_t>(body.size()));
+  buf += body;
+
+  iovec iov{&buf[0], buf.size()};
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  char control[CMSG_SPACE(sizeof(int))];
+  if (pass_fd >= 0) {
+    memset(control, 0, sizeof(control));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &pass_fd, sizeof(int));
+  }
+  ssize_t sent = sendmsg(fd, &msg, 0);
+  if (sent < 0)
+    return false;
+  // the fd is passed with the first byte, send the rest as a stream
+  const char* p = buf.data() + sent;
+  size_t left = buf.size() - sent;
+  while (left) {
+    ssize_t r = write(fd, p, left);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return false;
+    p += r;
+    left -= r;
+  }
+  return true;
+}
+
+// Anonymous shared memory, to be passed to a client.
+class SharedMemory {
+  public:
+    explicit SharedMemory(size_t size): size_{size} {
+      static atomic<int> id{0};
+      string name = ssprintf("/house3d-%d-%d", getpid(), id++);
+      fd_ = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+      if (fd_ < 0)
+        throw runtime_error(ssprintf("shm_open failed: %s", strerror(errno)));
+      // only reachable through the fd
+      shm_unlink(name.c_str());
+      if (ftruncate(fd_, size) != 0) {
+        close(fd_);
+        throw runtime_error(ssprintf("Cannot allocate %zu bytes of shared memory", size));
+      }
+      void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+      if (p == MAP_FAILED) {
+        close(fd_);
+        throw runtime_error(ssprintf("mmap failed: %s", strerror(errno)));
+      }
+      ptr_ = static_cast<unsigned char*>(p);
+    }
+
+    ~SharedMemory() {
+      munmap(ptr_, size_);
+      close(fd_);
+    }
+
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator = (const SharedMemory&) = delete;
+
+    int fd() const { return fd_; }
+    unsigned char* ptr() const { return ptr_; }
+
+  private:
+    size_t size_;
+    int fd_;
+    unsigned char* ptr_;
+};
+
+} // namespace
+
+namespace render {
+
+RenderServer::RenderServer(const string& socket_path, Geometry geo, int device,
+    int nr_context, int nr_slot, int cache_capacity):
+  socket_path_{socket_path}, geo_{geo}, nr_slot_{max(nr_slot, 1)} {
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path))
+    throw runtime_error(ssprintf("Socket path %s is too long", socket_path.c_str()));
+  strcpy(addr.sun_path, socket_path.c_str());
+
+  for (int i = 0; i < max(nr_context, 1); ++i) {
+    contexts_.emplace_back(new Context);
+    Context& ctx = *contexts_.back();
+    ctx.exec.execute_sync([&]() {
+      allow_thread_placement();
+      ctx.api.reset(new SUNCGRenderAPI{geo.w, geo.h, device});
+      ctx.api->setSceneCacheCapacity(cache_capacity);
+    });
+  }
+
+  // remove the socket of a previous server
+  unlink(socket_path.c_str());
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd_ < 0 ||
+      ::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      listen(listen_fd_, 64) != 0)
+    throw runtime_error(ssprintf("Cannot listen on %s: %s",
+          socket_path.c_str(), strerror(errno)));
+}
+
+RenderServer::~RenderServer() {
+  stopped_ = true;
+  // unblock the sessions waiting for requests
+  for (auto& s : sessions_)
+    shutdown(s.fd, SHUT_RDWR);
+  for (auto& s : sessions_) {
+    s.th.join();
+    close(s.fd);
+  }
+  close(listen_fd_);
+  unlink(socket_path_.c_str());
+  for (auto& ctx : contexts_)
+    ctx->exec.execute_sync([&]() { ctx->api.reset(); });
+}
+
+void RenderServer::serve() {
+  while (!stopped_) {
+    pollfd p{listen_fd_, POLLIN, 0};
+    // wake up regularly to check stopped_
+    int r = poll(&p, 1, 200);
+
+    for (auto it = sessions_.begin(); it != sessions_.end(); ) {
+      if (it->done) {
+        it->th.join();
+        close(it->fd);
+        it = sessions_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    if (r <= 0)
+      continue;
+    int fd = accept(listen_fd_, nullptr, nullptr);
+    if (fd < 0)
+      continue;
+    sessions_.emplace_back();
+    Session& s = sessions_.back();
+    s.fd = fd;
+    s.th = thread([this, &s]() { this->session_(s); });
+  }
+}
+
+RenderServer::Context& RenderServer::assign_() {
+  lock_guard<mutex> lg(mutex_);
+  auto it = min_element(contexts_.begin(), contexts_.end(),
+      [](const unique_ptr<Context>& a, const unique_ptr<Context>& b) {
+        return a->nr_client < b->nr_client;
+      });
+  (*it)->nr_client++;
+  return **it;
+}
+
+void RenderServer::release_(Context& ctx) {
+  lock_guard<mutex> lg(mutex_);
+  ctx.nr_client--;
+}
+
+void RenderServer::session_(Session& session) {
+  Profiler::set_thread_name("RenderServer::session");
+  int fd = session.fd;
+  Context* ctx = nullptr;
+  unique_ptr<SharedMemory> shm;
+  string scene[3];
+  bool has_scene = false;
+  int next_slot = 0;
+
+  // switch the context to the scene of this client; in the context thread
+  auto use_scene = [&]() {
+    if (!equal(scene, scene + 3, ctx->scene)) {
+      ctx->api->loadScene(scene[0], scene[1], scene[2]);
+      copy(scene, scene + 3, ctx->scene);
+    }
+  };
+
+  Request req;
+  while (!stopped_ && read_request(fd, req)) {
+    string resp;
+    int pass_fd = -1;
+    try {
+      if (!ctx && req.op != HELLO)
+        throw runtime_error("The first request has to be HELLO");
+      switch (req.op) {
+        case HELLO: {
+          if (ctx)
+            throw runtime_error("Already connected");
+          int w = req.get<int32_t>(), h = req.get<int32_t>();
+          if (w != geo_.w || h != geo_.h)
+            throw runtime_error(ssprintf("The server renders at %dx%d, not %dx%d",
+                  geo_.w, geo_.h, w, h));
+          shm.reset(new SharedMemory{slotBytes() * nr_slot_});
+          ctx = &assign_();
+          append<int32_t>(resp, nr_slot_);
+          append<uint64_t>(resp, slotBytes());
+          pass_fd = shm->fd();
+          break;
+        }
+        case LOAD_SCENE: {
+          string files[3];
+          for (auto& f : files) {
+            f = req.get_string();
+            if (access(f.c_str(), R_OK) != 0)
+              throw runtime_error(ssprintf("Cannot read %s", f.c_str()));
+          }
+          resp = ctx->exec.execute_sync<string>([&]() {
+            ctx->api->loadScene(files[0], files[1], files[2]);
+            copy(files, files + 3, ctx->scene);
+            string ret;
+            append_pose(ret, *ctx->api->getCamera());
+            return ret;
+          });
+          copy(files, files + 3, scene);
+          has_scene = true;
+          break;
+        }
+        case RENDER:
+        case RENDER_CUBEMAP: {
+          PROFILE_ZONE("RenderServer::render");
+          if (!has_scene)
+            throw runtime_error("Call loadScene first");
+          int32_t mode_id = req.get<int32_t>();
+          CameraPose pose = req.get_pose();
+          auto mode = static_cast<SUNCGScene::RenderMode>(mode_id);
+          if (mode_id < 0 || mode_id > static_cast<int>(SUNCGScene::RenderMode::RGB_FLAT))
+            throw runtime_error(ssprintf("Unknown mode %d", mode_id));
+          if (SUNCGScene::is_float_mode(mode))
+            throw runtime_error("Float modes are not supported by the render server");
+          bool cube = req.op == RENDER_CUBEMAP;
+          int rows = geo_.h, cols = geo_.w * (cube ? 6 : 1),
+              channels = SUNCGScene::num_channels(mode);
+          unsigned char* slot = shm->ptr() + next_slot * slotBytes();
+          ctx->exec.execute_sync<int>([&]() {
+            use_scene();
+            ctx->api->setMode(mode);
+            pose.apply(*ctx->api->getCamera());
+            if (cube) {
+              Matuc img = ctx->api->renderCubeMap();
+              memcpy(slot, img.ptr(), img.pixels() * channels);
+            } else {
+              // render directly into the shared memory
+              Matuc dst{rows, cols, channels, shared_ptr<unsigned char>(
+                  shared_ptr<unsigned char>(), slot)};
+              ctx->api->renderTo(dst);
+            }
+            return 0;
+          });
+          for (int32_t v : {next_slot, rows, cols, channels})
+            append(resp, v);
+          next_slot = (next_slot + 1) % nr_slot_;
+          break;
+        }
+        case INSTANCE_NAME: {
+          if (!has_scene)
+            throw runtime_error("Call loadScene first");
+          int r = req.get<int32_t>(), g = req.get<int32_t>(), b = req.get<int32_t>();
+          string name = ctx->exec.execute_sync<string>([&]() {
+            use_scene();
+            return ctx->api->getNameFromInstanceColor(r, g, b);
+          });
+          append(resp, static_cast<uint32_t>(name.size()));
+          resp += name;
+          break;
+        }
+        case CONTEXT_INFO: {
+          lock_guard<mutex> lg(mutex_);
+          int idx = 0;
+          while (contexts_[idx].get() != ctx)
+            idx++;
+          for (int32_t v : {idx, (int)contexts_.size(), ctx->nr_client})
+            append(resp, v);
+          break;
+        }
+        default:
+          throw runtime_error(ssprintf("Unknown request %u", req.op));
+      }
+    } catch (const exception& e) {
+      if (!send_response(fd, 1, e.what()))
+        break;
+      continue;
+    }
+    if (!send_response(fd, 0, resp, pass_fd))
+      break;
+  }
+  if (ctx)
+    release_(*ctx);
+  session.done = true;
+}
+
+} // namespace render
@@ -0,0 +1,107 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: renderServer.hh
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "render.hh"
+#include "lib/executor.hh"
+#include "lib/geometry.hh"
+
+namespace render {
+
+// Renders for client processes, e.g. House3D/renderclient.py, so that many
+// training processes share a few GL contexts instead of owning one each.
+//
+// Clients connect to a Unix socket. Each client is served by the context
+// with the fewest clients at the time it connects, and the clients of a
+// context share its scene cache. The client keeps the camera and the mode,
+// and sends them with every render, so a context only has to switch scenes
+// between clients.
+//
+// Frames are rendered into a ring of `nr_slot` slots in memory shared with
+// the client, which reads them without a copy. A frame stays valid until
+// `nr_slot` more frames are rendered for the same client.
+//
+// Protocol, little-endian, over a SOCK_STREAM socket:
+//   request:  uint32 op, uint32 size, then `size` bytes of arguments.
+//   response: int32 status, uint32 size, then `size` bytes. If status is not
+//             0, the bytes are an error message.
+// A string is a uint32 length and the bytes. A pose is the 11 floats pos,
+// front, yaw, pitch, near, far, vertical_fov of a CameraPose.
+//   HELLO(int32 w, h) -> int32 nr_slot, uint64 slot_bytes. The file
+//     descriptor of the shared memory is passed with SCM_RIGHTS along with
+//     the response. Must be the first request.
+//   LOAD_SCENE(string obj, category, colormap) -> the pose of the initial camera.
+//   RENDER(int32 mode, pose) -> int32 slot, rows, cols, channels.
+//   RENDER_CUBEMAP(int32 mode, pose) -> as RENDER.
+//   INSTANCE_NAME(int32 r, g, b) -> string.
+//   CONTEXT_INFO() -> int32 context, nr_context, nr_client of the context.
+class RenderServer {
+  public:
+    enum Op : uint32_t {
+      HELLO = 1, LOAD_SCENE, RENDER, RENDER_CUBEMAP, INSTANCE_NAME, CONTEXT_INFO
+    };
+
+    // cache_capacity: of the scene cache of each context, 0 for unlimited.
+    RenderServer(const std::string& socket_path, Geometry geo, int device,
+        int nr_context, int nr_slot = 4, int cache_capacity = 0);
+
+    // Disconnects the clients.
+    ~RenderServer();
+
+    RenderServer(const RenderServer&) = delete;
+    RenderServer& operator = (const RenderServer&) = delete;
+
+    // Accept clients until stop() is called.
+    void serve();
+
+    // Can be called from any thread, or a signal handler.
+    void stop() { stopped_ = true; }
+
+    // Bytes of a slot: enough for a cube map of 3 channels.
+    size_t slotBytes() const { return (size_t)geo_.w * geo_.h * 3 * 6; }
+
+  private:
+    struct Context {
+      ExecutorInThread exec;
+      std::unique_ptr<SUNCGRenderAPI> api;  // created and used in exec
+      std::string scene[3];  // the arguments of the loaded scene
+      int nr_client = 0;     // guarded by RenderServer::mutex_
+    };
+
+    struct Session {
+      int fd;
+      std::thread th;
+      std::atomic_bool done{false};
+    };
+
+    // serve a client until it disconnects
+    void session_(Session& session);
+    Context& assign_();
+    void release_(Context& ctx);
+
+    std::string socket_path_;
+    Geometry geo_;
+    int nr_slot_;
+    int listen_fd_ = -1;
+    std::atomic_bool stopped_{false};
+
+    std::vector<std::unique_ptr<Context>> contexts_;
+    std::mutex mutex_;
+    std::list<Session> sessions_;  // only used by serve()
+};
+
+} // namespace render
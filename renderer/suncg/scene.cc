@@ -9,7 +9,12 @@
 #include "model/shader.hh"
 
 #include "category.hh"
+#include "gl/memoryStats.hh"
+#include "lib/parallel.hh"
+#include "lib/profiler.hh"
 
+#include <algorithm>
+#include <cstdlib>
 #include <stdexcept>
 
 using namespace std;
@@ -41,13 +46,41 @@ std::vector<glm::vec3> get_uniform_sampled_colors(int count) {
 
 namespace render {
 
+// BasicShader::vShader, and the index of the mesh of each vertex
+const char* SUNCGShader::vShader = R"xxx(
+#version 330 core
+layout (location = 0) in vec3 posIn;
+layout (location = 1) in vec3 normalIn;
+layout (location = 2) in vec2 texcoordIn;
+layout (location = 3) in uint meshIndexIn;
+
+out vec3 pos;
+out vec3 normal;
+out vec2 texcoord;
+flat out uint meshIndex;
+
+uniform mat4 projection;
+
+void main()
+{
+    texcoord = texcoordIn;
+    normal = normalize(normalIn);
+    pos = posIn;
+    meshIndex = meshIndexIn;
+    gl_Position = projection * vec4(posIn, 1.0f);
+}
+)xxx";
+
 const char* SUNCGShader::fShader = R"xxx(
 #version 330 core
 
 in vec3 pos;
 in vec3 normal;
 in vec2 texcoord;
-out vec4 fragcolor;
+flat in uint meshIndex;
+layout (location = 0) out vec4 fragcolor;
+// Optical flow, written to the second color buffer if there is one.
+layout (location = 1) out vec4 flow;
 
 // Note these values need to match DEFAULT_NEAR and DEFAULT_FAR in camera.h
 const float NEAR = 0.1f;
@@ -61,12 +94,24 @@ uniform uint mode;
 // 1: light
 // 2: const Kd
 // 3: depth
+// 4: inverse depth
+// 5: normal
+// 6: position
+// 7: color of the mesh
 uniform vec3 Kd;
 uniform vec3 Ka;
 uniform vec3 eye;
 uniform float dissolve;
 uniform sampler2D texture_diffuse;
 uniform float minDepth = NEAR;
+uniform samplerBuffer meshColors;
+uniform int meshColorOffset;
+
+// optical flow to the previous camera
+uniform bool flowEnabled = false;
+uniform mat4 prevProjection;
+uniform vec2 viewportSize;
+const float FLOW_INF = 1e30f;
 
 // Convert depth buffer value to inverse depth.
 // The depth buffer value <d> is 0.0 for INV_NEAR, 1.0 for INV_FAR.
@@ -80,10 +125,27 @@ float TrueDepth(float d) {
 }
 
 void main() {
+    if (flowEnabled) {
+      // where this point was seen by the previous camera, in pixels
+      vec4 prev = prevProjection * vec4(pos, 1.0f);
+      if (prev.w > 0.0f) {
+        vec2 prevCoord = (prev.xy / prev.w * 0.5f + 0.5f) * viewportSize;
+        vec2 d = prevCoord - gl_FragCoord.xy;
+        // image rows go downwards
+        flow = vec4(d.x, -d.y, 0.0f, 1.0f);
+      } else {  // behind the previous camera
+        flow = vec4(FLOW_INF, FLOW_INF, 0.0f, 1.0f);
+      }
+    }
+
     if (mode == 2u) { // constant
       fragcolor = vec4(Kd, 1.0f);
       return;
     }
+    else if (mode == 7u) { // mesh color
+      fragcolor = vec4(texelFetch(meshColors, meshColorOffset + int(meshIndex)).rgb, 1.0f);
+      return;
+    }
     else if (mode == 3u) { // depth
       float scaledDepth = TrueDepth(gl_FragCoord.z) / DEPTH_SCALE;
       fragcolor = vec4(vec3(scaledDepth), 1.0f);
@@ -99,6 +161,14 @@ void main() {
       fragcolor = vec4(ms/255.0f, ls/255.0f, 0.0f, 1.0f);
       return;
     }
+    else if (mode == 5u) { // normal
+      fragcolor = vec4(normalize(normal), 1.0f);
+      return;
+    }
+    else if (mode == 6u) { // position
+      fragcolor = vec4(pos, 1.0f);
+      return;
+    }
 
     float alpha = dissolve;
     vec3 color;
@@ -124,7 +194,7 @@ void main() {
 )xxx";
 
 SUNCGShader::SUNCGShader():
-  Shader{BasicShader::vShader, fShader} {
+  Shader{vShader, fShader} {
 
   Kd_loc = getUniformLocation("Kd");
   Ka_loc = getUniformLocation("Ka");
@@ -132,17 +202,22 @@ SUNCGShader::SUNCGShader():
   texture_loc = getUniformLocation("texture_diffuse");
   dissolve_loc = getUniformLocation("dissolve");
   minDepth_loc = getUniformLocation("minDepth");
+  meshColors_loc = getUniformLocation("meshColors");
+  meshColorOffset_loc = getUniformLocation("meshColorOffset");
   };
 
 
 SUNCGScene::SUNCGScene(string obj_file, string model_category_file,
-    string semantic_label_file, float minDepth):
+    string semantic_label_file, int lod_levels, bool load_textures, float minDepth):
   ObjSceneBase{obj_file},
-  textures_{obj_.materials, obj_.base_dir},
+  textures_{obj_.materials, obj_.base_dir, load_textures},
   model_category_{model_category_file},
   semantic_color_{semantic_label_file},
-  minDepth_{minDepth}
+  minDepth_{minDepth},
+  lod_levels_{max(lod_levels, 1)}
 {
+    const char* batch = getenv("HOUSE3D_BATCH_DRAW");
+    batched_ = !batch || string(batch) != "0";
     background_color_ = semantic_color_.get_background_color();
 
     // use FINE_GRAINED if color mapping > 128
@@ -161,23 +236,134 @@ SUNCGScene::SUNCGScene(string obj_file, string model_category_file,
 }
 
 void SUNCGScene::activate() {
+  PROFILE_ZONE("SUNCGScene::activate");
   textures_.activate();
   int nr_mesh = mesh_.size();
   m_assert(nr_mesh == (int)materials_.size());
 
+  material_runs_.clear();
   for (int i = 0; i < nr_mesh; ++i) {
     MaterialDesc& material = materials_[i];
     material.texture = textures_.get(material.m->diffuse_texname);
-    mesh_[i].activate();
+    if (i == 0 || material.m != materials_[i - 1].m)
+      material_runs_.push_back(i);
+  }
+  material_runs_.push_back(nr_mesh);
+
+  if (!batched_) {
+    for (auto& m : mesh_)
+      m.activate();
+    return;
   }
+  batch_.activate(mesh_);
+  batch_.set_visible(visible_);
+
+  vector<glm::vec4> colors;
+  for (auto& m : materials_)
+    colors.emplace_back(m.label_color, 1.f);
+  for (auto& m : materials_)
+    colors.emplace_back(m.instance_color, 1.f);
+  size_t bytes = colors.size() * sizeof(glm::vec4);
+  glGenBuffers(1, mesh_color_buffer_);
+  glBindBuffer(GL_TEXTURE_BUFFER, mesh_color_buffer_);
+  glBufferData(GL_TEXTURE_BUFFER, bytes, colors.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  GPUMemory::allocate(GPUMemory::VERTEX_BUFFER, GPUMemory::Object::BUFFER,
+      mesh_color_buffer_, bytes);
+  glGenTextures(1, mesh_color_texture_);
+  GLStateCache::activeTexture(GL_TEXTURE1);
+  GLStateCache::bindTexture(GL_TEXTURE_BUFFER, mesh_color_texture_);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, mesh_color_buffer_);
+  GLStateCache::activeTexture(GL_TEXTURE0);
+  glCheckError("SUNCGScene::activate");
+}
+
+void SUNCGScene::load_textures() {
+  if (textures_.loaded())
+    return;
+  PROFILE_ZONE("SUNCGScene::load_textures");
+  textures_.load();
+  textures_.deactivate();
+  textures_.activate();
+  for (auto& material : materials_)
+    material.texture = textures_.get(material.m->diffuse_texname);
 }
 
 void SUNCGScene::deactivate() {
   for (auto& m : mesh_)
     m.deactivate();
+  batch_.deactivate();
+  if (mesh_color_texture_) {
+    GLStateCache::deleteTexture(mesh_color_texture_);
+    mesh_color_texture_.obj = 0;
+  }
+  if (mesh_color_buffer_) {
+    GPUMemory::release(GPUMemory::Object::BUFFER, mesh_color_buffer_);
+    glDeleteBuffers(1, mesh_color_buffer_);
+    mesh_color_buffer_.obj = 0;
+  }
   textures_.deactivate();
 }
 
+void SUNCGScene::draw_meshes_(int begin, int end) {
+  if (batched_) {
+    batch_.draw(begin, end);
+  } else {
+    for (int i = begin; i < end; ++i)
+      if (visible_.empty() || visible_[i])
+        mesh_[i].draw();
+  }
+}
+
+void SUNCGScene::set_hidden_categories(const vector<string>& categories) {
+  hidden_categories_.clear();
+  vector<bool> hidden(class_names_.size(), false);
+  bool any = false;
+  for (string c : categories) {
+    transform(c.begin(), c.end(), c.begin(), ::tolower);
+    hidden_categories_.push_back(c);
+    auto itr = class_index_.find(c);
+    if (itr != class_index_.end()) {
+      hidden[itr->second] = true;
+      any = true;
+    }
+  }
+  visible_.clear();
+  if (any) {
+    visible_.resize(mesh_.size());
+    for (size_t i = 0; i < mesh_.size(); ++i)
+      visible_[i] = !hidden[mesh_classes_[i][0]] && !hidden[mesh_classes_[i][1]];
+  }
+  batch_.set_visible(visible_);
+}
+
+array<int, 2> SUNCGScene::get_classes_by_shape_name(const string& name) {
+  string coarse, fine;
+  if (name.find("Model#") == 0) {
+    string model_id = name.substr(6);
+    coarse = model_category_.get_coarse_grained_class(model_id);
+    fine = model_category_.get_fine_grained_class(model_id);
+  } else {
+    // architecture, e.g. Floor#0_0, WallInside#0_0_1, or Ground
+    coarse = name.substr(0, name.find('#'));
+    if (coarse == "WallInside" or coarse == "WallOutside")
+      coarse = "Wall";
+    fine = coarse;
+  }
+  array<int, 2> ret;
+  for (int k = 0; k < 2; ++k) {
+    string klass = k == 0 ? coarse : fine;
+    transform(klass.begin(), klass.end(), klass.begin(), ::tolower);
+    auto itr = class_index_.find(klass);
+    if (itr == class_index_.end()) {
+      itr = class_index_.emplace(klass, class_names_.size()).first;
+      class_names_.push_back(klass);
+    }
+    ret[k] = itr->second;
+  }
+  return ret;
+}
+
 glm::vec3 SUNCGScene::get_color_by_shape_name(const string& name) {
   if (name.find("Model#") == 0) {
     int size_prefix = 6;  // len(Model#)
@@ -206,6 +392,7 @@ glm::vec3 SUNCGScene::get_color_by_shape_name(const string& name) {
 }
 
 void SUNCGScene::parse_scene() {
+  PROFILE_ZONE("SUNCGScene::parse_scene");
   float x = std::numeric_limits<float>::max();
   boxmin_ = {x, x, x};
   x = std::numeric_limits<float>::lowest();
@@ -229,6 +416,7 @@ void SUNCGScene::parse_scene() {
     mesh_.emplace_back();
     // Assume that obj_.materials won't change size any more
     materials_.emplace_back(MaterialDesc{mid, label_color, instance_color, 0UL, &obj_.materials[mid]});
+    mesh_classes_.push_back(get_classes_by_shape_name(shp.name));
 
     for (int f = 0; f < nr_face; ++f) {
       auto face = obj_.convertFace(tmesh, f);
@@ -240,18 +428,43 @@ void SUNCGScene::parse_scene() {
     }
   }
   mesh_.shrink_to_fit();
+  if (lod_levels_ > 1 && batched_) {
+    PROFILE_ZONE("SUNCGScene::build_lods");
+    parallel_for(mesh_.size(), 1, [&](int begin, int end) {
+      for (int i = begin; i < end; ++i)
+        mesh_[i].build_lods(lod_levels_);
+    });
+  }
   obj_.shapes.clear();
   obj_.shapes.shrink_to_fit();
 }
 
 void SUNCGScene::draw() {
-  glClearColor(background_color_.x, background_color_.y, background_color_.z, 1.0f);
+  PROFILE_ZONE("SUNCGScene::draw");
+  if (is_float_mode(mode_))
+    // empty pixels are zero
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+  else
+    glClearColor(background_color_.x, background_color_.y, background_color_.z, 1.0f);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  // the second color buffer (optical flow), if any, is zero for empty pixels
+  const GLfloat zero[] = {0.f, 0.f, 0.f, 0.f};
+  glClearBufferfv(GL_COLOR, 1, zero);
 
   int nr_mesh = mesh_.size();
-  if (mode_ == RenderMode::RGB) {
-    for (int i = 0; i < nr_mesh; ++i) {
-      const auto& material = materials_[i];
+  // samplers of different types cannot share a unit, even if unused
+  glUniform1i(shader_.meshColors_loc, 1);
+  if (mode_ == RenderMode::RGB || mode_ == RenderMode::RGB_FLAT) {
+    bool flat = mode_ == RenderMode::RGB_FLAT;
+    GLStateCache::activeTexture(GL_TEXTURE0);
+    glUniform1i(shader_.texture_loc, 0);  // use TU0
+    for (size_t r = 0; r + 1 < material_runs_.size(); ++r) {
+      int begin = material_runs_[r], end = material_runs_[r + 1];
+      if (!visible_.empty() &&
+          none_of(visible_.begin() + begin, visible_.begin() + end,
+            [](unsigned char v) { return v; }))
+        continue;
+      const auto& material = materials_[begin];
       static_assert(
           std::is_same<std::decay<
           decltype(material.m->diffuse[0])>::type, GLfloat>::value,
@@ -260,20 +473,28 @@ void SUNCGScene::draw() {
       glUniform3fv(shader_.Ka_loc, 1, (GLfloat*)&material.m->ambient);
       glUniform1f(shader_.dissolve_loc, material.m->dissolve);
 
+      GLuint texture = flat ? 0 : material.texture;
       auto mode = SUNCGShader::RenderMode::LIGHTING;
-      if (material.texture) {
-        glActiveTexture(GL_TEXTURE0);
-        glUniform1i(shader_.texture_loc, 0);  // use TU0
+      if (texture)
         mode = SUNCGShader::RenderMode::TEXTURE_LIGHTING;
-      }
       glUniform1ui(shader_.mode_loc, static_cast<GLuint>(mode));
 
-      TextureGuard TG{material.texture};
-      mesh_[i].draw();
+      TextureGuard TG{texture};
+      draw_meshes_(begin, end);
     }
+  } else if (batched_ && (mode_ == RenderMode::SEMANTIC || mode_ == RenderMode::INSTANCE)) {
+    auto mode = SUNCGShader::RenderMode::MESH_COLOR;
+    glUniform1ui(shader_.mode_loc, static_cast<GLuint>(mode));
+    glUniform1i(shader_.meshColorOffset_loc, mode_ == RenderMode::SEMANTIC ? 0 : nr_mesh);
+    GLStateCache::activeTexture(GL_TEXTURE1);
+    GLStateCache::bindTexture(GL_TEXTURE_BUFFER, mesh_color_texture_);
+    GLStateCache::activeTexture(GL_TEXTURE0);
+    batch_.draw(0, nr_mesh);
   } else if (mode_ == RenderMode::SEMANTIC || mode_ == RenderMode::INSTANCE) {
     auto mode = SUNCGShader::RenderMode::CONSTANT;
     for (int i = 0; i < nr_mesh; ++i) {
+      if (!visible_.empty() && !visible_[i])
+        continue;
       glm::vec3 color = mode_ == RenderMode::SEMANTIC ?
         materials_[i].label_color : materials_[i].instance_color;
       glUniform3fv(shader_.Kd_loc, 1, (GLfloat*)&color);
@@ -283,14 +504,17 @@ void SUNCGScene::draw() {
   } else if (mode_ == RenderMode::DEPTH) {
     auto mode = SUNCGShader::RenderMode::DEPTH;
     glUniform1ui(shader_.mode_loc, static_cast<GLuint>(mode));
-    for (int i = 0; i < nr_mesh; ++i)
-      mesh_[i].draw();
+    draw_meshes_(0, nr_mesh);
   } else if (mode_ == RenderMode::INVDEPTH) {
     auto mode = SUNCGShader::RenderMode::INVDEPTH;
     glUniform1ui(shader_.mode_loc, static_cast<GLuint>(mode));
     glUniform1f(shader_.minDepth_loc, minDepth_);
-    for (int i = 0; i < nr_mesh; ++i)
-      mesh_[i].draw();
+    draw_meshes_(0, nr_mesh);
+  } else if (mode_ == RenderMode::NORMAL || mode_ == RenderMode::POSITION) {
+    auto mode = mode_ == RenderMode::NORMAL ?
+      SUNCGShader::RenderMode::NORMAL : SUNCGShader::RenderMode::POSITION;
+    glUniform1ui(shader_.mode_loc, static_cast<GLuint>(mode));
+    draw_meshes_(0, nr_mesh);
   } else {
     throw runtime_error("unknown render mode");
   }
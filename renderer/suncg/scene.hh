@@ -7,7 +7,9 @@
 
 #pragma once
 
+#include <array>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "gl/api.hh"
@@ -29,16 +31,20 @@ class SUNCGShader: public Shader {
   public:
     SUNCGShader();
 
-    static const char* fShader;
+    static const char *vShader, *fShader;
     GLint Kd_loc, Ka_loc, mode_loc,
-          texture_loc, dissolve_loc, minDepth_loc;
+          texture_loc, dissolve_loc, minDepth_loc,
+          meshColors_loc, meshColorOffset_loc;
 
     enum class RenderMode : GLuint {
       TEXTURE_LIGHTING = 0,
       LIGHTING = 1,
       CONSTANT = 2,
       DEPTH = 3,
-      INVDEPTH = 4
+      INVDEPTH = 4,
+      NORMAL = 5,
+      POSITION = 6,
+      MESH_COLOR = 7    // the color of the mesh in the meshColors buffer
     };
 };
 
@@ -48,6 +54,8 @@ class SUNCGScene : public ObjSceneBase {
         std::string obj_file,
         std::string model_category_file,
         std::string semantic_label_file,
+        int lod_levels = 1,
+        bool load_textures = true,
         float minDepth = 0.3);
     ~SUNCGScene() {}
 
@@ -62,9 +70,28 @@ class SUNCGScene : public ObjSceneBase {
       SEMANTIC = 1,
       DEPTH = 2,
       INSTANCE = 3,
-      INVDEPTH = 4
+      INVDEPTH = 4,
+      NORMAL = 5,    // world-space surface normal, float
+      POSITION = 6,  // world-space coordinates, float
+      RGB_FLAT = 7   // RGB with the diffuse color of each material, no texture
     };
 
+    // Whether the mode renders floating point values instead of colors.
+    static bool is_float_mode(RenderMode m) {
+      return m == RenderMode::NORMAL || m == RenderMode::POSITION;
+    }
+
+    // Number of channels of the uint8 images of a mode, as returned by render().
+    static int num_channels(RenderMode m) { return m == RenderMode::DEPTH ? 2 : 3; }
+
+    // Lower-case name of the mode, e.g. "rgb".
+    static const char* mode_name(RenderMode m) {
+      static const char* names[] = {
+        "rgb", "semantic", "depth", "instance", "invdepth", "normal", "position",
+        "rgb_flat"};
+      return names[static_cast<int>(m)];
+    }
+
     enum class ObjectNameResolution {
       COARSE = 0,   // use its coarse class name
       FINE = 1      // use its fine class name
@@ -77,6 +104,26 @@ class SUNCGScene : public ObjSceneBase {
 
     RenderMode get_mode() const { return mode_; }
 
+    // Whether the textures are uploaded. A scene constructed with
+    // load_textures=false draws RGB mode like RGB_FLAT until load_textures().
+    bool textures_loaded() const { return textures_.loaded(); }
+    // Decode and upload the textures. The scene has to be activated.
+    void load_textures();
+
+    // Number of levels of detail built for the meshes, 1 if none.
+    int num_lod_levels() const { return lod_levels_; }
+
+    // Select the level of detail of each mesh for the following draws. See
+    // MeshBatch::select_lod. A non-positive pixel_error draws the full meshes.
+    void select_lod(const glm::mat4& camera_matrix, int viewport_w, int viewport_h,
+        float pixel_error) {
+      if (pixel_error > 0)
+        batch_.select_lod(camera_matrix, viewport_w, viewport_h, pixel_error);
+      else
+        batch_.clear_lod();
+    }
+    MeshBatch::LODStats lod_stats() const { return batch_.lod_stats(); }
+
     std::string get_name_from_instance_color(int r, int g, int b) const {
       int key = r * 256 * 256 + g * 256 + b;
       auto itr = instance_color_to_name_.find(key);
@@ -86,6 +133,19 @@ class SUNCGScene : public ObjSceneBase {
       return "";
     }
 
+    // Do not draw the objects of these classes, until called again. Each name
+    // is a coarse or a fine class (case-insensitive), e.g. {"chair", "plant"},
+    // or a kind of architecture such as "wall". Unknown names are ignored.
+    void set_hidden_categories(const std::vector<std::string>& categories);
+    const std::vector<std::string>& get_hidden_categories() const
+    { return hidden_categories_; }
+
+    // The class of a color in SEMANTIC mode, as the row index in the
+    // semantic label file. Returns -1 for unknown colors.
+    int get_class_index_from_color(int r, int g, int b) const {
+      return semantic_color_.get_index(r, g, b);
+    }
+
   protected:
     void parse_scene();
 
@@ -100,6 +160,9 @@ class SUNCGScene : public ObjSceneBase {
 
     glm::vec3 get_color_by_shape_name(const std::string& name);
 
+    // The index in class_names_ of the coarse and fine class of a shape.
+    std::array<int, 2> get_classes_by_shape_name(const std::string& name);
+
     RenderMode mode_ = RenderMode::RGB;
     ObjectNameResolution object_name_mode_ = ObjectNameResolution::COARSE;
     SUNCGShader shader_;
@@ -110,6 +173,21 @@ class SUNCGScene : public ObjSceneBase {
     glm::vec3 background_color_;
     std::vector<Mesh> mesh_;
     float minDepth_; // used for inverse depth mode
+    int lod_levels_;  // simplified versions of each mesh, including itself
+
+    // Draw all meshes from one vertex array, with one call per run of meshes
+    // with the same material in RGB mode, and one call in other modes.
+    // Disabled by HOUSE3D_BATCH_DRAW=0, to draw each mesh from its own,
+    // without levels of detail.
+    bool batched_;
+    MeshBatch batch_;
+    // label colors of each mesh, then instance colors, as a buffer texture
+    GLIntResource<GLuint> mesh_color_buffer_, mesh_color_texture_;
+    // the first mesh of each run of meshes with the same material, and the end
+    std::vector<int> material_runs_;
+
+    // draw meshes [begin, end)
+    void draw_meshes_(int begin, int end);
 
     struct MaterialDesc {
       int id;  // material id in tinyobj
@@ -123,6 +201,15 @@ class SUNCGScene : public ObjSceneBase {
     // material for each mesh. Must have same size as mesh_
     std::vector<MaterialDesc> materials_;
 
+    // lower-case names of the classes of the meshes
+    std::vector<std::string> class_names_;
+    std::unordered_map<std::string, int> class_index_;
+    // coarse and fine class of each mesh
+    std::vector<std::array<int, 2>> mesh_classes_;
+    std::vector<std::string> hidden_categories_;
+    // whether to draw each mesh, empty if no category is hidden
+    std::vector<unsigned char> visible_;
+
     // keys: r * 256 * 256 + g * 256 + b
     // value: shape.name as in the obj file
     std::unordered_map<int, std::string> instance_color_to_name_;
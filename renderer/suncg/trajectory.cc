@@ -0,0 +1,119 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: trajectory.cc
+
+#include "trajectory.hh"
+
+#include <cerrno>
+#include <stdexcept>
+#include <sys/stat.h>
+
+#include "lib/bufferPool.hh"
+#include "lib/strutils.hh"
+
+using namespace std;
+
+namespace {
+
+void make_dir(const string& dir) {
+  if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+    throw runtime_error(ssprintf("Cannot create directory %s", dir.c_str()));
+}
+
+vector<int> channels_of(const vector<render::SUNCGScene::RenderMode>& modes) {
+  vector<int> ret;
+  for (auto m : modes)
+    ret.push_back(render::SUNCGScene::num_channels(m));
+  return ret;
+}
+
+} // namespace
+
+namespace render {
+
+void ArrayTrajectorySink::begin(int nr_pose, const vector<SUNCGScene::RenderMode>& modes,
+    Geometry geo) {
+  nr_pose_ = nr_pose;
+  geo_ = geo;
+  channels_ = channels_of(modes);
+  arrays_.clear();
+  for (int c : channels_)
+    arrays_.push_back(make_pooled_array<unsigned char>((size_t)nr_pose * geo.h * geo.w * c));
+}
+
+Matuc ArrayTrajectorySink::frame(int pose, int mode) {
+  int c = channels_[mode];
+  size_t offset = (size_t)pose * geo_.h * geo_.w * c;
+  // shares the ownership of the whole array
+  return Matuc{geo_.h, geo_.w, c,
+    shared_ptr<unsigned char>(arrays_[mode], arrays_[mode].get() + offset)};
+}
+
+
+DirectoryTrajectorySink::DirectoryTrajectorySink(const string& dir, const string& ext,
+    int nr_thread, int level):
+  dir_{dir}, ext_{ext}, nr_thread_{nr_thread}, level_{level} {
+  if (ext_ != "png" && ext_ != "jpg" && ext_ != "raw")
+    throw runtime_error(ssprintf("Unknown format %s, expect png, jpg or raw", ext_.c_str()));
+}
+
+void DirectoryTrajectorySink::begin(int /*nr_pose*/,
+    const vector<SUNCGScene::RenderMode>& modes, Geometry geo) {
+  geo_ = geo;
+  channels_ = channels_of(modes);
+  make_dir(dir_);
+  mode_dirs_.clear();
+  writers_.clear();
+  for (auto m : modes) {
+    mode_dirs_.push_back(dir_ + "/" + SUNCGScene::mode_name(m));
+    if (ext_ == "raw") {
+      writers_.emplace_back(new AsyncWriter{nr_thread_, 2 * nr_thread_, mode_dirs_.back()});
+    } else {
+      make_dir(mode_dirs_.back());
+      if (writers_.empty())
+        writers_.emplace_back(new AsyncWriter{nr_thread_, 2 * nr_thread_});
+    }
+  }
+}
+
+Matuc DirectoryTrajectorySink::frame(int /*pose*/, int mode) {
+  // a new buffer, owned by the writer until it is written
+  return Matuc{geo_.h, geo_.w, channels_[mode]};
+}
+
+void DirectoryTrajectorySink::commit(int pose, int mode, const Matuc& frame) {
+  if (ext_ == "raw")
+    writers_[mode]->writeRaw(ssprintf("%06d", pose), frame);
+  else
+    writers_[0]->write(ssprintf("%s/%06d.%s", mode_dirs_[mode].c_str(), pose, ext_.c_str()),
+        frame, level_);
+}
+
+void DirectoryTrajectorySink::end() {
+  for (auto& w : writers_)
+    w->flush();
+}
+
+
+void CallbackTrajectorySink::begin(int /*nr_pose*/,
+    const vector<SUNCGScene::RenderMode>& modes, Geometry geo) {
+  geo_ = geo;
+  channels_ = channels_of(modes);
+}
+
+Matuc CallbackTrajectorySink::frame(int /*pose*/, int mode) {
+  return Matuc{geo_.h, geo_.w, channels_[mode]};
+}
+
+
+void NullTrajectorySink::begin(int /*nr_pose*/,
+    const vector<SUNCGScene::RenderMode>& modes, Geometry geo) {
+  frames_.clear();
+  for (auto m : modes)
+    frames_.emplace_back(geo.h, geo.w, SUNCGScene::num_channels(m));
+}
+
+} // namespace render
@@ -0,0 +1,129 @@
+// Copyright 2017-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+//File: trajectory.hh
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "scene.hh"
+#include "lib/asyncWriter.hh"
+#include "lib/geometry.hh"
+#include "lib/mat.h"
+
+namespace render {
+
+// A camera pose of a trajectory: the position, and the yaw and pitch as in Camera.
+struct TrajectoryPose {
+  glm::vec3 pos;
+  float yaw, pitch;
+};
+
+// Receives the frames of SUNCGRenderAPI::renderTrajectory().
+//
+// For each pose and each mode, the renderer writes the frame into the buffer
+// returned by frame(), then calls commit(). Frames are committed in order,
+// modes first. Channels are as returned by render() in that mode.
+class TrajectorySink {
+  public:
+    virtual ~TrajectorySink() {}
+
+    virtual void begin(int /*nr_pose*/,
+        const std::vector<SUNCGScene::RenderMode>& /*modes*/, Geometry /*geo*/) {}
+
+    // A h x w x c buffer for the frame of a pose in the `mode`-th mode.
+    virtual Matuc frame(int pose, int mode) = 0;
+
+    virtual void commit(int /*pose*/, int /*mode*/, const Matuc& /*frame*/) {}
+
+    // Called after the last frame, and not if rendering fails.
+    virtual void end() {}
+};
+
+
+// Keeps all frames in memory: one contiguous nr_pose x h x w x c array per mode.
+class ArrayTrajectorySink : public TrajectorySink {
+  public:
+    void begin(int nr_pose, const std::vector<SUNCGScene::RenderMode>& modes,
+        Geometry geo) override;
+    Matuc frame(int pose, int mode) override;
+
+    int nr_pose() const { return nr_pose_; }
+    int nr_mode() const { return arrays_.size(); }
+    Geometry resolution() const { return geo_; }
+    int channels(int mode) const { return channels_[mode]; }
+    const std::shared_ptr<unsigned char>& array(int mode) const { return arrays_[mode]; }
+
+  private:
+    int nr_pose_ = 0;
+    Geometry geo_;
+    std::vector<int> channels_;
+    std::vector<std::shared_ptr<unsigned char>> arrays_;
+};
+
+
+// Writes the frames to dir/<mode>/<pose>.<ext> through an AsyncWriter, where
+// mode is e.g. "rgb" and pose has 6 digits. ext is "png" or "jpg", or "raw"
+// for shards in dir/<mode>/, with the pose as key.
+// end() waits for all frames to be written, and throws if any write failed.
+class DirectoryTrajectorySink : public TrajectorySink {
+  public:
+    DirectoryTrajectorySink(const std::string& dir, const std::string& ext,
+        int nr_thread = 4, int level = -1);
+
+    void begin(int nr_pose, const std::vector<SUNCGScene::RenderMode>& modes,
+        Geometry geo) override;
+    Matuc frame(int pose, int mode) override;
+    void commit(int pose, int mode, const Matuc& frame) override;
+    void end() override;
+
+  private:
+    std::string dir_, ext_;
+    int nr_thread_, level_;
+    Geometry geo_;
+    std::vector<std::string> mode_dirs_;
+    std::vector<int> channels_;
+    // an AsyncWriter per mode for raw shards, one shared otherwise
+    std::vector<std::unique_ptr<AsyncWriter>> writers_;
+};
+
+
+// Passes each frame to a function. The frame is not reused afterwards.
+class CallbackTrajectorySink : public TrajectorySink {
+  public:
+    using Callback = std::function<void(int pose, int mode, const Matuc& frame)>;
+
+    explicit CallbackTrajectorySink(Callback func): func_{std::move(func)} {}
+
+    void begin(int nr_pose, const std::vector<SUNCGScene::RenderMode>& modes,
+        Geometry geo) override;
+    Matuc frame(int pose, int mode) override;
+    void commit(int pose, int mode, const Matuc& frame) override { func_(pose, mode, frame); }
+
+  private:
+    Callback func_;
+    Geometry geo_;
+    std::vector<int> channels_;
+};
+
+
+// Discards the frames, e.g. to benchmark or replay.
+class NullTrajectorySink : public TrajectorySink {
+  public:
+    void begin(int nr_pose, const std::vector<SUNCGScene::RenderMode>& modes,
+        Geometry geo) override;
+    Matuc frame(int /*pose*/, int mode) override { return frames_[mode]; }
+
+  private:
+    std::vector<Matuc> frames_;
+};
+
+} // namespace render
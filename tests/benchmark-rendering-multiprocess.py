@@ -14,9 +14,13 @@ import cv2
 
 from House3D import objrender, create_default_config
 from House3D.objrender import Camera, RenderMode
+from House3D.renderclient import RenderClient
 
-def worker(idx, device, num_iter):
-    api = objrender.RenderAPI(args.width, args.height, device=device)
+def worker(idx, device, num_iter, speeds):
+    if args.server:
+        api = RenderClient(args.width, args.height, socket_path=args.server)
+    else:
+        api = objrender.RenderAPI(args.width, args.height, device=device)
     api.printContextInfo()
     mappingFile = cfg['modelCategoryFile']
     colormapFile = cfg['colorFile']
@@ -34,6 +38,7 @@ def worker(idx, device, num_iter):
         mat = np.array(api.render(), copy=False)
     end = time.time()
     print("Worker {}, speed {:.3f} fps".format(idx, num_iter / (end - start)))
+    speeds.put(num_iter / (end - start))
 
 
 if __name__ == '__main__':
@@ -66,19 +71,23 @@ if __name__ == '__main__':
     parser.add_argument('--width', type=int, default=120)
     parser.add_argument('--height', type=int, default=90)
     parser.add_argument('--num-iter', type=int, default=5000)
+    parser.add_argument('--server', help='socket of a render-server.bin to render with')
     args = parser.parse_args()
 
     global cfg
     cfg = create_default_config('.')
 
     procs = []
+    speeds = mp.Queue()
     for i in range(args.num_proc):
         device = i % args.num_gpu
-        procs.append(mp.Process(target=worker, args=(i, device, args.num_iter)))
+        procs.append(mp.Process(target=worker, args=(i, device, args.num_iter, speeds)))
 
     for p in procs:
         p.start()
 
     for p in procs:
         p.join()
+    print("Total speed of {} procs: {:.3f} fps".format(
+        args.num_proc, sum(speeds.get() for _ in procs)))
 
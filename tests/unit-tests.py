@@ -4,6 +4,7 @@
 # This source code is licensed under the license found in the
 # LICENSE file in the root directory of this source tree.
 
+import copy
 import numpy as np
 import os
 import unittest
@@ -48,6 +49,31 @@ def find_first_good_house(cfg):
             return (house_id, house)
 
 
+class SyntheticHouseTest(unittest.TestCase):
+    '''Generates synthetic houses in a temporary directory, removed after the test.'''
+    def setUp(self):
+        import tempfile
+        self.cfg = load_config('config.json')
+        self.prefix = tempfile.mkdtemp()
+
+    def tearDown(self):
+        import shutil
+        shutil.rmtree(self.prefix)
+
+    def make_houses(self, n, **kwargs):
+        '''Generate houses '0' to 'n - 1' under self.prefix, with seeds 0 to n - 1.
+        Returns their obj files, and keeps the statistics in self.house_stats.'''
+        from House3D.synthetic import generate_house
+        objs, self.house_stats = [], []
+        for i in range(n):
+            d = os.path.join(self.prefix, str(i))
+            os.makedirs(d)
+            self.house_stats.append(generate_house(
+                d, seed=i, category_file=self.cfg['modelCategoryFile'], **kwargs))
+            objs.append(os.path.join(d, 'house.obj'))
+        return objs
+
+
 class TestCubeMap(unittest.TestCase):
     def test_render(self):
         api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
@@ -96,5 +122,672 @@ class TestCubeMap(unittest.TestCase):
             depth2[0, 0], depth_value, delta=depth_value * 0.05)
 
 
+class TestFrameStack(unittest.TestCase):
+    def test_stack(self):
+        K = 4
+        api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
+        cfg = load_config('config.json')
+        houseID, house = find_first_good_house(cfg)
+        env = Environment(api, house, cfg)
+        env.reset(*house.getRandomLocation(ROOM_TYPE))
+        env.set_render_mode(RenderMode.RGB)
+
+        stack = objrender.FrameStack(K, SIDE, SIDE, 3)
+        frames = []
+        for t in range(K + 2):
+            env.rotate(10)
+            api.renderToStack(stack)
+            frames.append(env.render(copy=True).transpose(2, 0, 1))
+            view = np.array(stack, copy=False)
+            self.assertEqual(view.shape, (K, 3, SIDE, SIDE))
+            expected = frames[-K:]
+            # the first frame of an episode fills the whole history
+            expected = [expected[0]] * (K - len(expected)) + expected
+            self.assertTrue(np.array_equal(view, np.stack(expected)))
+
+        stack.reset()
+        api.renderToStack(stack)
+        view = np.array(stack, copy=False)
+        for k in range(K):
+            self.assertTrue(np.array_equal(view[k], frames[-1]))
+
+
+class TestPanorama(unittest.TestCase):
+    def test_render(self):
+        api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
+        cfg = load_config('config.json')
+        houseID, house = find_first_good_house(cfg)
+        env = Environment(api, house, cfg)
+        env.reset(*house.getRandomLocation(ROOM_TYPE))
+
+        rgb = env.render_panorama('equirectangular', mode=RenderMode.RGB)
+        self.assertEqual(rgb.shape, (SIDE * 2, SIDE * 4, 3))
+
+        fisheye = env.render_panorama('fisheye', (SIDE, SIDE // 2), fov=200, mode=RenderMode.RGB)
+        self.assertEqual(fisheye.shape, (SIDE // 2, SIDE, 3))
+
+        depth = env.render_panorama('fisheye', mode=RenderMode.DEPTH)
+        self.assertEqual(depth.shape, (SIDE, SIDE, 2))
+        # corners are outside of the image circle
+        self.assertEqual(depth[0, 0, 1], 255)
+
+        # nearest sampling: every label also appears in the cube map
+        semantic = env.render_panorama(mode=RenderMode.SEMANTIC)
+        cube = env.render_cube_map(mode=RenderMode.SEMANTIC)
+        colors = lambda img: set(map(tuple, img.reshape(-1, 3)))
+        self.assertTrue(colors(semantic).issubset(colors(cube)))
+
+        # depth is the distance from the camera: at the center of the
+        # panorama, it matches the center of the view, also when the camera
+        # front is not along an axis of the cube map
+        cam = api.getCamera()
+        cam.yaw, cam.pitch = cam.yaw + 30, 0
+        cam.updateDirection()
+        for mode in [RenderMode.DEPTH, RenderMode.INVDEPTH]:
+            env.set_render_mode(mode)
+            view = env.render()[SIDE // 2, SIDE // 2].astype(np.int32)
+            pano = env.render_panorama()[SIDE, SIDE * 2].astype(np.int32)
+            if mode == RenderMode.DEPTH:
+                self.assertEqual(view[1], pano[1])
+                self.assertAlmostEqual(view[0], pano[0], delta=2)
+            else:
+                view, pano = view[0] * 256 + view[1], pano[0] * 256 + pano[1]
+                self.assertAlmostEqual(view, pano, delta=max(view * 0.02, 2))
+
+        # the equirectangular panorama ignores the pitch, also when looking
+        # straight up or down
+        level = env.render_panorama()
+        for pitch in [90, -90]:
+            cam.pitch = pitch
+            cam.updateDirection()
+            np.testing.assert_array_equal(env.render_panorama(), level)
+
+
+class TestFloatModes(unittest.TestCase):
+    def test_render(self):
+        api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
+        cfg = load_config('config.json')
+        houseID, house = find_first_good_house(cfg)
+        env = Environment(api, house, cfg)
+        env.reset(*house.getRandomLocation(ROOM_TYPE))
+
+        normal = env.render(RenderMode.NORMAL)
+        self.assertEqual(normal.dtype, np.float32)
+        self.assertEqual(normal.shape, (SIDE, SIDE, 3))
+        norm = np.linalg.norm(normal, axis=2)
+        covered = norm > 0
+        self.assertTrue(np.allclose(norm[covered], 1, atol=1e-3))
+
+        position = env.render(RenderMode.POSITION)
+        self.assertEqual(position.dtype, np.float32)
+        # the center pixel lies in front of the camera
+        cam = api.getCamera()
+        p = position[SIDE // 2, SIDE // 2]
+        offset = p - np.array([cam.pos.x, cam.pos.y, cam.pos.z])
+        front = np.array([cam.front.x, cam.front.y, cam.front.z])
+        self.assertGreater(np.dot(offset, front), 0)
+
+        cube = env.render_cube_map(RenderMode.NORMAL)
+        self.assertEqual(cube.dtype, np.float32)
+        self.assertEqual(cube.shape, (SIDE, SIDE * 6, 3))
+
+
+class TestPointCloud(unittest.TestCase):
+    def test_render(self):
+        api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
+        cfg = load_config('config.json')
+        houseID, house = find_first_good_house(cfg)
+        env = Environment(api, house, cfg)
+        env.reset(*house.getRandomLocation(ROOM_TYPE))
+
+        position = env.render(RenderMode.POSITION)
+        covered = np.linalg.norm(position, axis=2) > 0
+        cloud = env.render_point_cloud(labels=True)
+        self.assertEqual(cloud.dtype, np.float32)
+        self.assertEqual(cloud.shape, (covered.sum(), 4))
+        self.assertTrue(np.allclose(cloud[:, :3], position[covered], atol=1e-2))
+        self.assertTrue((cloud[:, 3] >= 0).all())
+
+        voxels = env.render_point_cloud(voxel_size=0.2)
+        self.assertLess(len(voxels), len(cloud))
+        self.assertTrue((voxels[:, 3] == -1).all())
+
+
+class TestFlow(unittest.TestCase):
+    def test_render(self):
+        api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
+        cfg = load_config('config.json')
+        houseID, house = find_first_good_house(cfg)
+        env = Environment(api, house, cfg)
+        env.reset(*house.getRandomLocation(ROOM_TYPE))
+        env.set_render_mode(RenderMode.RGB)
+
+        prev = copy.copy(env.cam)
+        img, flow = env.render_with_flow(prev)
+        self.assertEqual(flow.dtype, np.float32)
+        self.assertEqual(flow.shape, (SIDE, SIDE, 2))
+        self.assertTrue(np.allclose(flow, 0, atol=0.01))
+        self.assertTrue((img == env.render()).all())
+
+        # turning right moves the scene to the right in the previous view
+        env.rotate(5)
+        _, flow = env.render_with_flow(prev)
+        self.assertGreater(np.median(flow[:, :, 0]), 1)
+
+
+class TestFrameStats(unittest.TestCase):
+    def test_stats(self):
+        api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
+        cfg = load_config('config.json')
+        houseID, house = find_first_good_house(cfg)
+        env = Environment(api, house, cfg)
+        env.reset(*house.getRandomLocation(ROOM_TYPE))
+
+        self.assertEqual(api.getFrameStats(), {})
+        api.enableFrameStats()
+        for _ in range(10):
+            env.render()
+        stats = api.getFrameStats()
+        self.assertEqual(set(stats.keys()),
+                         {'draw', 'gpu', 'readback', 'postprocess', 'total'})
+        self.assertEqual(stats['total']['count'], 10)
+        # no GPU measurement is lost, except the warm-up one
+        self.assertEqual(stats['gpu']['discarded'], 1)
+        self.assertEqual(stats['gpu']['count'] + stats['gpu']['discarded'], 10)
+        self.assertLessEqual(stats['draw']['p50'], stats['total']['p99'])
+
+
+class TestProfiler(unittest.TestCase):
+    def test_trace(self):
+        import json
+        import tempfile
+        objrender.Profiler.enable()
+        api = objrender.RenderAPIThread(w=SIDE, h=SIDE, device=0)
+        cfg = load_config('config.json')
+        houseID, house = find_first_good_house(cfg)
+        env = Environment(api, house, cfg)
+        env.reset(*house.getRandomLocation(ROOM_TYPE))
+        env.render()
+        objrender.Profiler.disable()
+
+        self.assertIn('SUNCGScene::draw', objrender.Profiler.summary())
+        with tempfile.NamedTemporaryFile(suffix='.json') as f:
+            objrender.Profiler.writeChromeTrace(f.name)
+            events = json.load(open(f.name))['traceEvents']
+        names = set(e['name'] for e in events)
+        self.assertIn('ExecutorInThread::job', names)
+        self.assertIn('ObjLoader::load', names)
+        objrender.Profiler.clear()
+
+        # events beyond the cap are dropped and counted
+        objrender.Profiler.setMaxEvents(5)
+        objrender.Profiler.enable()
+        for _ in range(3):
+            env.render()
+        objrender.Profiler.disable()
+        self.assertGreater(objrender.Profiler.numDropped(), 0)
+        self.assertIn('dropped', objrender.Profiler.summary())
+        objrender.Profiler.clear()
+        self.assertEqual(objrender.Profiler.numDropped(), 0)
+        objrender.Profiler.setMaxEvents(1 << 20)
+
+
+class TestSyntheticHouse(SyntheticHouseTest):
+    def test_generate(self):
+        cfg = self.cfg
+        self.make_houses(1, rooms=6, triangle_budget=20000)
+        stats = self.house_stats[0]
+        self.assertGreater(stats['objects'], 0)
+        self.assertLess(abs(stats['triangles'] - 20000), 5000)
+
+        cfg['prefix'] = self.prefix
+        house = create_house('0', cfg)
+        self.assertTrue(house.hasRoomType(ROOM_TYPE))
+        api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
+        env = Environment(api, house, cfg)
+        env.reset(*house.getRandomLocation(ROOM_TYPE))
+        env.set_render_mode(RenderMode.SEMANTIC)
+        sem = env.render()
+        # walls, floor and furniture have different classes
+        self.assertGreater(len(np.unique(sem.reshape(-1, 3), axis=0)), 2)
+
+
+class TestSceneCache(SyntheticHouseTest):
+    def test_lru(self):
+        cfg = self.cfg
+        objs = self.make_houses(3, rooms=2)
+        api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
+        api.setSceneCacheCapacity(2)
+        load = lambda obj: api.loadScene(obj, cfg['modelCategoryFile'], cfg['colorFile'])
+        load(objs[0])
+        load(objs[1])
+        load(objs[0])   # objs[1] becomes the least recently used
+        load(objs[2])
+        self.assertTrue(api.isSceneCached(objs[0]))
+        self.assertFalse(api.isSceneCached(objs[1]))
+        self.assertTrue(api.isSceneCached(objs[2]))
+        api.setSceneCacheCapacity(1)
+        self.assertFalse(api.isSceneCached(objs[0]))
+        self.assertTrue(api.isSceneCached(objs[2]))
+        api.render()
+
+
+class TestRecorder(unittest.TestCase):
+    def test_record(self):
+        import tempfile
+        api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
+        cfg = load_config('config.json')
+        houseID, house = find_first_good_house(cfg)
+        with tempfile.NamedTemporaryFile(suffix='.log') as f:
+            api.startRecording(f.name)
+            env = Environment(api, house, cfg)
+            env.reset(*house.getRandomLocation(ROOM_TYPE))
+            for mode in [RenderMode.RGB, RenderMode.DEPTH]:
+                env.set_render_mode(mode)
+                env.render()
+                env.render_cube_map()
+            api.stopRecording()
+            data = open(f.name, 'rb').read()
+        self.assertEqual(data[:8], b'H3DREC1\0')
+        self.assertEqual(np.frombuffer(data[8:16], dtype=np.int32).tolist(), [SIDE, SIDE])
+        # loadScene, 2 x (setMode, render, renderCubeMap), with poses
+        self.assertGreater(len(data), 16 + 7 * 13)
+
+
+class TestMemoryStats(SyntheticHouseTest):
+    def test_accounting(self):
+        cfg = self.cfg
+        objs = self.make_houses(2, rooms=2, textures=2, texture_size=64)
+        api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
+        stats = api.getMemoryStats()
+        # color and depth renderbuffers
+        self.assertEqual(stats['renderer']['framebuffer'], SIDE * SIDE * 8)
+
+        for obj in objs:
+            api.loadScene(obj, cfg['modelCategoryFile'], cfg['colorFile'])
+        # textures are uploaded by the first render in RGB mode
+        api.render()
+        stats = api.getMemoryStats()
+        # two 64x64 RGB textures with mipmaps
+        self.assertEqual(stats[objs[1]]['texture'], 2 * 3 * 5461)
+        self.assertGreater(stats[objs[1]]['vertex_buffer'], 0)
+        # the cached scene is not resident
+        self.assertEqual(stats[objs[0]]['total'], 0)
+        self.assertGreater(stats[objs[0]]['peak'], 0)
+        total = stats['total']
+        self.assertEqual(total['total'],
+                         sum(total[k] for k in ['vertex_buffer', 'texture', 'framebuffer']))
+        self.assertGreaterEqual(total['peak'], total['total'])
+
+
+class TestStateCache(unittest.TestCase):
+    def test_elided(self):
+        api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
+        cfg = load_config('config.json')
+        houseID, house = find_first_good_house(cfg)
+        env = Environment(api, house, cfg)
+        env.reset(*house.getRandomLocation(ROOM_TYPE))
+
+        first = env.render()
+        before = api.getStateCacheStats()
+        for _ in range(5):
+            img = env.render()
+            self.assertTrue(np.array_equal(img, first))
+        after = api.getStateCacheStats()
+        # the program stays in use between frames
+        self.assertEqual(after['useProgram']['issued'], before['useProgram']['issued'])
+        self.assertEqual(after['useProgram']['elided'] - before['useProgram']['elided'], 5)
+        self.assertGreater(after['bindTexture']['elided'], before['bindTexture']['elided'])
+
+
+class TestProgramCache(unittest.TestCase):
+    def test_cache(self):
+        import shutil
+        import tempfile
+        cfg = load_config('config.json')
+        houseID, house = find_first_good_house(cfg)
+        cache_dir = tempfile.mkdtemp()
+        os.environ['HOUSE3D_SHADER_CACHE'] = cache_dir
+        try:
+            location = house.getRandomLocation(ROOM_TYPE)
+            images, hits, misses = [], [], []
+            for _ in range(2):   # compile, then load from the cache
+                hit, miss = objrender.ProgramCache.numHit(), objrender.ProgramCache.numMiss()
+                api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
+                env = Environment(api, house, cfg)
+                env.reset(*location)
+                images.append(env.render())
+                del env, api
+                hits.append(objrender.ProgramCache.numHit() - hit)
+                misses.append(objrender.ProgramCache.numMiss() - miss)
+            if misses[0] == 0:
+                self.skipTest('The driver does not support program binaries')
+            self.assertEqual(hits[0], 0)
+            self.assertTrue(any(f.endswith('.bin') for f in os.listdir(cache_dir)))
+            self.assertEqual(hits[1], misses[0])
+            self.assertEqual(misses[1], 0)
+            self.assertTrue(np.array_equal(images[0], images[1]))
+        finally:
+            del os.environ['HOUSE3D_SHADER_CACHE']
+            shutil.rmtree(cache_dir)
+
+
+class TestBufferPool(unittest.TestCase):
+    def test_reuse(self):
+        api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
+        cfg = load_config('config.json')
+        houseID, house = find_first_good_house(cfg)
+        env = Environment(api, house, cfg)
+        env.reset(*house.getRandomLocation(ROOM_TYPE))
+        for _ in range(3):
+            env.render(copy=True)
+
+        # frames of the same size reuse the released buffers
+        before = objrender.BufferPool.stats()
+        for _ in range(10):
+            env.render(copy=True)
+        after = objrender.BufferPool.stats()
+        self.assertGreaterEqual(after['hit'] - before['hit'], 10)
+        self.assertEqual(after['miss'], before['miss'])
+        self.assertEqual(after['allocate'], after['hit'] + after['miss'])
+        self.assertGreater(after['pooled_bytes'], 0)
+
+
+class TestAsyncWriter(unittest.TestCase):
+    def test_write(self):
+        import shutil
+        import tempfile
+        from House3D.frames import read_frames
+        cfg = load_config('config.json')
+        houseID, house = find_first_good_house(cfg)
+        api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
+        env = Environment(api, house, cfg)
+        env.reset()
+        out_dir = tempfile.mkdtemp()
+        try:
+            raw_dir = os.path.join(out_dir, 'raw')
+            writer = objrender.AsyncWriter(threads=2, capacity=4, raw_dir=raw_dir)
+            frames = {}
+            for i in range(8):
+                env.move_forward(0.1)
+                mat = api.render()
+                frames[str(i)] = np.array(mat, copy=True)
+                writer.write(os.path.join(out_dir, '{}.png'.format(i)), mat)
+                writer.write(os.path.join(out_dir, '{}.jpg'.format(i)), frames[str(i)])
+                writer.writeRaw(str(i), mat)
+            writer.flush()
+            stats = writer.stats()
+            self.assertEqual(stats['written'], 24)
+            self.assertEqual(stats['failed'], 0)
+            self.assertEqual(stats['queued'], 0)
+            self.assertLessEqual(stats['max_queued'], 4)
+
+            for i in range(8):
+                for ext in ['png', 'jpg']:
+                    fname = os.path.join(out_dir, '{}.{}'.format(i, ext))
+                    self.assertGreater(os.path.getsize(fname), 0)
+            raw = dict(read_frames(raw_dir))
+            self.assertEqual(sorted(raw.keys()), sorted(frames.keys()))
+            for key, frame in frames.items():
+                self.assertTrue(np.array_equal(raw[key], frame))
+
+            writer.write(os.path.join(out_dir, 'missing', 'x.png'), mat)
+            with self.assertRaises(RuntimeError):
+                writer.flush()
+            writer.flush()  # the error is reported once
+        finally:
+            shutil.rmtree(out_dir)
+
+
+class TestTrajectory(unittest.TestCase):
+    def test_trajectory(self):
+        import shutil
+        import tempfile
+        cfg = load_config('config.json')
+        houseID, house = find_first_good_house(cfg)
+        api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
+        env = Environment(api, house, cfg)
+        env.reset()
+        cam = api.getCamera()
+        poses = [(cam.pos.x + 0.05 * i, cam.pos.y, cam.pos.z, cam.yaw + 3 * i, cam.pitch)
+                 for i in range(6)]
+        modes = [RenderMode.RGB, RenderMode.DEPTH]
+
+        def set_pose(x, y, z, yaw, pitch):
+            cam.pos = objrender.Vec3(x, y, z)
+            cam.yaw, cam.pitch = yaw, pitch
+            cam.updateDirection()
+
+        # the camera stays at the last pose
+        api.setMode(RenderMode.SEMANTIC)
+        set_pose(*poses[-1])
+        semantic = np.array(api.render())
+        set_pose(*poses[0])
+        rgb, depth = api.renderTrajectory(poses, modes)
+        self.assertEqual(rgb.shape, (6, SIDE, SIDE, 3))
+        self.assertEqual(depth.shape, (6, SIDE, SIDE, 2))
+        # the mode is restored to SEMANTIC, not the last one (DEPTH)
+        self.assertTrue(np.array_equal(np.array(api.render()), semantic))
+        self.assertFalse(np.array_equal(semantic, rgb[-1]))
+
+        for i, pose in enumerate(poses):
+            set_pose(*pose)
+            for mode, frames in zip(modes, [rgb, depth]):
+                api.setMode(mode)
+                self.assertTrue(np.array_equal(np.array(api.render()), frames[i]))
+
+        received = []
+        api.renderTrajectory(poses, modes,
+                             lambda i, mode, frame: received.append((i, mode, np.array(frame))))
+        self.assertEqual([(i, m) for i, m, _ in received],
+                         [(i, m) for i in range(6) for m in modes])
+        self.assertTrue(np.array_equal(received[-1][2], depth[-1]))
+
+        out_dir = tempfile.mkdtemp()
+        try:
+            api.renderTrajectory(poses, modes, out_dir, ext='png', threads=2)
+            for name in ['rgb', 'depth']:
+                self.assertEqual(sorted(os.listdir(os.path.join(out_dir, name))),
+                                 ['{:06d}.png'.format(i) for i in range(6)])
+        finally:
+            shutil.rmtree(out_dir)
+
+
+class TestRenderServer(unittest.TestCase):
+    def test_client(self):
+        import shutil
+        import subprocess
+        import tempfile
+        import time
+        from House3D.renderclient import RenderClient, RenderServerError
+        server = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                              '../renderer/render-server.bin')
+        cfg = load_config('config.json')
+        houseID, house = find_first_good_house(cfg)
+        tmp_dir = tempfile.mkdtemp()
+        # the other client uses another house, or this one under another path,
+        # so that the shared context switches scenes between the clients
+        others = [h for h in sorted(os.listdir(cfg['prefix'])) if h != houseID and
+                  os.path.isfile(os.path.join(cfg['prefix'], h, 'house.obj'))]
+        if others:
+            other_obj = os.path.join(cfg['prefix'], others[0], 'house.obj')
+        else:
+            os.symlink(os.path.join(cfg['prefix'], houseID), os.path.join(tmp_dir, 'house'))
+            other_obj = os.path.join(tmp_dir, 'house', 'house.obj')
+        modes = [RenderMode.RGB, RenderMode.DEPTH, RenderMode.SEMANTIC]
+
+        api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
+        api.loadScene(other_obj, cfg['modelCategoryFile'], cfg['colorFile'])
+        other_expected = []
+        for mode in modes:
+            api.setMode(mode)
+            other_expected.append(np.array(api.render()))
+        env = Environment(api, house, cfg)
+
+        sock = os.path.join(tmp_dir, 'server.sock')
+        proc = subprocess.Popen([server, sock, '--width', str(SIDE), '--height', str(SIDE),
+                                 '--contexts', '1'])
+        try:
+            deadline = time.time() + 60
+            while not os.path.exists(sock):
+                self.assertIsNone(proc.poll(), 'render-server.bin exited')
+                self.assertLess(time.time(), deadline, 'render-server.bin did not start')
+                time.sleep(0.1)
+            with self.assertRaises(RenderServerError):
+                RenderClient(SIDE + 1, SIDE, socket_path=sock)
+            client = RenderClient(SIDE, SIDE, socket_path=sock)
+            other = RenderClient(SIDE, SIDE, socket_path=sock)
+            client_env = Environment(client, house, cfg)
+            other.loadScene(other_obj, cfg['modelCategoryFile'], cfg['colorFile'])
+            location = house.getRandomLocation(ROOM_TYPE)
+            env.reset(*location)
+            client_env.reset(*location)
+            for mode, expected in zip(modes, other_expected):
+                env.set_render_mode(mode)
+                client_env.set_render_mode(mode)
+                other.setMode(mode)
+                self.assertTrue(np.array_equal(np.array(other.render()), expected))
+                self.assertTrue(np.array_equal(env.render(), client_env.render()))
+                self.assertTrue(np.array_equal(np.array(other.render()), expected))
+                self.assertTrue(np.array_equal(env.render_cube_map(),
+                                               client_env.render_cube_map()))
+        finally:
+            proc.terminate()
+            proc.wait()
+            shutil.rmtree(tmp_dir)
+
+
+class TestCpuList(unittest.TestCase):
+    def test_parse(self):
+        parse = objrender.parseCpuList
+        self.assertEqual(parse('0-3,8,10-11'), [0, 1, 2, 3, 8, 10, 11])
+        self.assertEqual(parse('5'), [5])
+        self.assertEqual(parse('2,0-1,1'), [0, 1, 2])
+        # as read from /sys/devices/system/node/node0/cpulist
+        self.assertEqual(parse('0-3,8\n'), [0, 1, 2, 3, 8])
+        self.assertEqual(parse(' 1 , 3-4 ,\t7 '), [1, 3, 4, 7])
+        self.assertEqual(parse(''), [])
+        self.assertEqual(parse('\n'), [])
+        # not expanded without bound
+        self.assertEqual(len(parse('0-65535,0-65535')), 65536)
+        for s in ['a', '1,x', '3-1', '-1', '1-2-3', '1-', '1 2', '0-4294967295', '65536']:
+            with self.assertRaises(RuntimeError):
+                parse(s)
+
+    def test_format(self):
+        fmt = objrender.formatCpuList
+        self.assertEqual(fmt([0, 1, 2, 3, 8, 10, 11]), '0-3,8,10-11')
+        self.assertEqual(fmt([5]), '5')
+        self.assertEqual(fmt([]), '')
+        for s in ['0-3,8,10-11', '0,2,4', '0-63']:
+            self.assertEqual(fmt(objrender.parseCpuList(s)), s)
+
+
+class TestBatchedDraw(unittest.TestCase):
+    def test_same_as_per_mesh(self):
+        cfg = load_config('config.json')
+        houseID, house = find_first_good_house(cfg)
+        location = house.getRandomLocation(ROOM_TYPE)
+        modes = [RenderMode.RGB, RenderMode.SEMANTIC, RenderMode.INSTANCE,
+                 RenderMode.DEPTH, RenderMode.INVDEPTH]
+        images = []
+        for batch in ['1', '0']:   # read when the scene is loaded
+            os.environ['HOUSE3D_BATCH_DRAW'] = batch
+            try:
+                api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
+                env = Environment(api, house, cfg)
+                env.reset(*location)
+            finally:
+                del os.environ['HOUSE3D_BATCH_DRAW']
+            frames = []
+            for mode in modes:
+                api.setMode(mode)
+                frames.append(np.array(api.render(), copy=True))
+            images.append(frames)
+            del env, api
+        for batched, per_mesh in zip(*images):
+            self.assertTrue(np.array_equal(batched, per_mesh))
+
+
+class TestLevelOfDetail(unittest.TestCase):
+    def test_close_to_full(self):
+        cfg = load_config('config.json')
+        houseID, house = find_first_good_house(cfg)
+        location = house.getRandomLocation(ROOM_TYPE)
+        images = []
+        for levels in [1, 3]:
+            api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
+            api.setLevelOfDetail(levels)
+            env = Environment(api, house, cfg)
+            env.reset(*location)
+            api.setMode(RenderMode.SEMANTIC)
+            images.append(np.array(api.render(), copy=True))
+            del env, api
+        same = np.all(images[0] == images[1], axis=2).mean()
+        self.assertGreater(same, 0.95)
+
+    def test_far_is_coarser(self):
+        cfg = load_config('config.json')
+        houseID, house = find_first_good_house(cfg)
+        api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
+        api.setLevelOfDetail(3)
+        env = Environment(api, house, cfg)
+        env.reset(*house.getRandomLocation(ROOM_TYPE))
+        api.setMode(RenderMode.SEMANTIC)
+        api.render()
+        near = api.getLevelOfDetailStats()
+        self.assertGreater(near['meshes_with_lod'], 0)
+        self.assertLessEqual(near['drawn_triangles'], near['full_triangles'])
+
+        cam = api.getCamera()
+        cam.pos = cam.pos - 50 * cam.front
+        api.render()
+        far = api.getLevelOfDetailStats()
+        self.assertGreater(far['mean_level'], near['mean_level'])
+        self.assertLess(far['drawn_triangles'], near['drawn_triangles'])
+        self.assertEqual(far['full_triangles'], near['full_triangles'])
+
+
+class TestHiddenCategories(unittest.TestCase):
+    def test_hide(self):
+        api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
+        with self.assertRaises(RuntimeError):
+            api.setHiddenCategories(['chair'])
+        with self.assertRaises(RuntimeError):
+            api.getHiddenCategories()
+        cfg = load_config('config.json')
+        houseID, house = find_first_good_house(cfg)
+        env = Environment(api, house, cfg)
+        env.reset(*house.getRandomLocation(ROOM_TYPE))
+        api.setMode(RenderMode.SEMANTIC)
+
+        full = np.array(api.render(), copy=True)
+        api.setHiddenCategories(['Wall', 'chair'])
+        self.assertEqual(api.getHiddenCategories(), ['wall', 'chair'])
+        hidden = np.array(api.render(), copy=True)
+        self.assertFalse(np.array_equal(full, hidden))
+        api.setHiddenCategories([])
+        self.assertTrue(np.array_equal(full, api.render()))
+
+
+class TestFlatRGB(SyntheticHouseTest):
+    def test_flat(self):
+        cfg = self.cfg
+        obj, = self.make_houses(1, rooms=2, textures=2, texture_size=64)
+        api = objrender.RenderAPI(w=SIDE, h=SIDE, device=0)
+        api.loadScene(obj, cfg['modelCategoryFile'], cfg['colorFile'])
+        api.setMode(RenderMode.RGB_FLAT)
+        flat = np.array(api.render(), copy=True)
+        self.assertEqual(flat.shape, (SIDE, SIDE, 3))
+        self.assertEqual(api.getMemoryStats()[obj]['texture'], 0)
+
+        api.setMode(RenderMode.RGB)
+        rgb = np.array(api.render(), copy=True)
+        self.assertGreater(api.getMemoryStats()[obj]['texture'], 0)
+        self.assertFalse(np.array_equal(flat, rgb))
+        api.setMode(RenderMode.RGB_FLAT)
+        self.assertTrue(np.array_equal(flat, api.render()))
+
+
 if __name__ == '__main__':
     unittest.main()